@@ -18,7 +18,7 @@ BTreeNode::BTreeNode(HeapFile &file, BlockID block_id, const KeyProfile& key_pro
 }
 
 BTreeNode::~BTreeNode() {
-    delete this->block;
+    this->file.unpin(this->block);
     this->block = nullptr;
 }
 
@@ -28,53 +28,118 @@ void BTreeNode::save() {
 
 // Get the record and turn it into a block ID.
 BlockID BTreeNode::get_block_id(RecordID record_id) const {
-    Dbt *dbt = this->block->get(record_id);
-    BlockID block_id = *(BlockID *)dbt->get_data();
-    delete dbt;
-    return block_id;
+    Dbt dbt;
+    this->block->get(record_id, dbt);
+    return *(BlockID *)dbt.get_data();
 }
 
 // Get the record and turn it into a Handle.
 Handle BTreeNode::get_handle(RecordID record_id) const {
-    Dbt *dbt = this->block->get(record_id);
-    BlockID handle_block_id = *(BlockID *)dbt->get_data();
-    RecordID handle_record_id = *(RecordID *)((char*)dbt->get_data() + sizeof(BlockID));
-    delete dbt;
+    Dbt dbt;
+    this->block->get(record_id, dbt);
+    BlockID handle_block_id = *(BlockID *)dbt.get_data();
+    RecordID handle_record_id = *(RecordID *)((char*)dbt.get_data() + sizeof(BlockID));
     return Handle(handle_block_id, handle_record_id);
 }
 
-// Get the record and turn it into a KeyValue.
+// Get the record and turn it into a KeyValue, decoding it straight out of the block.
 KeyValue *BTreeNode::get_key(RecordID record_id) const {
-    Dbt *dbt = this->block->get(record_id);
-    char *bytes = (char*)dbt->get_data();
+    Dbt dbt;
+    this->block->get(record_id, dbt);
+    const char *bytes = (const char*)dbt.get_data();
     KeyValue *key_value = new KeyValue();
-    Value value;
+    key_value->reserve(this->key_profile.size());
     uint offset = 0;
     for (auto const& data_type: this->key_profile) {
-        value.data_type = data_type;
         if (data_type == ColumnAttribute::DataType::INT) {
-            value.n = *(int32_t*)(bytes + offset);
+            key_value->emplace_back(*(const int32_t*)(bytes + offset));
             offset += sizeof(int32_t);
         } else if (data_type == ColumnAttribute::DataType::TEXT) {
-            uint16_t size = *(uint16_t *)(bytes + offset);
+            uint16_t size = *(const uint16_t *)(bytes + offset);
             offset += sizeof(uint16_t);
-            char buffer[DbBlock::BLOCK_SZ];
-            memcpy(buffer, bytes+offset, size);
-            buffer[size] = '\0';
-            value.s = std::string(buffer);  // assume ascii for now
+            key_value->emplace_back(bytes + offset, size);  // assume ascii for now
             offset += size;
         } else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
-            value.n = *(uint8_t*)(bytes + offset);
+            key_value->emplace_back((int32_t)*(const uint8_t*)(bytes + offset));
+            key_value->back().data_type = data_type;
             offset += sizeof(uint8_t);
         } else {
             throw DbRelationError("Only know how to unmarshal INT, TEXT, or BOOLEAN");
         }
-        key_value->push_back(value);
     }
-    delete dbt;
+    if (offset < dbt.get_size())  // the NULL bitmap
+        for (uint i = 0; i < this->key_profile.size(); i++)
+            if (bytes[offset + i / 8] & (1 << (i % 8)))
+                (*key_value)[i] = Value::null(this->key_profile[i]);
     return key_value;
 }
 
+// Where a data type sorts among the others, same as Value::operator<.
+static int type_rank(ColumnAttribute::DataType data_type) {
+    if (data_type == ColumnAttribute::DataType::BOOLEAN)
+        return 0;
+    if (data_type == ColumnAttribute::DataType::INT)
+        return 1;
+    return 2;
+}
+
+// The NULL bitmap trailing a marshaled key, if it has one: a bit for each key column, set for NULL.
+// Keys without a NULL in them leave it off, so they look just as they always have.
+const char *BTreeNode::null_bitmap(const Dbt &dbt) const {
+    const char *bytes = (const char*)dbt.get_data();
+    uint offset = 0;
+    for (auto const& data_type: this->key_profile) {
+        if (data_type == ColumnAttribute::DataType::INT)
+            offset += sizeof(int32_t);
+        else if (data_type == ColumnAttribute::DataType::TEXT)
+            offset += sizeof(uint16_t) + *(const uint16_t*)(bytes + offset);
+        else
+            offset += sizeof(uint8_t);
+    }
+    return offset < dbt.get_size() ? bytes + offset : nullptr;
+}
+
+// Compare key to the marshaled key in a record, reading it in place: <0, 0, >0 like strcmp.
+// A key that is a prefix of the stored one sorts before it, as with KeyValue's operator<,
+// unless prefix is set, in which case they compare equal. NULLs go first, as with Value's.
+int BTreeNode::compare_key(const KeyValue &key, RecordID record_id, bool prefix) const {
+    Dbt dbt;
+    this->block->get(record_id, dbt);
+    const char *bytes = (const char*)dbt.get_data();
+    const char *nulls = null_bitmap(dbt);
+    uint offset = 0;
+    for (uint i = 0; i < this->key_profile.size(); i++) {
+        if (i == key.size())
+            return prefix ? 0 : -1;
+        const Value &value = key[i];
+        ColumnAttribute::DataType data_type = this->key_profile[i];
+        if (value.data_type != data_type)
+            return type_rank(value.data_type) < type_rank(data_type) ? -1 : 1;
+        bool null = nulls != nullptr && (nulls[i / 8] & (1 << (i % 8)));
+        if (value.is_null() != null)
+            return value.is_null() ? -1 : 1;
+        if (data_type == ColumnAttribute::DataType::INT) {
+            int32_t n = *(const int32_t*)(bytes + offset);
+            if (!null && value.n != n)
+                return value.n < n ? -1 : 1;
+            offset += sizeof(int32_t);
+        } else if (data_type == ColumnAttribute::DataType::TEXT) {
+            uint16_t size = *(const uint16_t*)(bytes + offset);
+            offset += sizeof(uint16_t);
+            int cmp = null ? 0 : value.compare_text(bytes + offset, size);
+            if (cmp != 0)
+                return cmp;
+            offset += size;
+        } else {
+            int32_t n = *(const uint8_t*)(bytes + offset);
+            if (!null && value.n != n)
+                return value.n < n ? -1 : 1;
+            offset += sizeof(uint8_t);
+        }
+    }
+    return key.size() > this->key_profile.size() ? 1 : 0;
+}
+
 // Convert block_id into bytes.
 Dbt *BTreeNode::marshal_block_id(BlockID block_id) {
     char *bytes = new char[sizeof(BlockID)];
@@ -94,47 +159,75 @@ Dbt *BTreeNode::marshal_handle(Handle handle) {
 
 // Convert KeyValue into bytes.
 Dbt *BTreeNode::marshal_key(const KeyValue *key) {
-    char *bytes = new char[DbBlock::BLOCK_SZ]; // more than we need
+    u_long total = key_size(key, this->key_profile) - 4;
+    if (total > this->file.get_block_size())
+        throw DbRelationError("index key too big to marshal");
+    char *bytes = new char[total];
     uint offset = 0;
     uint col_num = 0;
     for (auto const& data_type: this->key_profile) {
-        Value value = (*key)[col_num];
+        const Value &value = (*key)[col_num];
 
         if (data_type == ColumnAttribute::DataType::INT) {
-            if (offset + 4 > DbBlock::BLOCK_SZ - 4)
-                throw DbRelationError("index key too big to marshal");
-
-            *(int32_t*) (bytes + offset) = value.n;
+            *(int32_t*) (bytes + offset) = value.is_null() ? 0 : value.n;
             offset += sizeof(int32_t);
 
         } else if (data_type == ColumnAttribute::DataType::TEXT) {
-            u_long size = (uint16_t) value.s.length();
-            if (size > UINT16_MAX)
+            u_long size = value.text_size();
+            if (size > UINT16_MAX) {
+                delete[] bytes;
                 throw DbRelationError("text field too long to marshal");
-            if (offset + 2 + size > DbBlock::BLOCK_SZ)
-                throw DbRelationError("index key too big to marshal");
-
+            }
             *(uint16_t*) (bytes + offset) = (uint16_t) size;
             offset += sizeof(uint16_t);
-            memcpy(bytes+offset, value.s.c_str(), size); // assume ascii for now
+            memcpy(bytes+offset, value.text_data(), size); // assume ascii for now
             offset += size;
 
         } else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
-            if (offset + 1 > DbBlock::BLOCK_SZ - 1)
-                throw DbRelationError("index key too big to marshal");
-
-            *(uint8_t*) (bytes + offset) = (uint8_t)value.n;
+            *(uint8_t*) (bytes + offset) = value.is_null() ? 0 : (uint8_t)value.n;
             offset += sizeof(uint8_t);
 
         } else {
+            delete[] bytes;
             throw DbRelationError("only know how to marshal INT, TEXT, or BOOLEAN for BTree index");
         }
+        col_num++;
     }
-    char *right_size_bytes = new char[offset];
-    memcpy(right_size_bytes, bytes, offset);
-    delete[] bytes;
-    Dbt *data = new Dbt(right_size_bytes, offset);
-    return data;
+    if (has_null(*key)) {
+        memset(bytes + offset, 0, (this->key_profile.size() + 7) / 8);
+        for (uint i = 0; i < this->key_profile.size(); i++)
+            if ((*key)[i].is_null())
+                bytes[offset + i / 8] |= (char)(1 << (i % 8));
+        offset += (uint)(this->key_profile.size() + 7) / 8;
+    }
+    return new Dbt(bytes, offset);
+}
+
+// Size of the record marshal_key would make, plus its slot header.
+u_long BTreeNode::key_size(const KeyValue *key, const KeyProfile& key_profile) {
+    u_long size = 4;
+    for (uint i = 0; i < key_profile.size(); i++) {
+        if (key_profile[i] == ColumnAttribute::DataType::INT)
+            size += sizeof(int32_t);
+        else if (key_profile[i] == ColumnAttribute::DataType::TEXT)
+            size += sizeof(uint16_t) + (*key)[i].text_size();
+        else
+            size += sizeof(uint8_t);
+    }
+    if (has_null(*key))
+        size += (key_profile.size() + 7) / 8;
+    return size;
+}
+
+bool BTreeNode::has_null(const KeyValue &key) {
+    for (auto const& value: key)
+        if (value.is_null())
+            return true;
+    return false;
+}
+
+bool BTreeNode::underflow() const {
+    return this->block->get_free_space() > get_room() * 3 / 4;
 }
 
 
@@ -178,25 +271,26 @@ void BTreeStat::save() {
  *****************/
 
 BTreeInterior::BTreeInterior(HeapFile &file, BlockID block_id, const KeyProfile& key_profile, bool create)
-        : BTreeNode(file, block_id, key_profile, create), first(0), pointers(), boundaries() {
-    if (!create) {
-        RecordIDs *record_id_list = this->block->ids();
-        RecordID i = 1;
-        for (auto j = record_id_list->size(); j > 0; j--) {
-            if (i == 1) {
+        : BTreeNode(file, block_id, key_profile, create), loaded(create), first(0), pointers(), boundaries() {
+}
+
+// Decode the block into first, boundaries, and pointers.
+void BTreeInterior::load() {
+    if (!this->loaded) {
+        for (auto const& record: *this->block) {
+            if (record.id == 1) {
                 // first pointer
-                this->first = get_block_id(i);
-            } else if (i%2 != 0) {
+                this->first = *(const BlockID *)record.data;
+            } else if (record.id%2 != 0) {
                 // pointer
-                this->pointers.push_back(get_block_id(i));
+                this->pointers.push_back(*(const BlockID *)record.data);
             } else {
                 // key
-                KeyValue *key_value = get_key(i);
+                KeyValue *key_value = get_key(record.id);
                 this->boundaries.push_back(key_value);
             }
-            i++;
         }
-        delete record_id_list;
+        this->loaded = true;
     }
 }
 
@@ -206,30 +300,118 @@ BTreeInterior::~BTreeInterior() {
     this->boundaries.clear();
 }
 
-// Get next block down in tree where key must be.
-BTreeNode *BTreeInterior::find(const KeyValue* key, uint depth) const {
-    BlockID down = this->pointers.back();  // last pointer is correct if we don't find an earlier boundary
-    for (uint i = 0; i < this->boundaries.size(); i++) {
-        KeyValue *boundary = this->boundaries[i];
-        if (*boundary > *key) {
-            if (i > 0)
-                down = this->pointers[i - 1];
-            else
-                down = this->first;
-            break;
-        }
+// Get next block down in tree where key must be (leftmost block if key is nullptr).
+BlockID BTreeInterior::find(const KeyValue* key) const {
+    return get_child(find_index(key));
+}
+
+// Binary search for the first boundary above key, comparing against the keys in the block.
+// The child just before that boundary is where key must be.
+u_long BTreeInterior::find_index(const KeyValue* key) const {
+    u_long lo = 0, hi = key == nullptr ? 0 : get_count();
+    while (lo < hi) {
+        u_long mid = (lo + hi) / 2;
+        if (compare_key(*key, (RecordID)(2 * mid + 2)) < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
     }
-    if (depth == 2)
-        return new BTreeLeaf(this->file, down, this->key_profile, false);
-    else
-        return new BTreeInterior(this->file, down, this->key_profile, false);
+    return lo;
+}
+
+// Records are: first, then a key and a pointer for each boundary
+u_long BTreeInterior::get_count() const {
+    return (this->block->get_num_records() - 1) / 2;
+}
+
+KeyValue BTreeInterior::get_boundary(u_long i) const {
+    KeyValue *key = get_key((RecordID)(2 * i + 2));
+    KeyValue ret = *key;
+    delete key;
+    return ret;
+}
+
+void BTreeInterior::remove(u_long i) {
+    this->load();
+    delete this->boundaries[i];
+    this->boundaries.erase(this->boundaries.begin() + i);
+    this->pointers.erase(this->pointers.begin() + i);
+    save();
+}
+
+void BTreeInterior::set_boundary(u_long i, const KeyValue &boundary) {
+    this->load();
+    *this->boundaries[i] = boundary;
+    save();
+}
+
+// Pull the separator down from the parent and take in everything from right (our right sibling) if it fits.
+bool BTreeInterior::merge(const KeyValue &separator, BTreeInterior &right) {
+    u_long moving = key_size(&separator, this->key_profile)
+                    + get_room() - right.block->get_free_space();
+    if (moving > this->block->get_free_space())
+        return false;
+    this->load();
+    right.load();
+    this->boundaries.push_back(new KeyValue(separator));
+    this->pointers.push_back(right.first);
+    for (u_long i = 0; i < right.boundaries.size(); i++) {
+        this->boundaries.push_back(new KeyValue(*right.boundaries[i]));
+        this->pointers.push_back(right.pointers[i]);
+    }
+    save();
+    return true;
+}
+
+// Even out the children between us and right (our right sibling), rotating keys through the separator.
+KeyValue BTreeInterior::redistribute(const KeyValue &separator, BTreeInterior &right) {
+    this->load();
+    right.load();
+    BlockPointers children;
+    KeyValues keys;  // keys[i] separates children[i] and children[i + 1]
+    children.push_back(this->first);
+    children.insert(children.end(), this->pointers.begin(), this->pointers.end());
+    children.push_back(right.first);
+    children.insert(children.end(), right.pointers.begin(), right.pointers.end());
+    keys.insert(keys.end(), this->boundaries.begin(), this->boundaries.end());
+    keys.push_back(new KeyValue(separator));
+    keys.insert(keys.end(), right.boundaries.begin(), right.boundaries.end());
+    this->boundaries.clear();
+    this->pointers.clear();
+    right.boundaries.clear();
+    right.pointers.clear();
+
+    u_long total = 0;
+    for (auto const& key: keys)
+        total += key_size(key, this->key_profile);
+    u_long split = 1, used = 0;  // we keep children [0, split)
+    while (split < children.size() - 1 && used < total / 2)
+        used += key_size(keys[split++ - 1], this->key_profile);
+
+    this->first = children[0];
+    for (u_long i = 1; i < split; i++) {
+        this->boundaries.push_back(keys[i - 1]);
+        this->pointers.push_back(children[i]);
+    }
+    KeyValue ret = *keys[split - 1];
+    delete keys[split - 1];
+    right.first = children[split];
+    for (u_long i = split + 1; i < children.size(); i++) {
+        right.boundaries.push_back(keys[i - 1]);
+        right.pointers.push_back(children[i]);
+    }
+    save();
+    right.save();
+    return ret;
 }
 
 // Save the pointers and boundaries in the correct order
 void BTreeInterior::save() {
+    this->load();
     Dbt *dbt;
     this->block->clear();
     dbt = marshal_block_id(this->first);
+    this->block->add(dbt);
     delete[] (char *) dbt->get_data();
     delete dbt;
     for (uint i = 0; i < this->boundaries.size(); i++) {
@@ -250,12 +432,13 @@ void BTreeInterior::save() {
 
 // Insert boundary, block_id pair into block.
 Insertion BTreeInterior::insert(const KeyValue* boundary, BlockID block_id) {
+    this->load();
     Dbt *dbt;
 
     bool inserted = false;
     for (uint i = 0; i < this->boundaries.size(); i++) {
         KeyValue *check = this->boundaries[i];
-        if (*boundary == *check) {
+        if (*boundary < *check) {
             this->boundaries.insert(this->boundaries.begin() + i, new KeyValue(*boundary));
             this->pointers.insert(this->pointers.begin() + i, block_id);
             inserted = true;
@@ -309,122 +492,501 @@ Insertion BTreeInterior::insert(const KeyValue* boundary, BlockID block_id) {
 
         // save everything
         nnode->save();
+        delete nnode;
         this->save();
         return ret;
     }
 }
 
 
+// Add boundary, block_id pair past all the others, leaving the block alone until save().
+void BTreeInterior::append(const KeyValue* boundary, BlockID block_id) {
+    this->boundaries.push_back(new KeyValue(*boundary));
+    this->pointers.push_back(block_id);
+}
 
-/*************
- * BTreeLeaf *
- *************/
 
-BTreeLeaf::BTreeLeaf(HeapFile &file, BlockID block_id, const KeyProfile& key_profile, bool create)
-        : BTreeNode(file, block_id, key_profile, create), next_leaf(0), key_map() {
-    if (!create) {
-        RecordIDs *record_id_list = this->block->ids();
-        RecordID i = 1;
-        for (auto j = record_id_list->size(); j > 0; j--) {
-            if (i == record_id_list->size()) {
-                // next leaf block
-                this->next_leaf = get_block_id(i);
-            } else if (i%2 == 0) {
-                // record i-1: handle, record i: key
-                KeyValue *key_value = get_key(i);
-                this->key_map[*key_value] = get_handle(i-1);
-            }
-            i++;
-        }
-        delete record_id_list;
-    }
-}
+/*****************
+ * BTreeOverflow *
+ *****************/
 
-BTreeLeaf::~BTreeLeaf() {
+static const u_long PACKED_HANDLE = sizeof(BlockID) + sizeof(RecordID);  // a handle packed into a postings list
+
+static void pack_handle(char *bytes, Handle handle) {
+    *(BlockID *)bytes = handle.first;
+    *(RecordID *)(bytes + sizeof(BlockID)) = handle.second;
 }
 
-// Find the handle for a given key
-Handle BTreeLeaf::find_eq(const KeyValue* key) const {
-    return this->key_map.at(*key);
+static Handle unpack_handle(const char *bytes) {
+    return Handle(*(const BlockID *)bytes, *(const RecordID *)(bytes + sizeof(BlockID)));
 }
 
-// Save the key_map and next_leaf data in the correct order
-void BTreeLeaf::save() {
-    Dbt *dbt;
-    this->block->clear();
-    for (auto const& item: this->key_map) {
-        // handle
-        dbt = marshal_handle(item.second);
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-        // key
-        dbt = marshal_key(&item.first);
+BTreeOverflow::BTreeOverflow(HeapFile &file, BlockID block_id, const KeyProfile& key_profile, bool create)
+        : BTreeNode(file, block_id, key_profile, create) {
+    if (create) {
+        // start out with just the next pointer; the handles record comes with the first handle
+        Dbt *dbt = marshal_block_id(0);
         this->block->add(dbt);
         delete[] (char *) dbt->get_data();
         delete dbt;
     }
-    // next leaf pointer is final record
-    dbt = marshal_block_id(this->next_leaf);
-    this->block->add(dbt);
+}
+
+void BTreeOverflow::set_next(BlockID next) {
+    Dbt *dbt = marshal_block_id(next);
+    this->block->put(1, *dbt);
     delete[] (char *) dbt->get_data();
     delete dbt;
-    BTreeNode::save();
 }
 
-// Insert key, handle pair into block.
-Insertion BTreeLeaf::insert(const KeyValue* key, Handle handle) {
-    // check unique
-    if (this->key_map.find(*key) != this->key_map.end())
-        throw DbRelationError("Duplicate keys are not allowed in unique index");
-    Dbt *dbt;
-    dbt = marshal_handle(handle);
+u_long BTreeOverflow::get_count() const {
+    Dbt dbt;
+    if (this->block->get_num_records() < 2 || !this->block->get(2, dbt))
+        return 0;
+    return dbt.get_size() / PACKED_HANDLE;
+}
+
+void BTreeOverflow::get_handles(Handles &handles) const {
+    Dbt dbt;
+    if (this->block->get_num_records() < 2 || !this->block->get(2, dbt))
+        return;
+    const char *bytes = (const char *)dbt.get_data();
+    for (u_long at = 0; at < dbt.get_size(); at += PACKED_HANDLE)
+        handles.push_back(unpack_handle(bytes + at));
+}
+
+// Tack handle on after the others, if the block has room.
+bool BTreeOverflow::add(Handle handle) {
+    Dbt dbt;
+    u_long size = 0;
+    if (this->block->get_num_records() >= 2 && this->block->get(2, dbt))
+        size = dbt.get_size();
+    char *bytes = new char[size + PACKED_HANDLE];
+    if (size > 0)
+        memcpy(bytes, dbt.get_data(), size);
+    pack_handle(bytes + size, handle);
+    Dbt grown(bytes, (u_int32_t)(size + PACKED_HANDLE));
+    bool fits = true;
     try {
-        // following is just a check for size (the save method will redo this in the right order)
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-        dbt = marshal_key(key);
+        if (size == 0)
+            this->block->add(&grown);
+        else
+            this->block->put(2, grown);
+    } catch (DbBlockNoRoomError &e) {
+        fits = false;
+    }
+    delete[] bytes;
+    return fits;
+}
+
+// Take handle out; once the last one goes, the block is left with just its next pointer.
+bool BTreeOverflow::remove(Handle handle) {
+    Dbt dbt;
+    if (this->block->get_num_records() < 2 || !this->block->get(2, dbt))
+        return false;
+    const char *bytes = (const char *)dbt.get_data();
+    u_long size = dbt.get_size();
+    for (u_long at = 0; at < size; at += PACKED_HANDLE) {
+        if (unpack_handle(bytes + at) != handle)
+            continue;
+        if (size == PACKED_HANDLE) {
+            this->block->remove_at(2);
+        } else {
+            char *shrunk = new char[size - PACKED_HANDLE];
+            memcpy(shrunk, bytes, at);
+            memcpy(shrunk + at, bytes + at + PACKED_HANDLE, size - at - PACKED_HANDLE);
+            Dbt smaller(shrunk, (u_int32_t)(size - PACKED_HANDLE));
+            this->block->put(2, smaller);
+            delete[] shrunk;
+        }
+        return true;
+    }
+    return false;
+}
+
+
+/*************
+ * BTreeLeaf *
+ *************/
+
+BTreeLeaf::BTreeLeaf(HeapFile &file, BlockID block_id, const KeyProfile& key_profile, bool create)
+        : BTreeNode(file, block_id, key_profile, create) {
+    if (create) {
+        // start out with just the next leaf pointer
+        Dbt *dbt = marshal_block_id(0);
         this->block->add(dbt);
         delete[] (char *) dbt->get_data();
         delete dbt;
-        // that worked, so no need to split
-        this->key_map[*key] = handle;
-        this->save();
-        return BTreeNode::insertion_none();
+    }
+}
 
-    } catch (DbBlockNoRoomError &e) {
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-        // too big, so split
+BTreeLeaf::~BTreeLeaf() {
+}
+
+// Number of key, handle pairs in the block
+u_long BTreeLeaf::get_count() const {
+    u_long records = this->block->get_num_records();
+    return records == 0 ? 0 : (records - 1) / 2;
+}
 
-        // create the sister and put her to the right
-        BTreeLeaf *nleaf = new BTreeLeaf(this->file, 0, this->key_profile, true);
-        nleaf->next_leaf = this->next_leaf;
-        this->next_leaf = nleaf->id;
+// Compare key to the key of entry i: <0, 0, >0 like strcmp.
+int BTreeLeaf::compare_at(const KeyValue &key, u_long i, bool prefix) const {
+    return compare_key(key, (RecordID)(2 * i + 2), prefix);
+}
 
-        // move half of the entries to the sister
-        auto key_list = this->key_map;       // make a copy of my key_map
-        key_list[*key] = handle;             // add key/handle to it
-        u_long split = key_list.size() / 2;  // figure out how many to keep (the rest move to nleaf)
-        this->key_map.clear();               // empty my list
-        u_long i = 0;
-        KeyValue boundary;
-        for (auto const& item: key_list) {
-            if (i < split) {
-                this->key_map[item.first] = item.second;
-            } else if (i == split) {
-                boundary = item.first;
-                nleaf->key_map[boundary] = item.second;
+// Binary search for the first entry whose key is not below key.
+u_long BTreeLeaf::lower_bound(const KeyValue &key, bool prefix) const {
+    u_long lo = 0, hi = get_count();
+    while (lo < hi) {
+        u_long mid = (lo + hi) / 2;
+        if (compare_at(key, mid, prefix) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Binary search for the first entry whose key is above key.
+u_long BTreeLeaf::upper_bound(const KeyValue &key, bool prefix) const {
+    u_long lo = 0, hi = get_count();
+    while (lo < hi) {
+        u_long mid = (lo + hi) / 2;
+        if (compare_at(key, mid, prefix) >= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+BlockID BTreeLeaf::get_next_leaf() const {
+    return get_block_id(this->block->get_num_records());
+}
+
+void BTreeLeaf::set_next_leaf(BlockID next_leaf) {
+    Dbt *dbt = marshal_block_id(next_leaf);
+    this->block->put(this->block->get_num_records(), *dbt);
+    delete[] (char *) dbt->get_data();
+    delete dbt;
+}
+
+// Append all of entry i's handles: just the one for a unique index, else the postings in the leaf
+// and then down the overflow chain.
+void BTreeLeaf::get_handles_at(u_long i, Handles &handles) const {
+    Dbt dbt;
+    this->block->get((RecordID)(2 * i + 1), dbt);
+    const char *bytes = (const char *)dbt.get_data();
+    if (dbt.get_size() == PACKED_HANDLE) {
+        handles.push_back(unpack_handle(bytes));
+        return;
+    }
+    for (u_long at = sizeof(BlockID); at < dbt.get_size(); at += PACKED_HANDLE)
+        handles.push_back(unpack_handle(bytes + at));
+    BlockID next = *(const BlockID *)bytes;
+    while (next != 0) {
+        BTreeOverflow overflow(this->file, next, this->key_profile, false);
+        overflow.get_handles(handles);
+        next = overflow.get_next();
+    }
+}
+
+// Bytes the postings record for n handles takes up in the leaf, slot header included.
+u_long BTreeLeaf::postings_size(u_long n) {
+    return 4 + sizeof(BlockID) + PACKED_HANDLE * (n < INLINE_HANDLES ? n : INLINE_HANDLES);
+}
+
+// Add handle to the postings of entry i. It stays in the leaf while there is room and the entry
+// has fewer than INLINE_HANDLES there, otherwise it goes into the first overflow block (a new one
+// if that is full). Leaves saving the leaf to the caller.
+void BTreeLeaf::add_posting(u_long i, Handle handle) {
+    RecordID record_id = (RecordID)(2 * i + 1);
+    Dbt dbt;
+    this->block->get(record_id, dbt);
+    u_long size = dbt.get_size();
+    if ((size - sizeof(BlockID)) / PACKED_HANDLE < INLINE_HANDLES) {
+        char *bytes = new char[size + PACKED_HANDLE];
+        memcpy(bytes, dbt.get_data(), size);
+        pack_handle(bytes + size, handle);
+        Dbt grown(bytes, (u_int32_t)(size + PACKED_HANDLE));
+        bool fits = true;
+        try {
+            this->block->put(record_id, grown);
+        } catch (DbBlockNoRoomError &e) {
+            fits = false;
+        }
+        delete[] bytes;
+        if (fits)
+            return;
+    }
+
+    BlockID *overflow = (BlockID *)dbt.get_data();  // the record didn't move, so change the pointer in place
+    if (*overflow != 0) {
+        BTreeOverflow first(this->file, *overflow, this->key_profile, false);
+        if (first.add(handle)) {
+            first.save();
+            return;
+        }
+    }
+    BTreeOverflow fresh(this->file, 0, this->key_profile, true);
+    fresh.set_next(*overflow);
+    fresh.add(handle);
+    fresh.save();
+    *overflow = fresh.get_id();
+}
+
+// Take handle out of the postings of entry i, wherever it is. An overflow block that empties
+// is dropped from the chain (and left unused). Returns true if entry i has no handles left.
+// Leaves saving the leaf to the caller.
+bool BTreeLeaf::remove_posting(u_long i, Handle handle) {
+    RecordID record_id = (RecordID)(2 * i + 1);
+    Dbt dbt;
+    this->block->get(record_id, dbt);
+    const char *bytes = (const char *)dbt.get_data();
+    u_long size = dbt.get_size();
+    for (u_long at = sizeof(BlockID); at < size; at += PACKED_HANDLE) {
+        if (unpack_handle(bytes + at) != handle)
+            continue;
+        char *shrunk = new char[size - PACKED_HANDLE];
+        memcpy(shrunk, bytes, at);
+        memcpy(shrunk + at, bytes + at + PACKED_HANDLE, size - at - PACKED_HANDLE);
+        bool last = size - PACKED_HANDLE == sizeof(BlockID) && *(BlockID *)shrunk == 0;
+        Dbt smaller(shrunk, (u_int32_t)(size - PACKED_HANDLE));
+        this->block->put(record_id, smaller);
+        delete[] shrunk;
+        return last;
+    }
+
+    BlockID *link = (BlockID *)dbt.get_data();
+    BTreeOverflow *previous = nullptr;
+    BlockID next = *link;
+    while (next != 0) {
+        BTreeOverflow *overflow = new BTreeOverflow(this->file, next, this->key_profile, false);
+        if (overflow->remove(handle)) {
+            if (overflow->get_count() > 0) {
+                overflow->save();
+            } else if (previous == nullptr) {
+                *link = overflow->get_next();
             } else {
-                nleaf->key_map[item.first] = item.second;
+                previous->set_next(overflow->get_next());
+                previous->save();
             }
-            i++;
+            delete overflow;
+            delete previous;
+            return size == sizeof(BlockID) && *link == 0;
+        }
+        delete previous;
+        previous = overflow;
+        next = overflow->get_next();
+    }
+    delete previous;
+    throw DbRelationError("handle not found in index");
+}
+
+// Remove handle from the entry for key, and the entry itself once it has no handles left
+void BTreeLeaf::del(const KeyValue* key, Handle handle) {
+    u_long i = lower_bound(*key);
+    if (i == get_count() || compare_at(*key, i) != 0)
+        throw DbRelationError("key not found in index");
+    Dbt dbt;
+    this->block->get((RecordID)(2 * i + 1), dbt);
+    bool last;
+    if (dbt.get_size() == PACKED_HANDLE) {
+        if (get_handle_at(i) != handle)
+            throw DbRelationError("handle not found in index");
+        last = true;
+    } else {
+        last = remove_posting(i, handle);
+    }
+    if (last) {
+        this->block->remove_at((RecordID)(2 * i + 2));
+        this->block->remove_at((RecordID)(2 * i + 1));
+    }
+    this->save();
+}
+
+// Add key, handle pair after all the others (just ahead of the next leaf pointer).
+void BTreeLeaf::append(const KeyValue* key, Handle handle) {
+    Dbt *dbt = marshal_handle(handle);
+    append_record(key, *dbt);
+    delete[] (char *) dbt->get_data();
+    delete dbt;
+}
+
+// Same, but with all the handles for a non-unique key. Those that don't go in the leaf fill
+// new overflow blocks.
+void BTreeLeaf::append(const KeyValue* key, const Handles &handles) {
+    u_long n_inline = handles.size() < INLINE_HANDLES ? handles.size() : INLINE_HANDLES;
+    BlockID first = 0;
+    BTreeOverflow *overflow = nullptr;
+    for (u_long j = n_inline; j < handles.size(); j++) {
+        if (overflow != nullptr && overflow->add(handles[j]))
+            continue;
+        BTreeOverflow *next = new BTreeOverflow(this->file, 0, this->key_profile, true);
+        next->add(handles[j]);
+        if (overflow == nullptr) {
+            first = next->get_id();
+        } else {
+            overflow->set_next(next->get_id());
+            overflow->save();
+            delete overflow;
+        }
+        overflow = next;
+    }
+    if (overflow != nullptr) {
+        overflow->save();
+        delete overflow;
+    }
+
+    u_long size = sizeof(BlockID) + PACKED_HANDLE * n_inline;
+    char *bytes = new char[size];
+    *(BlockID *)bytes = first;
+    for (u_long j = 0; j < n_inline; j++)
+        pack_handle(bytes + sizeof(BlockID) + PACKED_HANDLE * j, handles[j]);
+    Dbt dbt(bytes, (u_int32_t)size);
+    append_record(key, dbt);
+    delete[] bytes;
+}
+
+// Add key with its handle or postings record after all the others.
+void BTreeLeaf::append_record(const KeyValue* key, const Dbt &record) {
+    u_long n = get_count();
+    this->block->insert_at((RecordID)(2 * n + 1), &record);
+    Dbt *dbt = marshal_key(key);
+    this->block->insert_at((RecordID)(2 * n + 2), dbt);
+    delete[] (char *) dbt->get_data();
+    delete dbt;
+}
+
+// Insert key, handle pair into its place in the block, shifting just the slot headers after it.
+// For a non-unique index, a key that is already there just gets handle added to its postings.
+Insertion BTreeLeaf::insert(const KeyValue* key, Handle handle, bool unique) {
+    u_long i = lower_bound(*key);
+    if (i < get_count() && compare_at(*key, i) == 0) {
+        if (unique)
+            throw DbRelationError("Duplicate keys are not allowed in unique index");
+        add_posting(i, handle);
+        this->save();
+        return BTreeNode::insertion_none();
+    }
+
+    Dbt *handle_dbt;
+    if (unique) {
+        handle_dbt = marshal_handle(handle);
+    } else {
+        char *bytes = new char[sizeof(BlockID) + PACKED_HANDLE];
+        *(BlockID *)bytes = 0;
+        pack_handle(bytes + sizeof(BlockID), handle);
+        handle_dbt = new Dbt(bytes, sizeof(BlockID) + PACKED_HANDLE);
+    }
+    Dbt *key_dbt = marshal_key(key);
+    bool fits = true;
+    try {
+        this->block->insert_at((RecordID)(2 * i + 1), handle_dbt);
+        try {
+            this->block->insert_at((RecordID)(2 * i + 2), key_dbt);
+        } catch (DbBlockNoRoomError &e) {
+            this->block->remove_at((RecordID)(2 * i + 1));
+            throw;
         }
+    } catch (DbBlockNoRoomError &e) {
+        fits = false;
+    }
+    delete[] (char *) key_dbt->get_data();
+    delete key_dbt;
 
-        nleaf->save();
+    Insertion ret = BTreeNode::insertion_none();
+    if (!fits)
+        ret = split(key, *handle_dbt, i);
+    else
         this->save();
-        return Insertion(nleaf->id, boundary);
+    delete[] (char *) handle_dbt->get_data();
+    delete handle_dbt;
+    return ret;
+}
+
+// Too big, so split: the upper half of the entries (with key and its record added at position at)
+// moves to a new sister leaf just to our right.
+Insertion BTreeLeaf::split(const KeyValue* key, const Dbt &record, u_long at) {
+    Entries entries = get_entries();
+    entries.insert(entries.begin() + at,
+                   std::make_pair(new KeyValue(*key), std::string((const char *)record.get_data(), record.get_size())));
+    u_long split = entries.size() / 2;
+
+    BTreeLeaf *nleaf = new BTreeLeaf(this->file, 0, this->key_profile, true);
+    nleaf->rebuild(entries, split, entries.size(), get_next_leaf());
+    BlockID nleaf_id = nleaf->id;
+    delete nleaf;
+    rebuild(entries, 0, split, nleaf_id);
+
+    Insertion ret(nleaf_id, *entries[split].first);
+    for (auto const& entry: entries)
+        delete entry.first;
+    return ret;
+}
+
+// Decode all the keys, copying out their handle or postings records as they are.
+BTreeLeaf::Entries BTreeLeaf::get_entries() const {
+    Entries entries;
+    Dbt dbt;
+    for (u_long i = 0; i < get_count(); i++) {
+        this->block->get((RecordID)(2 * i + 1), dbt);
+        entries.push_back(std::make_pair(get_key((RecordID)(2 * i + 2)),
+                                         std::string((const char *)dbt.get_data(), dbt.get_size())));
     }
+    return entries;
 }
 
+// Replace the block's contents with entries [from, to) and the given next leaf pointer.
+void BTreeLeaf::rebuild(const Entries &entries, u_long from, u_long to, BlockID next_leaf) {
+    this->block->clear();
+    Dbt *dbt = marshal_block_id(next_leaf);
+    this->block->add(dbt);
+    delete[] (char *) dbt->get_data();
+    delete dbt;
+    for (u_long i = from; i < to; i++) {
+        Dbt record((void *)entries[i].second.data(), (u_int32_t)entries[i].second.size());
+        append_record(entries[i].first, record);
+    }
+    this->save();
+}
+
+// Take in all of right's entries (right is the next leaf) if they fit.
+bool BTreeLeaf::merge(BTreeLeaf &right) {
+    u_long moving = get_room() - right.block->get_free_space() - BTreeNode::POINTER_SIZE;
+    if (moving > this->block->get_free_space())
+        return false;
+    Entries entries = right.get_entries();
+    for (auto const& entry: entries) {
+        Dbt record((void *)entry.second.data(), (u_int32_t)entry.second.size());
+        append_record(entry.first, record);
+        delete entry.first;
+    }
+    set_next_leaf(right.get_next_leaf());
+    this->save();
+    return true;
+}
+
+// Even out the entries between us and right (the next leaf) by bytes.
+KeyValue BTreeLeaf::redistribute(BTreeLeaf &right) {
+    Entries entries = get_entries();
+    Entries right_entries = right.get_entries();
+    entries.insert(entries.end(), right_entries.begin(), right_entries.end());
+    u_long total = 0;
+    for (auto const& entry: entries)
+        total += 4 + entry.second.size() + key_size(entry.first, this->key_profile);
+    u_long split = 0, used = 0;
+    while (split < entries.size() - 1 && used < total / 2) {
+        used += 4 + entries[split].second.size() + key_size(entries[split].first, this->key_profile);
+        split++;
+    }
+    if (split == 0)
+        split = 1;
+
+    rebuild(entries, 0, split, right.id);
+    right.rebuild(entries, split, entries.size(), right.get_next_leaf());
+    KeyValue ret = *entries[split].first;
+    for (auto const& entry: entries)
+        delete entry.first;
+    return ret;
+}
@@ -20,6 +20,14 @@ public:
 
     BlockID get_id() const { return this->id; }
 
+    static u_long room(uint block_size) { return block_size - 8; }  // bytes for records and their headers in an empty block
+    u_long get_room() const { return room(this->file.get_block_size()); }
+    static const u_long POINTER_SIZE = sizeof(BlockID) + 4;  // block id record, with its header
+    static const u_long HANDLE_SIZE = sizeof(BlockID) + sizeof(RecordID) + 4;  // handle record, with its header
+    static u_long key_size(const KeyValue *key, const KeyProfile& key_profile);  // bytes a key record takes, with its header
+    static bool has_null(const KeyValue &key);
+    bool underflow() const;  // less than a quarter full, so worth merging or evening out with a sibling
+
 protected:
     SlottedPage *block;
     HeapFile &file;
@@ -33,6 +41,8 @@ protected:
     virtual BlockID get_block_id(RecordID record_id) const;
     virtual Handle get_handle(RecordID record_id) const;
     virtual KeyValue* get_key(RecordID record_id) const;
+    const char *null_bitmap(const Dbt &dbt) const;  // nullptr if the key has no NULLs
+    int compare_key(const KeyValue &key, RecordID record_id, bool prefix=false) const;
 };
 
 class BTreeStat : public BTreeNode {
@@ -62,29 +72,88 @@ public:
     BTreeInterior(HeapFile &file, BlockID block_id, const KeyProfile& key_profile, bool create);
     virtual ~BTreeInterior();
 
-    BTreeNode *find(const KeyValue* key, uint depth) const;
+    BlockID find(const KeyValue* key) const;  // child to descend to; searches the block in place
+    u_long find_index(const KeyValue* key) const;  // same, but which child it is
     Insertion insert(const KeyValue* boundary, BlockID block_id);
+    void append(const KeyValue* boundary, BlockID block_id);  // for bulk loading: goes last, unchecked and unsaved
     virtual void save();
 
     void set_first(BlockID first) { this->first = first; }
 
+    // Child i is first for 0, otherwise the pointer after boundary i-1; all read from the block.
+    u_long get_count() const;  // number of boundaries
+    BlockID get_child(u_long i) const { return get_block_id((RecordID)(2 * i + 1)); }
+    KeyValue get_boundary(u_long i) const;
+
+    // For deletion: each saves what it changes.
+    void remove(u_long i);  // boundary i and the child after it
+    void set_boundary(u_long i, const KeyValue &boundary);
+    bool merge(const KeyValue &separator, BTreeInterior &right);  // false if it won't fit
+    KeyValue redistribute(const KeyValue &separator, BTreeInterior &right);  // returns the new separator
+
 protected:
+    // decoded from the block only when we are about to change it
+    bool loaded;
     BlockID first;
     BlockPointers pointers;
     KeyValues boundaries;
+
+    void load();
+};
+
+// Handles for a key with more rows than fit in its leaf entry: records are the next overflow block
+// (0 for none) and then all the handles packed together.
+class BTreeOverflow : public BTreeNode {
+public:
+    BTreeOverflow(HeapFile &file, BlockID block_id, const KeyProfile& key_profile, bool create);
+    virtual ~BTreeOverflow() {}
+
+    BlockID get_next() const { return get_block_id(1); }
+    void set_next(BlockID next);
+    u_long get_count() const;
+    void get_handles(Handles &handles) const;  // appends ours
+    bool add(Handle handle);  // false if full; unsaved
+    bool remove(Handle handle);  // false if not here; unsaved
 };
 
 class BTreeLeaf : public BTreeNode {
 public:
+    static const u_long INLINE_HANDLES = 64;  // most handles a non-unique entry keeps in the leaf before overflowing
+
     BTreeLeaf(HeapFile &file, BlockID block_id, const KeyProfile& key_profile, bool create);
     virtual ~BTreeLeaf();
 
-    Handle find_eq(const KeyValue* key) const;  // throws if not found
-    Insertion insert(const KeyValue* key, Handle handle);
-    virtual void save();
+    Insertion insert(const KeyValue* key, Handle handle, bool unique);  // non-unique keys gather handles
+    void del(const KeyValue* key, Handle handle);  // throws if not found
+    void append(const KeyValue* key, Handle handle);  // for bulk loading: goes last, unchecked
+    void append(const KeyValue* key, const Handles &handles);  // same, for a non-unique key
+    static u_long postings_size(u_long n);  // bytes the entry record for n handles of a non-unique key takes in the leaf
+
+    // Entries are kept in key order right in the block: handle, key, handle, key, ..., next_leaf.
+    // A non-unique index has a postings record in place of each handle: the first overflow block
+    // (0 for none), then up to INLINE_HANDLES handles; the rest are in the chain of BTreeOverflow blocks.
+    // Searches compare keys in place; with prefix, a key matches any entry it is a prefix of.
+    u_long get_count() const;
+    Handle get_handle_at(u_long i) const { return get_handle((RecordID)(2 * i + 1)); }  // unique indices only
+    void get_handles_at(u_long i, Handles &handles) const;  // appends all of entry i's handles
+    int compare_at(const KeyValue &key, u_long i, bool prefix=false) const;
+    u_long lower_bound(const KeyValue &key, bool prefix=false) const;  // first entry not below key
+    u_long upper_bound(const KeyValue &key, bool prefix=false) const;  // first entry above key
+    BlockID get_next_leaf() const;
+    void set_next_leaf(BlockID next_leaf);
+
+    // For deletion: each saves what it changes.
+    bool merge(BTreeLeaf &right);  // false if it won't fit
+    KeyValue redistribute(BTreeLeaf &right);  // returns right's new first key
 
 protected:
-    BlockID next_leaf;
-    std::map<KeyValue,Handle> key_map;
+    typedef std::vector<std::pair<KeyValue*,std::string>> Entries;  // keys with their handle or postings records
+
+    Insertion split(const KeyValue* key, const Dbt &record, u_long at);
+    Entries get_entries() const;  // caller deletes the keys
+    void rebuild(const Entries &entries, u_long from, u_long to, BlockID next_leaf);
+    void append_record(const KeyValue* key, const Dbt &record);
+    void add_posting(u_long i, Handle handle);
+    bool remove_posting(u_long i, Handle handle);  // true if that was the last one
 };
 
@@ -1,4 +1,5 @@
 #include "EvalPlan.h"
+#include "schema_tables.h"
 
 
 class Dummy : public DbRelation {
@@ -21,23 +22,42 @@ public:
 };
 
 EvalPlan::EvalPlan(PlanType type, EvalPlan *relation)
-        : type(type), relation(relation), projection(nullptr), select_conjunction(nullptr), table(Dummy::one()) {
+        : type(type), relation(relation), projection(nullptr), select_conjunction(nullptr), select_ranges(nullptr),
+          table(Dummy::one()), index(nullptr) {
 }
 
 EvalPlan::EvalPlan(ColumnNames *projection, EvalPlan *relation)
-        : type(Project), relation(relation), projection(projection), select_conjunction(nullptr), table(Dummy::one()) {
+        : type(Project), relation(relation), projection(projection), select_conjunction(nullptr), select_ranges(nullptr),
+          table(Dummy::one()), index(nullptr) {
 }
 
 EvalPlan::EvalPlan(ValueDict* conjunction, EvalPlan *relation)
-        : type(Select), relation(relation), projection(nullptr), select_conjunction(conjunction), table(Dummy::one()) {
+        : type(Select), relation(relation), projection(nullptr), select_conjunction(conjunction), select_ranges(nullptr),
+          table(Dummy::one()), index(nullptr) {
+}
+
+EvalPlan::EvalPlan(ValueDict* conjunction, ValueRanges* ranges, EvalPlan *relation)
+        : type(Select), relation(relation), projection(nullptr), select_conjunction(conjunction), select_ranges(ranges),
+          table(Dummy::one()), index(nullptr) {
 }
 
 EvalPlan::EvalPlan(DbRelation &table)
-        : type(TableScan), relation(nullptr), projection(nullptr), select_conjunction(nullptr), table(table) {
+        : type(TableScan), relation(nullptr), projection(nullptr), select_conjunction(nullptr), select_ranges(nullptr),
+          table(table), index(nullptr) {
+}
+
+EvalPlan::EvalPlan(DbIndex &index, DbRelation &table, ValueDict *key)
+        : type(IndexLookup), relation(nullptr), projection(nullptr), select_conjunction(key), select_ranges(nullptr),
+          table(table), index(&index) {
+}
+
+EvalPlan::EvalPlan(DbIndex &index, DbRelation &table, ValueDict *prefix, ValueRanges *range)
+        : type(IndexRange), relation(nullptr), projection(nullptr), select_conjunction(prefix), select_ranges(range),
+          table(table), index(&index) {
 }
 
 EvalPlan::EvalPlan(const EvalPlan *other)
-        : type(other->type), table(other->table) {
+        : type(other->type), table(other->table), index(other->index) {
     if (other->relation != nullptr)
         relation = new EvalPlan(other->relation);
     else
@@ -50,52 +70,181 @@ EvalPlan::EvalPlan(const EvalPlan *other)
         select_conjunction = new ValueDict(*other->select_conjunction);
     else
         select_conjunction = nullptr;
+    if (other->select_ranges != nullptr)
+        select_ranges = new ValueRanges(*other->select_ranges);
+    else
+        select_ranges = nullptr;
 }
 
 EvalPlan::~EvalPlan() {
     delete relation;
     delete projection;
     delete select_conjunction;
+    delete select_ranges;
 }
 
 
-EvalPlan *EvalPlan::optimize() {
-    return new EvalPlan(this);  // For now, we don't know how to do anything better
+EvalPlan *EvalPlan::optimize(Indices *indices) {
+    if (indices != nullptr && this->type == Select && this->relation->type == TableScan) {
+        EvalPlan *indexed = this->index_plan(*indices);
+        if (indexed != nullptr)
+            return indexed;
+    }
+    EvalPlan *ret = new EvalPlan(this);
+    if (this->relation != nullptr) {
+        delete ret->relation;
+        ret->relation = this->relation->optimize(indices);
+    }
+    return ret;
 }
 
-ValueDicts *EvalPlan::evaluate() {
-    ValueDicts *ret = nullptr;
+// Replace this Select-over-TableScan with a scan of the index that answers the most of its predicates, followed
+// by a Select of whatever is left over. Returns nullptr if no index helps.
+EvalPlan *EvalPlan::index_plan(Indices &indices) const {
+    DbRelation &table = this->relation->table;
+    Identifier table_name = table.get_table_name();
+    ValueDict equalities;
+    ValueRanges ranges;
+    if (this->select_conjunction != nullptr)
+        equalities = *this->select_conjunction;
+    if (this->select_ranges != nullptr)
+        ranges = *this->select_ranges;
+
+    Identifier best_name;
+    ColumnNames best_columns;
+    uint best_prefix = 0;
+    bool best_full = false, best_range = false, best_hash = false;
+    for (auto const& index_name: indices.get_index_names(table_name)) {
+        ColumnNames key_columns;
+        bool is_hash, is_unique;
+        indices.get_columns(table_name, index_name, key_columns, is_hash, is_unique);
+
+        // how many leading key columns are pinned by equalities, and is the next one bounded by a range
+        uint prefix = 0;
+        while (prefix < key_columns.size() && equalities.find(key_columns[prefix]) != equalities.end())
+            prefix++;
+        bool full = prefix == key_columns.size();
+        bool range = !full && ranges.find(key_columns[prefix]) != ranges.end();
+        if (prefix == 0 && !range)
+            continue;
+        if (is_hash && !full)
+            continue;  // hash indices only look up whole keys
+
+        // a whole key beats a partial one, then the more key columns used the better, then hashing beats a tree
+        if (best_name.empty() || (full && !best_full)
+            || (full == best_full && prefix + range > best_prefix + best_range)
+            || (full == best_full && prefix + range == best_prefix + best_range && is_hash && !best_hash)) {
+            best_name = index_name;
+            best_columns = key_columns;
+            best_prefix = prefix;
+            best_full = full;
+            best_range = range;
+            best_hash = is_hash;
+        }
+    }
+    if (best_name.empty())
+        return nullptr;
+
+    DbIndex &index = indices.get_index(table_name, best_name);
+    ValueDict *key = new ValueDict();
+    for (uint i = 0; i < best_prefix; i++) {
+        (*key)[best_columns[i]] = equalities[best_columns[i]];
+        equalities.erase(best_columns[i]);
+    }
+    EvalPlan *plan;
+    if (best_full) {
+        plan = new EvalPlan(index, table, key);
+    } else {
+        ValueRanges *range = new ValueRanges();
+        if (best_range) {
+            (*range)[best_columns[best_prefix]] = ranges[best_columns[best_prefix]];
+            ranges.erase(best_columns[best_prefix]);
+        }
+        plan = new EvalPlan(index, table, key, range);
+    }
+
+    if (equalities.empty() && ranges.empty())
+        return plan;
+    return new EvalPlan(new ValueDict(equalities), new ValueRanges(ranges), plan);
+}
+
+Rows *EvalPlan::evaluate() {
+    Rows *ret = nullptr;
     if (this->type != ProjectAll && this->type != Project)
         throw DbRelationError("Invalid evaluation plan--not ending with a projection");
 
     EvalPipeline pipeline = this->relation->pipeline();
     DbRelation *temp_table = pipeline.first;
-    Handles *handles = pipeline.second;
-    if (this->type == ProjectAll)
-        ret = temp_table->project(handles);
-    else if (this->type == Project)
-        ret = temp_table->project(handles, this->projection);
-    delete handles;
+    DbCursor *cursor = pipeline.second;
+    ColumnNames all;  // empty for all of them
+    RowLayoutPtr layout = temp_table->get_layout(this->type == ProjectAll ? &all : this->projection);
+    ret = new Rows();
+    Handles batch;  // a run of handles from the same block, so it is fetched once for all of them
+    Handle handle;
+    cursor->open();
+    while (cursor->next(handle)) {
+        if (!batch.empty() && batch.back().first != handle.first)
+            project_batch(temp_table, layout, batch, ret);
+        batch.push_back(handle);
+    }
+    project_batch(temp_table, layout, batch, ret);
+    cursor->close();
+    delete cursor;
     return ret;
 }
 
+// Project a batch of handles onto the end of rows and empty the batch.
+void EvalPlan::project_batch(DbRelation *table, RowLayoutPtr layout, Handles &batch, Rows *rows) {
+    if (batch.empty())
+        return;
+    table->project(&batch, layout, *rows);
+    batch.clear();
+}
+
 EvalPipeline EvalPlan::pipeline() {
     // base cases
     if (this->type == TableScan)
-        return EvalPipeline(&this->table, this->table.select());
-    if (this->type == Select && this->relation->type == TableScan)
-        return EvalPipeline(&this->relation->table, this->relation->table.select(this->select_conjunction));
+        return EvalPipeline(&this->table, this->table.cursor());
+    if (this->type == IndexLookup) {
+        this->index->open();
+        return EvalPipeline(&this->table, new HandlesCursor(this->index->lookup(this->select_conjunction)));
+    }
+    if (this->type == IndexRange) {
+        // both bounds start with the leading key columns, then the range (if any) on the next key column
+        ValueDict min_key(*this->select_conjunction), max_key(*this->select_conjunction);
+        bool min_inclusive = true, max_inclusive = true;
+        for (auto const& column: *this->select_ranges) {
+            const ValueRange &range = column.second;
+            if (range.has_min) {
+                min_key[column.first] = range.min;
+                min_inclusive = range.min_inclusive;
+            } else if (range.has_max) {
+                // just past the NULLs, which sort first but are in no range
+                min_key[column.first] = Value::null(range.max.data_type);
+                min_inclusive = false;
+            }
+            if (range.has_max) {
+                max_key[column.first] = range.max;
+                max_inclusive = range.max_inclusive;
+            }
+        }
+        this->index->open();
+        Handles *handles = this->index->range(min_key.empty() ? nullptr : &min_key,
+                                              max_key.empty() ? nullptr : &max_key, min_inclusive, max_inclusive);
+        return EvalPipeline(&this->table, new HandlesCursor(handles));
+    }
+    if (this->type == Select && this->relation->type == TableScan) {
+        DbRelation &table = this->relation->table;
+        return EvalPipeline(&table, table.cursor(this->select_conjunction, this->select_ranges));
+    }
 
     // recursive case
     if (this->type == Select) {
         EvalPipeline pipeline = this->relation->pipeline();
         DbRelation *temp_table = pipeline.first;
-        Handles *handles = pipeline.second;
-        EvalPipeline ret(temp_table, temp_table->select(handles, this->select_conjunction));
-        delete handles;
-        return ret;
+        return EvalPipeline(temp_table, temp_table->cursor(pipeline.second, this->select_conjunction,
+                                                           this->select_ranges));
     }
 
-    throw DbRelationError("Not implemented: pipeline other than Select or TableScan");
+    throw DbRelationError("Not implemented: pipeline other than Select, TableScan, IndexLookup, or IndexRange");
 }
-
@@ -2,8 +2,9 @@
 
 #include "storage_engine.h"
 
+class Indices;
 
-typedef std::pair<DbRelation*,Handles*> EvalPipeline;
+typedef std::pair<DbRelation*,DbCursor*> EvalPipeline;  // cursor is unopened and freed by caller
 
 class EvalPlan {
 public:
@@ -11,21 +12,26 @@ public:
         ProjectAll,
         Project,
         Select,
-        TableScan
+        TableScan,
+        IndexLookup,
+        IndexRange
     };
 
     EvalPlan(PlanType type, EvalPlan *relation);  // use for ProjectAll, e.g., EvalPlan(EvalPlan::ProjectAll, table);
     EvalPlan(ColumnNames *projection, EvalPlan *relation); // use for Project
     EvalPlan(ValueDict* conjunction, EvalPlan *relation);  // use for Select
+    EvalPlan(ValueDict* conjunction, ValueRanges* ranges, EvalPlan *relation);  // use for Select with range predicates
     EvalPlan(DbRelation &table);  // use for TableScan
+    EvalPlan(DbIndex &index, DbRelation &table, ValueDict *key);  // use for IndexLookup
+    EvalPlan(DbIndex &index, DbRelation &table, ValueDict *prefix, ValueRanges *range);  // use for IndexRange
     EvalPlan(const EvalPlan *other);  // use for copying
     virtual ~EvalPlan();
 
-    // Attempt to get the best equivalent evaluation plan
-    EvalPlan *optimize();
+    // Attempt to get the best equivalent evaluation plan, using any of the table's indices that help
+    EvalPlan *optimize(Indices *indices = nullptr);
 
-    // Evaluate the plan: evaluate gets values, pipeline gets handles
-    ValueDicts *evaluate();
+    // Evaluate the plan: evaluate gets values (rows freed by caller), pipeline gets handles
+    Rows *evaluate();
     EvalPipeline pipeline();
 
 protected:
@@ -33,7 +39,12 @@ protected:
     PlanType type;
     EvalPlan *relation;  // for everything except TableScan
     ColumnNames *projection;  // for Project
-    ValueDict *select_conjunction;  // for Select
-    DbRelation &table;  // for TableScan
+    ValueDict *select_conjunction;  // for Select, IndexLookup (the key), and IndexRange (leading key columns)
+    ValueRanges *select_ranges;  // for Select and IndexRange (at most the key column after the leading ones)
+    DbRelation &table;  // for TableScan, IndexLookup, and IndexRange
+    DbIndex *index;  // for IndexLookup and IndexRange
+
+    void project_batch(DbRelation *table, RowLayoutPtr layout, Handles &batch, Rows *rows);
+    EvalPlan *index_plan(Indices &indices) const;
 };
 
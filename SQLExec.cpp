@@ -7,6 +7,7 @@
 #include "ParseTreeToString.h"
 #include "schema_tables.h"
 #include "EvalPlan.h"
+#include "btree.h"
 #include <algorithm>
 using namespace std;
 using namespace hsql;
@@ -25,14 +26,18 @@ ostream &operator<<(ostream &out, const QueryResult &qres) {
             out << "----------+";
         out << endl;
         for (auto const &row: *qres.rows) {
-            for (auto const &column_name: *qres.column_names) {
-                Value value = row->at(column_name);
+            for (unsigned int i = 0; i < row->size(); i++) {
+                const Value &value = (*row)[i];
+                if (value.is_null()) {
+                    out << "NULL ";
+                    continue;
+                }
                 switch (value.data_type) {
                     case ColumnAttribute::INT:
                         out << value.n;
                         break;
                     case ColumnAttribute::TEXT:
-                        out << "\"" << value.s << "\"";
+                        out << "\"" << value.text() << "\"";
                         break;
                     case ColumnAttribute::BOOLEAN:
 						out << (value.n == 0 ? "false" : "true");
@@ -66,7 +71,7 @@ QueryResult::~QueryResult() {
 
 //EXECUTE
 //Executes Query statement
-QueryResult *SQLExec::execute(const SQLStatement *statement) throw(SQLExecError) {
+QueryResult *SQLExec::execute(const SQLStatement *statement, const ValueDict *with) throw(SQLExecError) {
     //initialize table and indices
     if (SQLExec::tables == nullptr) {
         SQLExec::tables = new Tables();
@@ -77,7 +82,7 @@ QueryResult *SQLExec::execute(const SQLStatement *statement) throw(SQLExecError)
     try {
         switch (statement->type()) {
             case kStmtCreate:
-                return create((const CreateStatement *) statement);
+                return create((const CreateStatement *) statement, with);
             case kStmtDrop:
                 return drop((const DropStatement *) statement);
             case kStmtShow:
@@ -139,13 +144,22 @@ QueryResult *SQLExec::insert(const InsertStatement *statement) {
     //create index on new values
     IndexNames index_names = SQLExec::indices->get_index_names(tableID);
     u_long nIndex = index_names.size();
-    for (auto const& index_name: index_names) {
-        try {
+    IndexNames done;
+    try {
+        for (auto const& index_name: index_names) {
             DbIndex& index = SQLExec::indices->get_index(tableID, index_name);
+            index.open();
             index.insert(t_insert);
-        // since we do not have delete set up, we catch duplication problems here
-        // and do nothing since the index exists
-        } catch (DbRelationError& e) {}
+            done.push_back(index_name);
+        }
+    } catch (DbRelationError& e) {
+        // e.g. a duplicate key: back the row out of the indices it made it into, and out of the table
+        try {
+            for (auto const& index_name: done)
+                SQLExec::indices->get_index(tableID, index_name).del(t_insert);
+            table.del(t_insert);
+        } catch (...) {}
+        throw;
     }
 
     // create print string
@@ -157,48 +171,95 @@ QueryResult *SQLExec::insert(const InsertStatement *statement) {
     return new QueryResult(returnStatment);
 }
 
+/*
+ * gets the value of a literal on the right-hand side of a comparison, a helper for get_where_conjunction
+ * @param Expr* expr -a literal expression
+ * @return Value of the literal
+ */
+static Value get_literal(const Expr *expr)
+{
+    switch (expr->type)
+    {
+    case kExprLiteralString:
+        return Value(expr->name);
+    case kExprLiteralInt:
+        return Value(expr->ival);
+    default:
+        throw DbRelationError("Data type not implemented");
+    }
+}
+
 /*
  * parses the where clause of a statment, a helper function for select/delete
  * @param Expr* expr -of type kOpExpression;
- * @return ValueDict representation of the expression
+ * @param ValueRanges* ranges -returned by reference: bounds from <, <=, >, >= and BETWEEN
+ * @return ValueDict representation of the equality predicates in the expression
  */
-ValueDict *get_where_conjunction(const Expr *expr)
+ValueDict *get_where_conjunction(const Expr *expr, ValueRanges *ranges)
 {
     ValueDict *where = new ValueDict();
     if (expr->opType == Expr::SIMPLE_OP && expr->opChar == '=')
     {       
-        Identifier colname = expr->expr->name;
-        switch (expr->expr2->type)
-        {
-        case kExprLiteralString:
-            (*where)[colname] = Value(expr->expr2->name);
-            break;
-        case kExprLiteralInt:
-            (*where)[colname] = Value(expr->expr2->ival);
-            break;
-        case kExprLiteralFloat:
-            (*where)[colname] = Value(expr->expr2->fval);
-        default:
-            throw DbRelationError("Data type not implemented");
-        }
+        (*where)[expr->expr->name] = get_literal(expr->expr2);
+    }
+    else if (expr->opType == Expr::SIMPLE_OP && expr->opChar == '<')
+    {
+        (*ranges)[expr->expr->name].restrict_max(get_literal(expr->expr2), false);
+    }
+    else if (expr->opType == Expr::SIMPLE_OP && expr->opChar == '>')
+    {
+        (*ranges)[expr->expr->name].restrict_min(get_literal(expr->expr2), false);
+    }
+    else if (expr->opType == Expr::LESS_EQ)
+    {
+        (*ranges)[expr->expr->name].restrict_max(get_literal(expr->expr2), true);
+    }
+    else if (expr->opType == Expr::GREATER_EQ)
+    {
+        (*ranges)[expr->expr->name].restrict_min(get_literal(expr->expr2), true);
+    }
+    //BETWEEN low AND high, inclusive at both ends
+    else if (expr->opType == Expr::BETWEEN)
+    {
+        ValueRange &range = (*ranges)[expr->expr->name];
+        range.restrict_min(get_literal(expr->exprList->at(0)), true);
+        range.restrict_max(get_literal(expr->exprList->at(1)), true);
     }
     //AND
     else if (expr->opType == Expr::AND)
     {                           
-        ValueDict *temp = get_where_conjunction(expr->expr); 
+        ValueDict *temp = get_where_conjunction(expr->expr, ranges);
         where->insert(temp->begin(), temp->end());           
-        temp = get_where_conjunction(expr->expr2);           
+        delete temp;
+        temp = get_where_conjunction(expr->expr2, ranges);
         where->insert(temp->begin(), temp->end());           
         delete temp;
     }
     //something we haven't gotten to yet
     else
     {
+        delete where;
         throw DbRelationError("Where clause not supported");
     }
     return where;
 }
 
+/*
+ * builds the plan for the rows of a table matching a where clause, a helper function for select/delete
+ * @param Identifier table_name -table to scan
+ * @param Expr* expr -where clause, or nullptr for every row
+ * @return EvalPlan giving the matching rows
+ */
+EvalPlan *SQLExec::where_plan(Identifier table_name, const Expr *expr)
+{
+    EvalPlan *plan = new EvalPlan(SQLExec::tables->get_table(table_name));
+    if (expr == nullptr)
+        return plan;
+    ValueRanges *ranges = new ValueRanges();
+    ValueDict *where = get_where_conjunction(expr, ranges);
+    return new EvalPlan(where, ranges, plan);
+}
+
 /*
  * DELETE
  * Executes a delete statment (from a table/index)
@@ -207,51 +268,35 @@ ValueDict *get_where_conjunction(const Expr *expr)
  */
 QueryResult *SQLExec::del(const DeleteStatement *statement) {
     Identifier tableID = statement->tableName;
-    DbRelation& table = SQLExec::tables->get_table(tableID);
-    ColumnNames trueNames;
-    ColumnAttributes column_attributes;
-    SQLExec::tables->get_columns(tableID, trueNames, column_attributes);
-    Expr* expr = statement->expr;
-    ValueDict* where = nullptr;
-    if (statement->expr != nullptr)
-        where = get_where_conjunction(expr);
     // make eval plan
-    
-    EvalPlan* plan = new EvalPlan(table);
-    EvalPlan* optPlan;
-    
-    if (where) {
-        EvalPlan selectPlan = EvalPlan(where, plan);
-        optPlan = selectPlan.optimize();
-    } else
-        optPlan = plan->optimize();
-    //evaluate and get handles from pipeline
+    EvalPlan* plan = where_plan(tableID, statement->expr);
+    EvalPlan* optPlan = plan->optimize(SQLExec::indices);
+    delete plan;
+
+    //stream handles from the pipeline, removing each row as we go
     EvalPipeline result = optPlan->pipeline();
-    //delete plan;
-    delete optPlan;
     DbRelation *to_delete = result.first;
-    Handles *handles = result.second;
-    u_long nRows = handles->size();
-
-
-    //remove from indices
+    DbCursor *cursor = result.second;
     IndexNames index_names = SQLExec::indices->get_index_names(tableID);
     u_long nIndex = index_names.size();
-
-    for (auto const& index_name: index_names) {
-        DbIndex& index = SQLExec::indices->get_index(tableID, index_name);
-        for (auto const& handle: *handles) {
-            try { 
-                index.del(handle);
-            //accounts for the fact that del is not implemented yet
-            }catch (DbRelationError& e) {}
+    u_long nRows = 0;
+    Handle handle;
+    cursor->open();
+    while (cursor->next(handle)) {
+        //remove from indices
+        for (auto const& index_name: index_names) {
+            DbIndex& index = SQLExec::indices->get_index(tableID, index_name);
+            index.open();
+            index.del(handle);
         }
+        // remove from table
+        to_delete->del(handle);
+        nRows++;
     }
+    cursor->close();
+    delete cursor;
+    delete optPlan;
 
-    // remove from table
-    for (auto const& handle: *handles) 
-        to_delete->del(handle);
- 
     // create print string
     string returnStatement;
     if (nRows == 1)
@@ -264,8 +309,6 @@ QueryResult *SQLExec::del(const DeleteStatement *statement) {
     else
         returnStatement += string(" and ") + to_string(nIndex) + string(" indices");
    
-     //free memory
-    delete handles; 
     return new QueryResult(returnStatement);
 }
 
@@ -279,10 +322,7 @@ QueryResult *SQLExec::select(const SelectStatement *statement) {
     DbRelation& table = SQLExec::tables->get_table(statement->fromTable->name);
     ColumnNames *column_names = new ColumnNames;
     ColumnAttributes *column_attributes = new ColumnAttributes;
-    EvalPlan *plan = new EvalPlan(table);
-
-    if (statement->whereClause != nullptr)
-        plan = new EvalPlan(get_where_conjunction(statement->whereClause), plan);
+    EvalPlan *plan = where_plan(statement->fromTable->name, statement->whereClause);
 
     if (statement->selectList->at(0)->type == kExprStar) {
         *column_names = table.get_column_names();
@@ -293,8 +333,8 @@ QueryResult *SQLExec::select(const SelectStatement *statement) {
         plan = new EvalPlan(column_names, plan);
     }
 
-    EvalPlan *optimized = plan->optimize();
-    ValueDicts *rows = optimized->evaluate();
+    EvalPlan *optimized = plan->optimize(SQLExec::indices);
+    Rows *rows = optimized->evaluate();
     column_attributes = table.get_column_attributes(*column_names);
  
     delete optimized;
@@ -324,20 +364,20 @@ void SQLExec::column_definition(const ColumnDefinition *col, Identifier& column_
 
 //CREATE
 //Creates a table or index based on input statement
-QueryResult *SQLExec::create(const CreateStatement *statement) {
+QueryResult *SQLExec::create(const CreateStatement *statement, const ValueDict *with) {
     switch(statement->type) {
         case CreateStatement::kTable:
-            return create_table(statement);
+            return create_table(statement, with);
         case CreateStatement::kIndex:
-            return create_index(statement);
+            return create_index(statement, with);
         default:
             return new QueryResult("Only CREATE TABLE and CREATE INDEX are implemented");
     }
 }
 
 //CREATE TABLE
-//Will create a table with defined columns of names and attributes
-QueryResult *SQLExec::create_table(const CreateStatement *statement) {
+//Will create a table with defined columns of names and attributes, stored the way with says
+QueryResult *SQLExec::create_table(const CreateStatement *statement, const ValueDict *with) {
     //Identifiers and column variables
     Identifier tableID;
     Identifier column_name;
@@ -348,6 +388,29 @@ QueryResult *SQLExec::create_table(const CreateStatement *statement) {
 
     //get statement info
     tableID= statement->tableName;
+    string storage = "heap";
+    uint block_size = 0;
+    string compression = "none";
+    if (with != nullptr) {
+        for (auto const &option: *with) {
+            if (option.first == "storage")
+                storage = option.second.text();
+            else if (option.first == "block_size")
+                block_size = block_size_option(option.second);
+            else if (option.first == "compression")
+                compression = option.second.text();
+            else
+                throw SQLExecError("unknown table option " + option.first);
+        }
+        if (storage != "heap" && storage != "column")
+            throw SQLExecError("unknown storage " + storage + " (heap or column)");
+        if (block_size != 0 && storage != "heap")
+            throw SQLExecError("block_size is only for heap storage");
+        if (compression != "none" && compression != "lz")
+            throw SQLExecError("unknown compression " + compression + " (none or lz)");
+        if (compression != "none" && storage != "heap")
+            throw SQLExecError("compression is only for heap storage");
+    }
 
     //get the attribute of variable for each columns
     for(ColumnDefinition *col: *statement->columns){
@@ -357,7 +420,9 @@ QueryResult *SQLExec::create_table(const CreateStatement *statement) {
     }
     //create a row, get handles
     row["table_name"]= tableID;
+    row["storage"] = Value(storage);
     Handle table_handle = SQLExec::tables->insert(&row);
+    row.erase("storage");
 
     //create column handle
     try {
@@ -373,6 +438,10 @@ QueryResult *SQLExec::create_table(const CreateStatement *statement) {
 
             // Create Relation
             DbRelation& table = SQLExec::tables->get_table(tableID);
+            if (block_size != 0)
+                dynamic_cast<HeapTable&>(table).set_block_size(block_size);
+            if (compression != "none")
+                dynamic_cast<HeapTable&>(table).set_compressed(true);
             //check if table exists already
             if (statement->ifNotExists)
                 table.create_if_not_exists();
@@ -399,12 +468,46 @@ QueryResult *SQLExec::create_table(const CreateStatement *statement) {
     return new QueryResult("created " + tableID);
 }
 
+// WITH (block_size=n): n has to be a power of two a HeapFile can take
+uint SQLExec::block_size_option(const Value &value) {
+    const string &text = value.text();
+    uint block_size = 0;
+    if (!text.empty() && text.size() <= 5 && text.find_first_not_of("0123456789") == string::npos)
+        block_size = (uint)stoul(text);
+    if (block_size < DbBlock::BLOCK_SZ || block_size > DbBlock::MAX_BLOCK_SZ || (block_size & (block_size - 1)) != 0)
+        throw SQLExecError("block_size must be " + to_string(DbBlock::BLOCK_SZ) + ", " + to_string(2 * DbBlock::BLOCK_SZ)
+                           + ", ... or " + to_string(DbBlock::MAX_BLOCK_SZ));
+    return block_size;
+}
+
+// WITH (unique=true|false)
+bool SQLExec::unique_option(const Value &value) {
+    const string &text = value.text();
+    if (text != "true" && text != "false")
+        throw SQLExecError("unique must be true or false");
+    return text == "true";
+}
+
 //CREATE INDEX
-//Creates an index for a table for specific column variables
-QueryResult *SQLExec::create_index(const CreateStatement *statement) {
+//Creates an index for a table for specific column variables, unique or with bigger blocks if with says so
+QueryResult *SQLExec::create_index(const CreateStatement *statement, const ValueDict *with) {
     //Get statement identifiers
     Identifier table_name = statement->tableName;
     Identifier index_name = statement->indexName;
+    uint block_size = 0;
+    bool unique = false;
+    if (with != nullptr) {
+        for (auto const &option: *with) {
+            if (option.first == "block_size")
+                block_size = block_size_option(option.second);
+            else if (option.first == "unique")
+                unique = unique_option(option.second);
+            else
+                throw SQLExecError("unknown index option " + option.first);
+        }
+        if (block_size != 0 && string(statement->indexType) != "BTREE")
+            throw SQLExecError("block_size is only for BTREE indices");
+    }
     //get all column names of index statement
     ColumnNames column_names;
     for (auto const& col : *statement->indexColumns)
@@ -422,7 +525,7 @@ QueryResult *SQLExec::create_index(const CreateStatement *statement) {
             row["column_name"] = column_names[i];
             row["seq_in_index"] = Value(i+1); // start from 1 not 0
             row["index_type"] = Value(string(statement->indexType));
-            row["is_unique"] = Value(string(statement->indexType) == "BTREE");
+            row["is_unique"] = Value(unique);
             c_handles.push_back(SQLExec::indices->insert(&row));    // insert into _indices
             // check if the column(s) specified to the index actually exist in the underlying table.
             where["table_name"] = table_name;                       // predicate2 (table name)
@@ -433,6 +536,8 @@ QueryResult *SQLExec::create_index(const CreateStatement *statement) {
 
         //create index
         DbIndex& indice = SQLExec::indices->get_index(table_name,index_name); // currently has problem here for indice.create
+        if (block_size != 0)
+            dynamic_cast<BTreeIndex&>(indice).set_block_size(block_size);
         indice.create();
         //actually create the index
     // if something wrong, delete all the handles
@@ -591,11 +696,8 @@ QueryResult *SQLExec::show_index(const ShowStatement *statement) {
     u_long n = handles->size();
 
     // use project to get the specific columns
-    ValueDicts* rows = new ValueDicts;
-    for (auto const& handle: *handles) {
-        ValueDict* row = indicesTable.project(handle, column_names);
-        rows->push_back(row);
-    }
+    Rows* rows = new Rows;
+    indicesTable.project(handles, indicesTable.get_layout(column_names), *rows);
     //delete handles
     delete handles;
 
@@ -619,12 +721,15 @@ QueryResult *SQLExec::show_tables() {
     Handles* handles = SQLExec::tables->select();
     u_long n = handles->size() - 3;
 
-    ValueDicts* rows = new ValueDicts;
-    for (auto const& handle: *handles) {
-        ValueDict* row = SQLExec::tables->project(handle, column_names);
-        Identifier table_name = row->at("table_name").s;
+    Rows all;
+    SQLExec::tables->project(handles, SQLExec::tables->get_layout(column_names), all);
+    Rows* rows = new Rows;
+    for (auto row: all) {
+        Identifier table_name = (*row)[0].text();
         if (table_name != Tables::TABLE_NAME && table_name != Columns::TABLE_NAME && table_name != Indices::TABLE_NAME)
             rows->push_back(row);
+        else
+            delete row;
     }
 
     //delete handles
@@ -660,11 +765,8 @@ QueryResult *SQLExec::show_columns(const ShowStatement *statement) {
     u_long n = handles->size();
 
     //project columns to row
-    ValueDicts* rows = new ValueDicts;
-    for (auto const& handle: *handles) {
-        ValueDict* row = columns.project(handle, column_names);
-        rows->push_back(row);
-    }
+    Rows* rows = new Rows;
+    columns.project(handles, columns.get_layout(column_names), *rows);
     //free memory
 
     delete handles;
@@ -673,3 +775,61 @@ QueryResult *SQLExec::show_columns(const ShowStatement *statement) {
     return new QueryResult(column_names, column_attributes, rows,
                            "successfully returned " + to_string(n) + " rows");
 }
+
+// Run one statement through SQLExec, with any WITH options, for test_sql_exec.
+// Returns the result (freed by caller), or nullptr if it didn't parse or was turned away.
+static QueryResult *test_execute(const string &sql, const ValueDict *with=nullptr) {
+    SQLParserResult *parse = SQLParser::parseSQLString(sql);
+    QueryResult *result = nullptr;
+    try {
+        if (parse->isValid())
+            result = SQLExec::execute(parse->getStatement(0), with);
+    } catch (SQLExecError &e) {
+        result = nullptr;
+    }
+    delete parse;
+    return result;
+}
+
+// Run one statement for test_sql_exec, just telling whether it went through.
+static bool test_executes(const string &sql, const ValueDict *with=nullptr) {
+    QueryResult *result = test_execute(sql, with);
+    bool executed = result != nullptr;
+    delete result;
+    return executed;
+}
+
+/**
+ * tests CREATE INDEX through SQLExec: an index takes duplicate keys unless it's created WITH (unique=true)
+ * @return bool true if passes
+ */
+bool test_sql_exec() {
+    ValueDict unique;
+    unique["unique"] = Value("true");
+    bool ok = test_executes("CREATE TABLE _test_sql_exec (a INT, b INT)")
+              && test_executes("CREATE INDEX _test_sql_exec_b ON _test_sql_exec (b) USING BTREE")
+              && test_executes("CREATE INDEX _test_sql_exec_a ON _test_sql_exec (a) USING BTREE", &unique)
+              && test_executes("INSERT INTO _test_sql_exec VALUES (1, 7)")
+              && test_executes("INSERT INTO _test_sql_exec VALUES (2, 7)")  // duplicate b is fine
+              && !test_executes("INSERT INTO _test_sql_exec VALUES (2, 8)");  // duplicate a is not
+
+    // both rows are found through the non-unique index, and the turned-away one is nowhere
+    QueryResult *result = ok ? test_execute("SELECT * FROM _test_sql_exec WHERE b = 7") : nullptr;
+    ok = result != nullptr && result->get_rows()->size() == 2;
+    delete result;
+    result = ok ? test_execute("SELECT * FROM _test_sql_exec WHERE b = 8") : nullptr;
+    ok = result != nullptr && result->get_rows()->empty();
+    delete result;
+
+    // and _indices has it the same way
+    result = ok ? test_execute("SHOW INDEX FROM _test_sql_exec") : nullptr;
+    ok = result != nullptr && result->get_rows()->size() == 2;
+    for (u_long i = 0; ok && i < result->get_rows()->size(); i++) {
+        const Row &row = *result->get_rows()->at(i);
+        ok = (row.at("is_unique").n != 0) == (row.at("index_name").text() == "_test_sql_exec_a");
+    }
+    delete result;
+
+    test_executes("DROP TABLE _test_sql_exec");
+    return ok;
+}
@@ -30,21 +30,21 @@ public:
     QueryResult(std::string message) : column_names(nullptr), column_attributes(nullptr), rows(nullptr),
                                        message(message) {}
 
-    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, ValueDicts *rows, std::string message)
+    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, Rows *rows, std::string message)
             : column_names(column_names), column_attributes(column_attributes), rows(rows), message(message) {}
 
     virtual ~QueryResult();
 
     ColumnNames *get_column_names() const { return column_names; }
     ColumnAttributes *get_column_attributes() const { return column_attributes; }
-    ValueDicts *get_rows() const { return rows; }
+    Rows *get_rows() const { return rows; }
     const std::string &get_message() const { return message; }
     friend std::ostream &operator<<(std::ostream &stream, const QueryResult &qres);
 
 protected:
     ColumnNames *column_names;
     ColumnAttributes *column_attributes;
-    ValueDicts *rows;
+    Rows *rows;  // values in column_names order
     std::string message;
 };
 
@@ -57,9 +57,11 @@ public:
 	/**
 	 * Execute the given SQL statement.
 	 * @param statement   the Hyrise AST of the SQL statement to execute
+	 * @param with        options from a WITH (name=value, ...) clause after a CREATE TABLE or INDEX,
+	 *                    which the parser doesn't know about, or nullptr
 	 * @returns           the query result (freed by caller)
 	 */
-    static QueryResult *execute(const hsql::SQLStatement *statement) throw(SQLExecError);
+    static QueryResult *execute(const hsql::SQLStatement *statement, const ValueDict *with=nullptr) throw(SQLExecError);
 
 protected:
 	// the one place in the system that holds the _tables table and _indices table
@@ -67,9 +69,9 @@ protected:
     static Indices *indices;
 
 	// recursive decent into the AST
-    static QueryResult *create(const hsql::CreateStatement *statement);
-    static QueryResult *create_table(const hsql::CreateStatement *statement);
-    static QueryResult *create_index(const hsql::CreateStatement *statement);
+    static QueryResult *create(const hsql::CreateStatement *statement, const ValueDict *with);
+    static QueryResult *create_table(const hsql::CreateStatement *statement, const ValueDict *with);
+    static QueryResult *create_index(const hsql::CreateStatement *statement, const ValueDict *with);
 
     static QueryResult *drop(const hsql::DropStatement *statement);
     static QueryResult *drop_table(const hsql::DropStatement *statement);
@@ -91,5 +93,28 @@ protected:
 	 * @param column_attributes  returned by reference
 	 */
     static void column_definition(const hsql::ColumnDefinition *col, Identifier &column_name, ColumnAttribute &column_attribute);
+
+	/**
+	 * Pull the block size out of a WITH option's value
+	 * @param value  the block_size option
+	 * @return       bytes per block, checked to be one a file can have
+	 */
+    static uint block_size_option(const Value &value);
+
+	/**
+	 * Pull whether an index is unique out of a WITH option's value
+	 * @param value  the unique option
+	 * @return       true for unique=true, false for unique=false
+	 */
+    static bool unique_option(const Value &value);
+
+	/**
+	 * Build the plan for the rows of a table matching a where clause
+	 * @param table_name  table to scan
+	 * @param where       AST where clause, or nullptr for every row
+	 * @return            plan giving the matching rows (freed by caller)
+	 */
+    static EvalPlan *where_plan(Identifier table_name, const hsql::Expr *where);
 };
 
+bool test_sql_exec();
@@ -26,14 +26,13 @@ BTreeIndex::BTreeIndex(DbRelation& relation, Identifier name, ColumnNames key_co
           root(nullptr),
           file(relation.get_table_name() + "-" + name),
           key_profile() {
-    if (!unique)
-        throw DbRelationError("BTree index must have unique key");
-        this->build_key_profile();
+    this->build_key_profile();
 }
 /*
  * destructor for BTreeIndex
  */
 BTreeIndex::~BTreeIndex() {
+    this->clear_node_cache();
     if (this->stat != nullptr)
         delete this->stat;
         
@@ -44,29 +43,139 @@ BTreeIndex::~BTreeIndex() {
 }
 
 /*
- * create the index
+ * create the index, bulk loading the rows already in the relation
  */
 void BTreeIndex::create() {
 	this->file.create();
     this->stat = new BTreeStat(this->file, this->STAT, this->STAT + 1, this->key_profile);
-    this->root = new BTreeLeaf(this->file, this->stat->get_root_id(), this->key_profile, true);
     this->closed = false;
-    // build the index/ insert already existing rows
     try {
-        for (auto const& handle: *this->relation.select()) {
-            this->insert(handle);
-        }
+        this->bulk_load();
     //if create fails, drop what you have done
     }catch (DbRelationError& e) {
-        this->file.drop();
+        this->drop();
         throw;
     }
 }
 
+double BTreeIndex::fill_factor = 0.9;
+
+/*
+ * Build the tree bottom-up: sort the keys from one scan of the relation, pack leaves
+ * left to right, then pack each interior level over the one below it until there is
+ * just a root. Every block is written once.
+ */
+void BTreeIndex::bulk_load() {
+    typedef std::pair<KeyValue, Handle> Entry;
+    typedef std::pair<KeyValue, BlockID> Child;  // a node's smallest key and where it is
+
+    // one sequential scan for the keys
+    Handles *handles = this->relation.select();
+    ValueDicts *rows = this->relation.project(handles, &this->key_columns);
+    std::vector<Entry> entries;
+    entries.reserve(handles->size());
+    for (u_long i = 0; i < handles->size(); i++) {
+        KeyValue *key = this->tkey((*rows)[i]);
+        entries.push_back(Entry(*key, (*handles)[i]));
+        delete key;
+        delete (*rows)[i];
+    }
+    delete rows;
+    delete handles;
+    std::sort(entries.begin(), entries.end());  // by key, then handle
+    if (this->unique)  // keys with a NULL in them are never duplicates
+        for (u_long i = 1; i < entries.size(); i++)
+            if (!(entries[i - 1].first < entries[i].first) && !BTreeNode::has_null(entries[i].first))
+                throw DbRelationError("Duplicate keys are not allowed in unique index");
+
+    // leaves, each chained to the next as soon as the next one exists
+    u_long room = (u_long)(fill_factor * BTreeNode::room(this->file.get_block_size()));
+    std::vector<Child> level;
+    BTreeLeaf *leaf = new BTreeLeaf(this->file, 0, this->key_profile, true);
+    level.push_back(Child(entries.empty() ? KeyValue() : entries[0].first, leaf->get_id()));
+    u_long used = BTreeNode::POINTER_SIZE;  // next_leaf
+    for (u_long i = 0, j; i < entries.size(); i = j) {
+        // entries [i, j) share a key, which can only happen in a non-unique index or with NULLs
+        const KeyValue &key = entries[i].first;
+        for (j = i + 1; j < entries.size() && !(key < entries[j].first); j++)
+            ;
+        bool single = this->unique && !BTreeNode::has_null(key);  // just a handle, not postings
+        u_long size = (single ? BTreeNode::HANDLE_SIZE : BTreeLeaf::postings_size(j - i))
+                      + BTreeNode::key_size(&key, this->key_profile);
+        if (used + size > room && leaf->get_count() > 0) {
+            BTreeLeaf *next = new BTreeLeaf(this->file, 0, this->key_profile, true);
+            leaf->set_next_leaf(next->get_id());
+            leaf->save();
+            delete leaf;
+            leaf = next;
+            level.push_back(Child(key, leaf->get_id()));
+            used = BTreeNode::POINTER_SIZE;
+        }
+        if (single) {
+            leaf->append(&key, entries[i].second);
+        } else {
+            Handles handles;
+            for (u_long k = i; k < j; k++)
+                handles.push_back(entries[k].second);
+            leaf->append(&key, handles);
+        }
+        used += size;
+    }
+    leaf->save();
+    delete leaf;
+    entries.clear();
+
+    // interior levels
+    uint height = 1;
+    while (level.size() > 1) {
+        // group the children, each group's first one going in as the node's first pointer
+        std::vector<std::vector<Child>> groups(1);
+        used = 0;
+        for (auto const& child: level) {
+            u_long size = BTreeNode::POINTER_SIZE + BTreeNode::key_size(&child.first, this->key_profile);
+            if (groups.back().size() > 1 && used + size > room) {
+                groups.push_back(std::vector<Child>());
+                used = 0;
+            }
+            used += groups.back().empty() ? BTreeNode::POINTER_SIZE : size;
+            groups.back().push_back(child);
+        }
+        // a node needs at least one boundary, so borrow one from its left sibling if not
+        if (groups.size() > 1 && groups.back().size() == 1) {
+            std::vector<Child> &left = groups[groups.size() - 2];
+            groups.back().insert(groups.back().begin(), left.back());
+            left.pop_back();
+        }
+
+        std::vector<Child> parents;
+        for (auto const& group: groups) {
+            BTreeInterior *node = new BTreeInterior(this->file, 0, this->key_profile, true);
+            node->set_first(group[0].second);
+            for (u_long i = 1; i < group.size(); i++)
+                node->append(&group[i].first, group[i].second);
+            node->save();
+            parents.push_back(Child(group[0].first, node->get_id()));
+            delete node;
+        }
+        level.swap(parents);
+        height++;
+    }
+
+    this->stat->set_root_id(level[0].second);
+    this->stat->set_height(height);
+    this->stat->save();
+    if (height == 1)
+        this->root = new BTreeLeaf(this->file, level[0].second, this->key_profile, false);
+    else
+        this->root = new BTreeInterior(this->file, level[0].second, this->key_profile, false);
+}
+
 /* 
  * Drop the index.
  */
 void BTreeIndex::drop() {
+    if (!this->closed)
+        this->close();
     this->file.drop();
 }
 
@@ -90,11 +199,13 @@ void BTreeIndex::open() {
  *  Closes the index. Disables: lookup, range, insert, delete, update.
  */
 void BTreeIndex::close() {
-	this->file.close();
+    // release our pinned blocks before the file lets go of its buffer pool
+    clear_node_cache();
     delete stat;
     delete root;
     stat = nullptr;
     root = nullptr;
+	this->file.close();
     this->closed = true;
 }
 
@@ -106,33 +217,81 @@ void BTreeIndex::close() {
  * @return Handles  to lookup result
  */
 Handles* BTreeIndex::lookup(ValueDict* key_dict) const {
-	Handles* handles =  this->_lookup(this->root, this->stat->get_height(), this->tkey(key_dict));
+    KeyValue* key = this->tkey(key_dict);
+	Handles* handles =  this->_lookup(this->root, this->stat->get_height(), key);
+    delete key;
     return handles;
 }
 
 //recursive function for lookup
 Handles* BTreeIndex::_lookup(BTreeNode *node, uint height, const KeyValue* key) const {
-    Handles* handles = new Handles; 
     if (height == 1){
-        try{
-            BTreeLeaf* leafNode = (BTreeLeaf*)node;
-            Handle handle = leafNode->find_eq(key);
-            handles->push_back(handle);
-        } catch (...){}
+        Handles* handles = new Handles;
+        BTreeLeaf* leafNode = (BTreeLeaf*)node;
+        u_long i = leafNode->lower_bound(*key);
+        if (i < leafNode->get_count() && leafNode->compare_at(*key, i) == 0)
+            leafNode->get_handles_at(i, *handles);
         return handles;
     } else {
         BTreeInterior* intNode = (BTreeInterior*)node;
-        return this->_lookup(intNode->find(key, height), height-1, key);
+        BTreeNode* child = this->get_node(intNode->find(key), height - 1);
+        Handles* handles = this->_lookup(child, height-1, key);
+        this->release(child);
+        return handles;
     }
 }
 
 /*
- * for selecting/inserting/deleting over a range
- * NOT IMPLMENTED
+ * Find all the rows whose keys fall between min_key and max_key.
+ * Descends once to the leaf where min_key would be, then follows the
+ * next_leaf chain until a key goes past max_key.
+ * @param ValueDict* min_key - lower bound (nullptr for none), may give just leading key columns
+ * @param ValueDict* max_key - upper bound (nullptr for none), may give just leading key columns
+ * @param bool min_inclusive - whether keys equal to min_key qualify
+ * @param bool max_inclusive - whether keys equal to max_key qualify
+ * @return Handles of the qualifying rows, in key order
  */
-Handles* BTreeIndex::range(ValueDict* min_key, ValueDict* max_key) const {
-    throw DbRelationError("Don't know how to do a range query on Btree index yet");
-    // FIXME
+Handles* BTreeIndex::range(ValueDict* min_key, ValueDict* max_key, bool min_inclusive, bool max_inclusive) const {
+    KeyValue *min = min_key == nullptr ? nullptr : this->tkey_prefix(min_key);
+    KeyValue *max = max_key == nullptr ? nullptr : this->tkey_prefix(max_key);
+    Handles* handles = new Handles;
+
+    // descend to the leaf that min would be in
+    BTreeNode *node = this->root;
+    for (uint height = this->stat->get_height(); height > 1; height--) {
+        BTreeNode *child = this->get_node(((BTreeInterior*)node)->find(min), height - 1);
+        this->release(node);
+        node = child;
+    }
+
+    // walk the leaves from there until we pass max; a prefix min can match entries in several leaves,
+    // so each leaf skips whatever is still below it
+    BTreeLeaf *leaf = (BTreeLeaf*)node;
+    bool done = false;
+    while (!done) {
+        u_long i = 0;
+        if (min != nullptr)
+            i = min_inclusive ? leaf->lower_bound(*min, true) : leaf->upper_bound(*min, true);
+        for (; i < leaf->get_count(); i++) {
+            if (max != nullptr) {
+                int cmp = leaf->compare_at(*max, i, true);
+                if (cmp < 0 || (cmp == 0 && !max_inclusive)) {
+                    done = true;
+                    break;
+                }
+            }
+            leaf->get_handles_at(i, *handles);
+        }
+        BlockID next = leaf->get_next_leaf();
+        this->release(leaf);
+        if (next == 0)
+            break;
+        if (!done)
+            leaf = new BTreeLeaf(this->file, next, this->key_profile, false);
+    }
+    delete min;
+    delete max;
+    return handles;
 }
 
 /* 
@@ -142,7 +301,15 @@ Handles* BTreeIndex::range(ValueDict* min_key, ValueDict* max_key) const {
 void BTreeIndex::insert(Handle handle) {
     ValueDict * row = this->relation.project(handle, &this->key_columns);
     KeyValue *key = this->tkey(row);
-    Insertion split_root = this->_insert(this->root, this->stat->get_height(), key, handle);
+    delete row;
+    Insertion split_root;
+    try {
+        split_root = this->_insert(this->root, this->stat->get_height(), key, handle);
+    } catch (...) {
+        delete key;
+        throw;
+    }
+    delete key;
     //if we split the root, grow the tree up one level
     if (!BTreeNode::insertion_is_none(split_root)) {
         BTreeInterior* newRoot = new BTreeInterior(this->file, 0, this->key_profile, true);
@@ -163,15 +330,25 @@ void BTreeIndex::insert(Handle handle) {
 Insertion BTreeIndex::_insert(BTreeNode *node, uint height, const KeyValue* key, Handle handle) {
     if (height == 1) {
         BTreeLeaf* leafNode = (BTreeLeaf*)node;
-        Insertion retVal = leafNode->insert(key, handle);
+        Insertion retVal = leafNode->insert(key, handle, this->unique && !BTreeNode::has_null(*key));
         leafNode->save();
         return retVal;
     } else {
         BTreeInterior* intNode = (BTreeInterior*)node;
-        Insertion new_kid = this->_insert(intNode->find(key, height), height-1, key, handle);
+        BTreeNode* child = this->get_node(intNode->find(key), height - 1);
+        Insertion new_kid;
+        try {
+            new_kid = this->_insert(child, height-1, key, handle);
+        } catch (...) {
+            this->release(child);
+            throw;
+        }
+        this->release(child);
         if (!BTreeNode::insertion_is_none(new_kid)) {
             Insertion retVal = intNode->insert(&new_kid.second, new_kid.first);
             intNode->save();
+            if (!BTreeNode::insertion_is_none(retVal))
+                this->node_cache.erase(intNode->get_id());  // it split, so the caller's release() deletes it
             return retVal;
         } 
         return BTreeNode::insertion_none();
@@ -179,11 +356,129 @@ Insertion BTreeIndex::_insert(BTreeNode *node, uint height, const KeyValue* key,
 }
 
 /*
- * delete a value from the index NOT IMPLMENTED
+ * delete a row's entry from the index. Row must still exist in relation.
+ * Nodes left less than a quarter full are merged with a sibling, or evened out with it
+ * if the two won't fit in one block, and the tree gets shorter when the root runs out of boundaries.
+ * @param Handle handle of row to remove
  */
 void BTreeIndex::del(Handle handle) {
-    throw DbRelationError("Don't know how to delete from a BTree index yet");
-	// FIXME
+    ValueDict *row = this->relation.project(handle, &this->key_columns);
+    KeyValue *key = this->tkey(row);
+    delete row;
+    try {
+        this->_del(this->root, this->stat->get_height(), key, handle);
+    } catch (...) {
+        delete key;
+        throw;
+    }
+    delete key;
+
+    // a root with only one child left is replaced by that child
+    uint height = this->stat->get_height();
+    if (height > 1 && ((BTreeInterior*)this->root)->get_count() == 0) {
+        BlockID new_root = ((BTreeInterior*)this->root)->get_child(0);
+        delete this->root;
+        auto it = this->node_cache.find(new_root);
+        if (it != this->node_cache.end()) {
+            this->root = it->second;
+            this->node_cache.erase(it);
+        } else if (height - 1 == 1) {
+            this->root = new BTreeLeaf(this->file, new_root, this->key_profile, false);
+        } else {
+            this->root = new BTreeInterior(this->file, new_root, this->key_profile, false);
+        }
+        this->stat->set_root_id(new_root);
+        this->stat->set_height(height - 1);
+        this->stat->save();
+    }
+}
+
+/*
+ *  recursive function for del (private)
+ *  @return true if node is left underfull
+ */
+bool BTreeIndex::_del(BTreeNode *node, uint height, const KeyValue* key, Handle handle) {
+    if (height == 1) {
+        BTreeLeaf *leaf = (BTreeLeaf*)node;
+        leaf->del(key, handle);
+        return leaf->underflow();
+    }
+    BTreeInterior *parent = (BTreeInterior*)node;
+    u_long at = parent->find_index(key);
+    BTreeNode *child = this->get_node(parent->get_child(at), height - 1);
+    bool underflow;
+    try {
+        underflow = this->_del(child, height - 1, key, handle);
+    } catch (...) {
+        this->release(child);
+        throw;
+    }
+    this->release(child);
+    if (underflow)
+        this->rebalance(parent, at, height - 1);
+    return parent->underflow();
+}
+
+/*
+ * Fix up parent's underfull child at (of the given height) together with its right sibling
+ * (or left, if it is the last child): merge them if they fit in one block, otherwise even them out.
+ * A merged-away block is left unused.
+ */
+void BTreeIndex::rebalance(BTreeInterior *parent, u_long at, uint height) {
+    if (parent->get_count() == 0)
+        return;  // no siblings to work with
+    u_long left_at = at < parent->get_count() ? at : at - 1;
+    KeyValue separator = parent->get_boundary(left_at);
+    BTreeNode *left = this->get_node(parent->get_child(left_at), height);
+    BTreeNode *right = this->get_node(parent->get_child(left_at + 1), height);
+    if (height == 1) {
+        if (((BTreeLeaf*)left)->merge(*(BTreeLeaf*)right))
+            parent->remove(left_at);
+        else
+            parent->set_boundary(left_at, ((BTreeLeaf*)left)->redistribute(*(BTreeLeaf*)right));
+    } else {
+        if (((BTreeInterior*)left)->merge(separator, *(BTreeInterior*)right)) {
+            this->node_cache.erase(right->get_id());
+            parent->remove(left_at);
+        } else {
+            parent->set_boundary(left_at, ((BTreeInterior*)left)->redistribute(separator, *(BTreeInterior*)right));
+        }
+    }
+    this->release(left);
+    this->release(right);
+}
+
+uint BTreeIndex::node_cache_capacity = 16;
+
+// Get the node in block_id at the given height (1 for leaves), from the node cache if it's there.
+// Interior nodes are cached as they're first visited, until the cache is full; leaves never are.
+// Hand the node back with release() when done with it.
+BTreeNode *BTreeIndex::get_node(BlockID block_id, uint height) const {
+    if (height == 1)
+        return new BTreeLeaf(this->file, block_id, this->key_profile, false);
+    auto it = this->node_cache.find(block_id);
+    if (it != this->node_cache.end())
+        return it->second;
+    BTreeInterior *node = new BTreeInterior(this->file, block_id, this->key_profile, false);
+    if (this->node_cache.size() < node_cache_capacity)
+        this->node_cache[block_id] = node;
+    return node;
+}
+
+// Done with a node from get_node(): delete it unless it's the root or it's cached.
+void BTreeIndex::release(BTreeNode *node) const {
+    if (node == this->root)
+        return;
+    auto it = this->node_cache.find(node->get_id());
+    if (it == this->node_cache.end() || it->second != node)
+        delete node;
+}
+
+// Empty the node cache, unpinning its blocks.
+void BTreeIndex::clear_node_cache() {
+    for (auto const& entry: this->node_cache)
+        delete entry.second;
+    this->node_cache.clear();
 }
 
 // private method for extracting key values from a ValueDict
@@ -195,6 +490,18 @@ KeyValue *BTreeIndex::tkey(ValueDict const *key) const {
 	return toReturn;
 }
 
+// private method for extracting the leading key values present in a ValueDict
+KeyValue *BTreeIndex::tkey_prefix(ValueDict const *key) const {
+    KeyValue* toReturn = new KeyValue;
+    for (Identifier column_name: this->key_columns) {
+        auto it = key->find(column_name);
+        if (it == key->end())
+            break;
+        toReturn->push_back(it->second);
+    }
+    return toReturn;
+}
+
 // private method for initializing the key_profile in constructor
 void BTreeIndex::build_key_profile() {
     ColumnAttributes* column_attr = new ColumnAttributes;
@@ -241,6 +548,33 @@ bool test_compare(BTreeIndex &index, HeapTable &table, ValueDict *test, ValueDic
     return true;
 }
 
+/**
+ * Helper function for test: check that a range scan finds count rows, in order, all within bounds.
+ * A negative bound is left open.
+ */
+bool test_range(BTreeIndex &index, HeapTable &table, int min, bool min_inclusive, int max, bool max_inclusive,
+                u_long count)
+{
+    ValueDict min_key, max_key;
+    min_key["a"] = min;
+    max_key["a"] = max;
+    Handles *handles = index.range(min < 0 ? nullptr : &min_key, max < 0 ? nullptr : &max_key,
+                                   min_inclusive, max_inclusive);
+    bool ok = handles->size() == count;
+    int previous = -1;
+    for (auto const& handle: *handles) {
+        ValueDict *row = table.project(handle);
+        int a = (*row)["a"].n;
+        delete row;
+        if (a <= previous || (min >= 0 && (a < min || (a == min && !min_inclusive)))
+            || (max >= 0 && (a > max || (a == max && !max_inclusive))))
+            ok = false;
+        previous = a;
+    }
+    delete handles;
+    return ok;
+}
+
 /**
  * tests all functionality of BTreeIndex
  * @return bool true if passes
@@ -310,7 +644,299 @@ bool test_btree() {
         }
     }
 
-    return true;
+    // enough more rows to split leaves and interiors
+    for (int i = 1000; i < 3000; i++) {
+        ValueDict brow;
+        brow["a"] = i;
+        brow["b"] = -i;
+        index.insert(table.insert(&brow));
+    }
+    for (int i = 1000; i < 3000; i += 7) {
+        (*test_row)["a"] = i;
+        (*test_row)["b"] = -i;
+        Handles *handles = index.lookup(test_row);
+        bool found = handles->size() == 1 && test_compare(index, table, test_row, test_row);
+        delete handles;
+        if (!found)
+            return false;
+    }
+
+    // range scans: [150,1500], (150,1500), everything >= 2990, everything < 110
+    if (!test_range(index, table, 150, true, 1500, true, 50 + 501)
+        || !test_range(index, table, 150, false, 1500, false, 49 + 500)
+        || !test_range(index, table, 2990, true, -1, false, 10)
+        || !test_range(index, table, -1, false, 110, false, 10))
+        return false;
+
+    delete test_row;
+    delete row1;
+    delete row2;
+    index.drop();
+    table.drop();
+
+    // bulk load from rows in scrambled order, packed loosely enough to need several interior levels
+    HeapTable bulk_table("_test_btree_bulk_cpp", column_names, column_attributes);
+    bulk_table.create();
+    for (int i = 0; i < 5000; i++) {
+        ValueDict brow;
+        brow["a"] = (i * 7919) % 5000;
+        brow["b"] = -i;
+        bulk_table.insert(&brow);
+    }
+    double fill_factor = BTreeIndex::fill_factor;
+    BTreeIndex::fill_factor = 0.2;
+    BTreeIndex bulk_index(bulk_table, "test_bulk_index", index_column, true);
+    bulk_index.create();
+    BTreeIndex::fill_factor = fill_factor;
+    for (int i = 0; i < 5000; i += 3) {
+        ValueDict key;
+        key["a"] = i;
+        Handles *handles = bulk_index.lookup(&key);
+        bool found = handles->size() == 1;
+        delete handles;
+        if (!found)
+            return false;
+    }
+    if (!test_range(bulk_index, bulk_table, -1, false, -1, false, 5000)
+        || !test_range(bulk_index, bulk_table, 1234, true, 4321, false, 4321 - 1234))
+        return false;
+
+    // and it still takes inserts afterwards
+    for (int i = 5000; i < 6000; i++) {
+        ValueDict brow;
+        brow["a"] = i;
+        brow["b"] = -i;
+        bulk_index.insert(bulk_table.insert(&brow));
+    }
+    if (!test_range(bulk_index, bulk_table, 4990, true, -1, false, 1010))
+        return false;
+
+    // deletes take entries out of the middle of leaves
+    for (int i = 100; i < 5000; i += 2) {
+        ValueDict key;
+        key["a"] = i;
+        Handles *handles = bulk_index.lookup(&key);
+        bulk_index.del(handles->at(0));
+        delete handles;
+        handles = bulk_index.lookup(&key);
+        bool gone = handles->empty();
+        delete handles;
+        if (!gone)
+            return false;
+    }
+    if (!test_range(bulk_index, bulk_table, 90, true, 120, true, 10 + 10)
+        || !test_range(bulk_index, bulk_table, -1, false, -1, false, 6000 - 2450))
+        return false;
+
+    // deleting nearly everything merges nodes back together until the tree is short again
+    std::map<int, Handle> kept;
+    for (int i = 0; i < 6000; i++) {
+        if (i >= 100 && i < 5000 && i % 2 == 0)
+            continue;
+        ValueDict key;
+        key["a"] = i;
+        Handles *handles = bulk_index.lookup(&key);
+        if (handles->size() != 1) {
+            delete handles;
+            return false;
+        }
+        if (i % 97 == 0)
+            kept[i] = handles->at(0);
+        else
+            bulk_index.del(handles->at(0));
+        delete handles;
+    }
+    for (auto const& k: kept) {
+        ValueDict key;
+        key["a"] = k.first;
+        Handles *handles = bulk_index.lookup(&key);
+        bool found = handles->size() == 1 && handles->at(0) == k.second;
+        delete handles;
+        if (!found)
+            return false;
+    }
+    if (!test_range(bulk_index, bulk_table, -1, false, -1, false, kept.size())
+        || !test_range(bulk_index, bulk_table, 1000, true, 5500, false, 21 + 5))
+        return false;
+
+    // and the shrunken tree grows again
+    for (int i = 6000; i < 7000; i++) {
+        ValueDict brow;
+        brow["a"] = i;
+        brow["b"] = -i;
+        bulk_index.insert(bulk_table.insert(&brow));
+    }
+    if (!test_range(bulk_index, bulk_table, -1, false, -1, false, kept.size() + 1000))
+        return false;
+    bulk_index.drop();
+    bulk_table.drop();
+
+    // a prefix of a composite key as the bounds, with each b's 500 entries spread over several leaves
+    HeapTable prefix_table("_test_btree_prefix_cpp", column_names, column_attributes);
+    prefix_table.create();
+    ColumnNames prefix_columns;
+    prefix_columns.push_back("b");
+    prefix_columns.push_back("a");
+    BTreeIndex prefix_index(prefix_table, "test_prefix_index", prefix_columns, true);
+    prefix_index.create();
+    for (int i = 0; i < 3000; i++) {
+        ValueDict prow;
+        prow["a"] = i;
+        prow["b"] = i / 500;
+        prefix_index.insert(prefix_table.insert(&prow));
+    }
+    ValueDict three, four;
+    three["b"] = 3;
+    four["b"] = 4;
+    u_long counts[5];
+    Handles *found = prefix_index.range(&three, nullptr, false, true);
+    counts[0] = found->size();  // b > 3
+    delete found;
+    found = prefix_index.range(&three, nullptr, true, true);
+    counts[1] = found->size();  // b >= 3
+    delete found;
+    found = prefix_index.range(&three, &four, false, true);
+    counts[2] = found->size();  // 3 < b <= 4
+    delete found;
+    found = prefix_index.range(nullptr, &three, true, false);
+    counts[3] = found->size();  // b < 3
+    delete found;
+    found = prefix_index.range(&three, &three, true, true);
+    counts[4] = found->size();  // b = 3
+    delete found;
+    if (counts[0] != 1000 || counts[1] != 1500 || counts[2] != 500 || counts[3] != 1500 || counts[4] != 500)
+        return false;
+
+    // NULL b's sort first and take up leaves of their own; an upper bound alone starts just past them,
+    // the way EvalPlan plans b < 4
+    for (int i = 3000; i < 4500; i++) {
+        ValueDict prow;
+        prow["a"] = i;
+        prefix_index.insert(prefix_table.insert(&prow));
+    }
+    ValueDict nulls;
+    nulls["b"] = Value::null(ColumnAttribute::INT);
+    found = prefix_index.range(&nulls, &four, false, false);
+    counts[0] = found->size();  // b < 4
+    delete found;
+    found = prefix_index.range(&nulls, &nulls, true, true);
+    counts[1] = found->size();  // b IS NULL
+    delete found;
+    if (counts[0] != 2000 || counts[1] != 1500)
+        return false;
+    prefix_index.drop();
+    prefix_table.drop();
+
+    // non-unique: the first 1500 rows share b = 7, enough to take several overflow blocks, the rest spread over 50 values
+    HeapTable multi_table("_test_btree_multi_cpp", column_names, column_attributes);
+    multi_table.create();
+    ColumnNames multi_column;
+    multi_column.push_back("b");
+    for (int i = 0; i < 1000; i++) {
+        ValueDict mrow;
+        mrow["a"] = i;
+        mrow["b"] = 7;
+        multi_table.insert(&mrow);
+    }
+    BTreeIndex multi_index(multi_table, "test_multi_index", multi_column, false);
+    multi_index.create();  // bulk loaded postings
+    for (int i = 1000; i < 2000; i++) {
+        ValueDict mrow;
+        mrow["a"] = i;
+        mrow["b"] = i < 1500 ? 7 : i % 50;
+        multi_index.insert(multi_table.insert(&mrow));  // and inserted ones
+    }
+    ValueDict sevens, thirteens;
+    sevens["b"] = 7;
+    thirteens["b"] = 13;
+    Handles *handles = multi_index.lookup(&sevens);
+    bool ok = handles->size() == 1500 + 10;
+    for (auto const& handle: *handles) {
+        ValueDict *row = multi_table.project(handle);
+        ok = ok && (*row)["b"].n == 7;
+        delete row;
+    }
+    Handles *others = multi_index.lookup(&thirteens);
+    ok = ok && others->size() == 10;
+    delete others;
+    ValueDict low, high;
+    low["b"] = 10;
+    high["b"] = 19;
+    others = multi_index.range(&low, &high);
+    ok = ok && others->size() == 100;
+    delete others;
+    if (!ok) {
+        delete handles;
+        return false;
+    }
+
+    // deleting takes handles out of the leaf and the overflow blocks, then the key itself
+    for (u_long i = 0; i < handles->size(); i += 2)
+        multi_index.del(handles->at(i));
+    Handles *left = multi_index.lookup(&sevens);
+    ok = left->size() == 755;
+    delete left;
+    for (u_long i = 1; i < handles->size(); i += 2)
+        multi_index.del(handles->at(i));
+    delete handles;
+    left = multi_index.lookup(&sevens);
+    ok = ok && left->empty();
+    delete left;
+    left = multi_index.range(nullptr, nullptr);
+    ok = ok && left->size() == 490;
+    delete left;
+    if (!ok)
+        return false;
+    multi_index.drop();
+    multi_table.drop();
+
+    // long TEXT keys in bigger blocks, bulk loaded and then inserted, still there after reopening
+    ColumnAttributes wide_attributes = column_attributes;
+    wide_attributes[1].set_data_type(ColumnAttribute::TEXT);
+    HeapTable wide_table("_test_btree_wide_cpp", column_names, wide_attributes);
+    wide_table.create();
+    ColumnNames wide_column;
+    wide_column.push_back("b");
+    for (int i = 0; i < 400; i++) {
+        ValueDict wrow;
+        wrow["a"] = i;
+        wrow["b"] = Value(std::to_string(1000 + i) + std::string(1000, 'k'));
+        wide_table.insert(&wrow);
+    }
+    {
+        BTreeIndex wide_index(wide_table, "test_wide_index", wide_column, true);
+        wide_index.set_block_size(4 * DbBlock::BLOCK_SZ);
+        wide_index.create();
+        for (int i = 400; i < 800; i++) {
+            ValueDict wrow;
+            wrow["a"] = i;
+            wrow["b"] = Value(std::to_string(1000 + i) + std::string(1000, 'k'));
+            wide_index.insert(wide_table.insert(&wrow));
+        }
+        wide_index.close();
+    }
+    BTreeIndex wide_index(wide_table, "test_wide_index", wide_column, true);
+    wide_index.open();
+    for (int i = 0; i < 800; i += 7) {
+        ValueDict key;
+        key["b"] = Value(std::to_string(1000 + i) + std::string(1000, 'k'));
+        Handles *found = wide_index.lookup(&key);
+        ok = found->size() == 1;
+        if (ok) {
+            ValueDict *row = wide_table.project(found->at(0));
+            ok = (*row)["a"].n == i;
+            delete row;
+        }
+        delete found;
+        if (!ok)
+            return false;
+    }
+    left = wide_index.range(nullptr, nullptr);
+    ok = left->size() == 800;
+    delete left;
+    wide_index.drop();
+    wide_table.drop();
+    return ok;
 }
 
 
@@ -4,34 +4,47 @@
 
 class BTreeIndex : public DbIndex {
 public:
+    static double fill_factor;  // how full create() packs each block, in (0, 1]
+    static uint node_cache_capacity;  // interior nodes each open index keeps pinned (stay under BufferPool::capacity)
+
     BTreeIndex(DbRelation& relation, Identifier name, ColumnNames key_columns, bool unique);
     virtual ~BTreeIndex();
 
     virtual void create();
     virtual void drop();
+    virtual void set_block_size(uint block_size) { file.set_block_size(block_size); }  // for create(): fewer levels for long keys
 
     virtual void open();
     virtual void close();
 
     virtual Handles* lookup(ValueDict* key) const;
-    virtual Handles* range(ValueDict* min_key, ValueDict* max_key) const;
+    virtual Handles* range(ValueDict* min_key, ValueDict* max_key,
+                           bool min_inclusive=true, bool max_inclusive=true) const;
 
     virtual void insert(Handle handle);
     virtual void del(Handle handle);
 
     virtual KeyValue *tkey(ValueDict const *key) const; // pull out the key values from the ValueDict in order
+    virtual KeyValue *tkey_prefix(ValueDict const *key) const; // same, but stopping at the first missing column
 
 protected:
     static const BlockID STAT = 1;
     bool closed;
     BTreeStat *stat;
     BTreeNode *root;
-    HeapFile file;
+    mutable HeapFile file;  // reading nodes pins pages even in const lookups
     KeyProfile key_profile;
+    mutable std::map<BlockID, BTreeInterior*> node_cache;  // interior nodes below the root, first come first kept
 
     void build_key_profile();
+    void bulk_load();
+    BTreeNode *get_node(BlockID block_id, uint height) const;
+    void release(BTreeNode *node) const;
+    void clear_node_cache();
     Handles* _lookup(BTreeNode *node, uint height, const KeyValue* key) const;
     Insertion _insert(BTreeNode *node, uint height, const KeyValue* key, Handle handle);
+    bool _del(BTreeNode *node, uint height, const KeyValue* key, Handle handle);
+    void rebalance(BTreeInterior *parent, u_long at, uint height);
 };
 
 bool test_btree();
@@ -0,0 +1,751 @@
+/**
+ * @file column_storage.cpp - implementation of the column-oriented (PAX) storage engine
+ */
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include "column_storage.h"
+using namespace std;
+
+typedef uint16_t u16;
+
+
+/**************
+ * ColumnPage *
+ **************/
+
+u_long ColumnPage::text_room = 16;
+
+ColumnPage::ColumnPage(Dbt &block, BlockID block_id, const RowFormat &format, bool is_new)
+        : DbBlock(block, block_id, is_new), format(format), capacity(0), count(0), text_start(0),
+          minipages(), data_end(0), record() {
+    if (is_new) {
+        this->capacity = capacity_for(format.get_column_attributes());
+        lay_out();
+        clear();
+    } else {
+        this->capacity = *(const u16*)address(0);
+        this->count = *(const u16*)address(2);
+        this->text_start = *(const u16*)address(4);
+        lay_out();
+    }
+}
+
+// Bytes a value takes in its minipage.
+u16 ColumnPage::width(ColumnAttribute::DataType data_type) {
+    if (data_type == ColumnAttribute::DataType::INT)
+        return sizeof(int32_t);
+    if (data_type == ColumnAttribute::DataType::TEXT)
+        return 2 * sizeof(u16);
+    if (data_type == ColumnAttribute::DataType::BOOLEAN)
+        return sizeof(uint8_t);
+    throw DbRelationError("Only know how to store INT, TEXT, and BOOLEAN");
+}
+
+// Bytes the header, deleted bitmap, and minipages take for a block of the given capacity.
+u_long ColumnPage::layout_size(const ColumnAttributes &column_attributes, u16 capacity) {
+    u_long size = HEADER + bitmap_size(capacity);
+    for (auto const& ca: column_attributes) {
+        u_long values = (u_long)capacity * width(ca.get_data_type());
+        size += bitmap_size(capacity) + (values + 3) / 4 * 4;
+    }
+    return size;
+}
+
+// Most rows a block can be laid out for and still have text_room bytes of text for each of them.
+u16 ColumnPage::capacity_for(const ColumnAttributes &column_attributes) {
+    u_long per_row = 0, texts = 0;
+    for (auto const& ca: column_attributes) {
+        per_row += width(ca.get_data_type());
+        if (ca.get_data_type() == ColumnAttribute::DataType::TEXT)
+            texts++;
+    }
+    per_row += texts * text_room;
+    u_long capacity = (BLOCK_SZ - HEADER) / (per_row == 0 ? 1 : per_row) + 1;
+    while (capacity > 0 && layout_size(column_attributes, (u16)capacity) + capacity * texts * text_room > BLOCK_SZ)
+        capacity--;
+    if (capacity == 0)
+        throw DbRelationError("too many columns for a column table block");
+    return (u16)capacity;
+}
+
+// Work out where the minipages go.
+void ColumnPage::lay_out() {
+    this->minipages.clear();
+    u_long offset = HEADER + bitmap_size(this->capacity);
+    for (auto const& ca: this->format.get_column_attributes()) {
+        this->minipages.push_back((u16)offset);
+        u_long values = (u_long)this->capacity * width(ca.get_data_type());
+        offset += bitmap_size(this->capacity) + (values + 3) / 4 * 4;
+    }
+    this->data_end = (u16)offset;
+}
+
+void ColumnPage::put_header() {
+    *(u16*)address(0) = this->capacity;
+    *(u16*)address(2) = this->count;
+    *(u16*)address(4) = this->text_start;
+    *(u16*)address(6) = 0;
+}
+
+bool ColumnPage::get_bit(u16 bitmap, RecordID record_id) const {
+    uint i = record_id - 1;
+    return (*(const uint8_t*)address((u16)(bitmap + i / 8)) >> (i % 8)) & 1;
+}
+
+void ColumnPage::put_bit(u16 bitmap, RecordID record_id, bool bit) {
+    uint i = record_id - 1;
+    uint8_t *byte = (uint8_t*)address((u16)(bitmap + i / 8));
+    if (bit)
+        *byte |= (uint8_t)(1 << (i % 8));
+    else
+        *byte &= (uint8_t)~(1 << (i % 8));
+}
+
+// Add a row of values as the next record. Nothing is changed if it doesn't fit.
+RecordID ColumnPage::add(const Value *values) throw(DbBlockNoRoomError) {
+    if (this->count >= this->capacity)
+        throw DbBlockNoRoomError("no more rows fit in this block");
+    RecordID id = (RecordID)(this->count + 1);
+    if (text_needed(values, id) > (u_long)(this->text_start - this->data_end))
+        throw DbBlockNoRoomError("not enough room for the text in this block");
+    this->count++;
+    put_bit(HEADER, id, false);
+    for (uint col_num = 0; col_num < this->minipages.size(); col_num++)
+        put_value(id, col_num, values[col_num]);
+    put_header();
+    return id;
+}
+
+// Add a record in the RowFormat.
+RecordID ColumnPage::add(const Dbt* data) throw(DbBlockNoRoomError) {
+    RecordView record(this->format, *data, true);
+    vector<Value> values;
+    values.reserve(this->minipages.size());
+    for (uint col_num = 0; col_num < this->minipages.size(); col_num++)
+        values.push_back(record.get(col_num, true));
+    return add(values.data());
+}
+
+// The record as a row in the RowFormat.
+Dbt* ColumnPage::get(RecordID record_id) const {
+    if (record_id == 0 || record_id > this->count || is_deleted(record_id))
+        return nullptr;
+    vector<Value> values;
+    values.reserve(this->minipages.size());
+    for (uint col_num = 0; col_num < this->minipages.size(); col_num++)
+        values.push_back(get_value(record_id, col_num, true));
+    this->record.resize(this->format.size(values.data()));
+    this->format.marshal(values.data(), this->record.data());
+    return new Dbt(this->record.data(), (u_int32_t)this->record.size());
+}
+
+// Replace a record with one in the RowFormat. TEXT that got longer goes in as new text.
+void ColumnPage::put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError) {
+    RecordView record(this->format, data, true);
+    vector<Value> values;
+    values.reserve(this->minipages.size());
+    for (uint col_num = 0; col_num < this->minipages.size(); col_num++)
+        values.push_back(record.get(col_num, true));
+    if (text_needed(values.data(), record_id) > (u_long)(this->text_start - this->data_end))
+        throw DbBlockNoRoomError("not enough room for the new text in this block");
+    for (uint col_num = 0; col_num < this->minipages.size(); col_num++)
+        put_value(record_id, col_num, values[col_num]);
+    put_header();
+}
+
+// Mark the row deleted.
+void ColumnPage::del(RecordID record_id) {
+    if (record_id == 0 || record_id > this->count)
+        return;
+    put_bit(HEADER, record_id, true);
+}
+
+RecordIDs* ColumnPage::ids() const {
+    RecordIDs* record_ids = new RecordIDs();
+    for (RecordID id = 1; id <= this->count; id++)
+        if (!is_deleted(id))
+            record_ids->push_back(id);
+    return record_ids;
+}
+
+// Empty the block, keeping its capacity.
+void ColumnPage::clear() {
+    this->count = 0;
+    this->text_start = BLOCK_SZ;
+    memset(address(0), 0, this->data_end);
+    put_header();
+}
+
+u_int16_t ColumnPage::size() const {
+    u_int16_t n = 0;
+    for (RecordID id = 1; id <= this->count; id++)
+        if (!is_deleted(id))
+            n++;
+    return n;
+}
+
+bool ColumnPage::is_deleted(RecordID record_id) const {
+    return get_bit(HEADER, record_id);
+}
+
+// New text bytes putting values in as the given record would take.
+u_long ColumnPage::text_needed(const Value *values, RecordID record_id) const {
+    u_long needed = 0;
+    const ColumnAttributes &column_attributes = this->format.get_column_attributes();
+    for (uint col_num = 0; col_num < column_attributes.size(); col_num++) {
+        if (column_attributes[col_num].get_data_type() != ColumnAttribute::DataType::TEXT || values[col_num].is_null())
+            continue;
+        u16 old_size = 0;
+        if (record_id <= this->count)
+            get_column(record_id, col_num, old_size);
+        if (values[col_num].text_size() > old_size)
+            needed += values[col_num].text_size();
+    }
+    return needed;
+}
+
+// Write one value of a row; TEXT is reused in place when the new one fits there.
+void ColumnPage::put_value(RecordID record_id, uint col_num, const Value &value) {
+    u16 minipage = this->minipages[col_num];
+    ColumnAttribute::DataType data_type = this->format.get_column_attributes()[col_num].get_data_type();
+    u16 w = width(data_type);
+    char *slot = address((u16)(minipage + bitmap_size(this->capacity) + (record_id - 1) * w));
+    put_bit(minipage, record_id, value.is_null());
+    if (data_type == ColumnAttribute::DataType::INT) {
+        *(int32_t*)slot = value.is_null() ? 0 : value.n;
+    } else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
+        *(uint8_t*)slot = value.is_null() ? 0 : (uint8_t)value.n;
+    } else {
+        u16 size = value.is_null() ? 0 : (u16)value.text_size();
+        u16 *text = (u16*)slot;
+        if (size > text[1]) {
+            this->text_start -= size;
+            text[0] = this->text_start;
+        }
+        memcpy(address(text[0]), value.text_data(), size);  // assume ascii for now
+        text[1] = size;
+    }
+}
+
+// Start of the value of a record's column, and its size.
+const char *ColumnPage::get_column(RecordID record_id, uint col_num, u16 &size) const {
+    u16 minipage = this->minipages[col_num];
+    if (get_bit(minipage, record_id)) {
+        size = 0;
+        return nullptr;
+    }
+    ColumnAttribute::DataType data_type = this->format.get_column_attributes()[col_num].get_data_type();
+    u16 w = width(data_type);
+    const char *slot = address((u16)(minipage + bitmap_size(this->capacity) + (record_id - 1) * w));
+    if (data_type == ColumnAttribute::DataType::TEXT) {
+        const u16 *text = (const u16*)slot;
+        size = text[1];
+        return address(text[0]);
+    }
+    size = w;
+    return slot;
+}
+
+Value ColumnPage::get_value(RecordID record_id, uint col_num, bool view) const {
+    u16 size;
+    const char *data = get_column(record_id, col_num, size);
+    ColumnAttribute::DataType data_type = this->format.get_column_attributes()[col_num].get_data_type();
+    if (data == nullptr)
+        return Value::null(data_type);
+    if (data_type == ColumnAttribute::DataType::TEXT)
+        return view ? Value::view(data, size) : Value(data, size);
+    Value value(data_type == ColumnAttribute::DataType::INT ? *(const int32_t*)data : (int32_t)*(const uint8_t*)data);
+    value.data_type = data_type;
+    return value;
+}
+
+// A minipage's INT and BOOLEAN values are already the arrays a ColumnVector wants; TEXT and the
+// NULLs (if there are any) are gathered, but only for the wanted records.
+void ColumnPage::get_vector(uint col_num, ColumnVector &vector, const uint8_t *wanted) const {
+    u16 minipage = this->minipages[col_num];
+    ColumnAttribute::DataType data_type = this->format.get_column_attributes()[col_num].get_data_type();
+    const char *values = address((u16)(minipage + bitmap_size(this->capacity)));
+    bool has_nulls = false;
+    const uint32_t *words = (const uint32_t*)address(minipage);
+    for (uint i = 0; i < bitmap_size(this->count) / 4; i++)
+        has_nulls = has_nulls || words[i] != 0;
+    if (data_type == ColumnAttribute::DataType::TEXT || has_nulls) {
+        vector.gather(data_type, this->count);
+        const u16 *texts = (const u16*)values;  // offset and size for each record
+        for (RecordID id = 1; id <= this->count; id++) {
+            if (!wanted[id - 1])
+                continue;
+            if (has_nulls && get_bit(minipage, id))
+                vector.set(id - 1, nullptr, 0);
+            else if (data_type == ColumnAttribute::DataType::TEXT)
+                vector.set(id - 1, address(texts[2 * (id - 1)]), texts[2 * (id - 1) + 1]);
+            else
+                vector.set(id - 1, values + (id - 1) * width(data_type), width(data_type));
+        }
+    } else {
+        vector.ints = nullptr;
+        vector.bools = nullptr;
+        vector.texts = nullptr;
+        vector.sizes = nullptr;
+        vector.nulls = nullptr;
+    }
+    if (data_type == ColumnAttribute::DataType::INT)
+        vector.ints = (const int32_t*)values;
+    else if (data_type == ColumnAttribute::DataType::BOOLEAN)
+        vector.bools = (const uint8_t*)values;
+}
+
+void ColumnPage::get_live(uint8_t *live) const {
+    for (RecordID id = 1; id <= this->count; id++)
+        live[id - 1] = (uint8_t)!is_deleted(id);
+}
+
+
+/***************
+ * ColumnTable *
+ ***************/
+
+ColumnTable::ColumnTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes)
+        : DbRelation(table_name, column_names, column_attributes), file(table_name), format(column_attributes) {
+    this->layout = get_layout(&this->column_names);
+}
+
+// Make the file, with its first block laid out for our columns.
+void ColumnTable::create() {
+    this->file.create();
+    SlottedPage *block = this->file.get(this->file.get_last_block_id());
+    ColumnPage page(*block->get_block(), block->get_block_id(), this->format, true);
+    this->file.put(block);
+    this->file.unpin(block);
+}
+
+void ColumnTable::create_if_not_exists() {
+    try {
+        open();
+    } catch (DbException &e) {
+        create();
+    }
+}
+
+void ColumnTable::drop() {
+    this->file.drop();
+}
+
+void ColumnTable::open() {
+    this->file.open();
+}
+
+void ColumnTable::close() {
+    this->file.close();
+}
+
+Handle ColumnTable::insert(const ValueDict* row) {
+    open();
+    Row* full_row = validate(row);
+    Handle handle;
+    try {
+        handle = append(full_row);
+    } catch (...) {
+        delete full_row;
+        throw;
+    }
+    delete full_row;
+    return handle;
+}
+
+void ColumnTable::update(const Handle handle, const ValueDict* new_values) {
+    throw DbRelationError("UPDATE NOT YET IMPLEMENTED");
+}
+
+void ColumnTable::del(const Handle handle) {
+    open();
+    SlottedPage *block = this->file.get(handle.first);
+    ColumnPage page(*block->get_block(), block->get_block_id(), this->format);
+    page.del(handle.second);
+    this->file.put(block);
+    this->file.unpin(block);
+}
+
+Handles* ColumnTable::select() {
+    return select(nullptr);
+}
+
+Handles* ColumnTable::select(const ValueDict* where) {
+    Handles* handles = new Handles();
+    DbCursor* cursor = this->cursor(where);
+    Handle handle;
+    cursor->open();
+    while (cursor->next(handle))
+        handles->push_back(handle);
+    cursor->close();
+    delete cursor;
+    return handles;
+}
+
+DbCursor* ColumnTable::cursor(const ValueDict* where, const ValueRanges* ranges) {
+    return new ColumnTableCursor(*this, where, ranges);
+}
+
+// Refine another selection, a run of handles in the same block at a time.
+Handles* ColumnTable::select(Handles *current_selection, const ValueDict* where) {
+    Handles* handles = new Handles();
+    BatchFilter filter(this->column_names, this->column_attributes, where);
+    ColumnVector values;
+    std::vector<uint8_t> selection;
+    for (size_t i = 0, j; i < current_selection->size(); i = j) {
+        BlockID block_id = (*current_selection)[i].first;
+        SlottedPage *block = this->file.get(block_id);
+        ColumnPage page(*block->get_block(), block_id, this->format);
+        selected(page, filter, values, selection);
+        this->file.unpin(block);
+        for (j = i; j < current_selection->size() && (*current_selection)[j].first == block_id; j++) {
+            RecordID record_id = (*current_selection)[j].second;
+            if (record_id > 0 && record_id <= selection.size() && selection[record_id - 1])
+                handles->push_back((*current_selection)[j]);
+        }
+    }
+    return handles;
+}
+
+ValueDict* ColumnTable::project(Handle handle) {
+    return project(handle, &this->column_names);
+}
+
+ValueDict* ColumnTable::project(Handle handle, const ColumnNames* column_names) {
+    Row row(get_layout(column_names));
+    project(handle, row);
+    ValueDict* result = new ValueDict();
+    const ColumnNames &names = row.get_layout().get_column_names();
+    for (uint i = 0; i < row.size(); i++)
+        result->emplace(names[i], std::move(row[i]));
+    return result;
+}
+
+ValueDicts* ColumnTable::project(Handles* handles) {
+    return project(handles, &this->column_names);
+}
+
+ValueDicts* ColumnTable::project(Handles* handles, const ColumnNames* column_names) {
+    Rows rows;
+    project(handles, get_layout(column_names), rows);
+    ValueDicts* dicts = new ValueDicts();
+    dicts->reserve(rows.size());
+    for (Row* row: rows) {
+        ValueDict* dict = new ValueDict();
+        const ColumnNames &names = row->get_layout().get_column_names();
+        for (uint i = 0; i < row->size(); i++)
+            dict->emplace(names[i], std::move((*row)[i]));
+        dicts->push_back(dict);
+        delete row;
+    }
+    return dicts;
+}
+
+void ColumnTable::project(Handle handle, Row &row) {
+    SlottedPage *block = this->file.get(handle.first);
+    ColumnPage page(*block->get_block(), block->get_block_id(), this->format);
+    if (handle.second == 0 || handle.second > page.get_count() || page.is_deleted(handle.second)) {
+        this->file.unpin(block);
+        throw DbRelationError("no such row");
+    }
+    unmarshal(page, handle.second, slots_for(row.get_layout()), row.data());
+    this->file.unpin(block);
+    row.fill_duplicates();
+}
+
+// Appends a row for each of the given handles, reading just the layout's columns.
+// Runs of handles in the same block (as they come from select) share one fetch of that block.
+void ColumnTable::project(Handles* handles, RowLayoutPtr layout, Rows &rows) {
+    const std::vector<int> &slots = slots_for(*layout);
+    rows.reserve(rows.size() + handles->size());
+    SlottedPage *block = nullptr;
+    ColumnPage *page = nullptr;
+    for (auto const& handle: *handles) {
+        if (block == nullptr || block->get_block_id() != handle.first) {
+            if (block != nullptr) {
+                delete page;
+                this->file.unpin(block);
+            }
+            block = this->file.get(handle.first);
+            page = new ColumnPage(*block->get_block(), handle.first, this->format);
+        }
+        if (handle.second == 0 || handle.second > page->get_count() || page->is_deleted(handle.second)) {
+            delete page;
+            this->file.unpin(block);
+            throw DbRelationError("no such row");
+        }
+        Row* row = new Row(layout);
+        unmarshal(*page, handle.second, slots, row->data());
+        row->fill_duplicates();
+        rows.push_back(row);
+    }
+    if (block != nullptr) {
+        delete page;
+        this->file.unpin(block);
+    }
+}
+
+// Columns the row has no value for are NULL.
+Row* ColumnTable::validate(const ValueDict* row) const {
+    Row* full_row = new Row(this->layout);
+    for (uint col_num = 0; col_num < this->column_names.size(); col_num++) {
+        auto it = row->find(this->column_names[col_num]);
+        if (it == row->end())
+            (*full_row)[col_num] = Value::null(this->column_attributes[col_num].get_data_type());
+        else
+            (*full_row)[col_num] = it->second;
+    }
+    return full_row;
+}
+
+// Add the row to the last block, or to a new one if it's full.
+Handle ColumnTable::append(const Row* row) {
+    this->format.size(row->data());  // throws if a TEXT is too long
+    SlottedPage *block = this->file.get(this->file.get_last_block_id());
+    RecordID record_id;
+    try {
+        ColumnPage page(*block->get_block(), block->get_block_id(), this->format);
+        record_id = page.add(row->data());
+    } catch (DbBlockNoRoomError &e) {
+        this->file.unpin(block);
+        block = this->file.get_new();
+        try {
+            ColumnPage page(*block->get_block(), block->get_block_id(), this->format, true);
+            record_id = page.add(row->data());
+        } catch (DbBlockNoRoomError &e) {
+            this->file.put(block);  // laid out, if empty
+            this->file.unpin(block);
+            throw DbRelationError("row too big for a column table block");
+        }
+    }
+    Handle handle(block->get_block_id(), record_id);
+    this->file.put(block);
+    this->file.unpin(block);
+    return handle;
+}
+
+// Which of the page's records are live and pass the filter, one byte for each record.
+void ColumnTable::selected(const ColumnPage &page, const BatchFilter &filter, ColumnVector &values,
+                           std::vector<uint8_t> &selected) const {
+    selected.resize(page.get_count());
+    page.get_live(selected.data());
+    const std::vector<uint> &columns = filter.get_columns();
+    for (uint i = 0; i < columns.size(); i++) {
+        page.get_vector(columns[i], values, selected.data());
+        filter.filter(i, values, selected.size(), selected.data());
+    }
+}
+
+// Reads the columns slots picks out into values: column i goes to values[slots[i]], or is skipped
+// if that's -1.
+void ColumnTable::unmarshal(const ColumnPage &page, RecordID record_id, const std::vector<int> &slots,
+                            Value *values) const {
+    for (uint col_num = 0; col_num < this->column_names.size(); col_num++)
+        if (slots[col_num] >= 0)
+            values[slots[col_num]] = page.get_value(record_id, col_num);
+}
+
+const std::vector<int> &ColumnTable::slots_for(const RowLayout &layout) const {
+    if (layout.get_slots().size() != this->column_names.size())
+        throw DbRelationError("row layout is not for table " + this->table_name);
+    return layout.get_slots();
+}
+
+
+/*********************
+ * ColumnTableCursor *
+ *********************/
+
+ColumnTableCursor::ColumnTableCursor(ColumnTable &table, const ValueDict* where, const ValueRanges* ranges)
+        : table(table), filter(table.column_names, table.column_attributes, where, ranges), values(), selected(),
+          block_id(0), last_block_id(0), record_ids(), position(0) {
+}
+
+void ColumnTableCursor::open() {
+    close();
+    this->table.open();
+    this->block_id = 0;
+    this->last_block_id = this->table.file.get_last_block_id();
+}
+
+// Hand out the current block's matches, finding the next block's once they run out.
+bool ColumnTableCursor::next(Handle &handle) {
+    while (this->position >= this->record_ids.size()) {
+        if (this->block_id >= this->last_block_id)
+            return false;
+        SlottedPage *block = this->table.file.get(++this->block_id);
+        ColumnPage page(*block->get_block(), this->block_id, this->table.format);
+        this->table.selected(page, this->filter, this->values, this->selected);
+        this->table.file.unpin(block);
+        this->record_ids.clear();
+        for (RecordID id = 1; id <= this->selected.size(); id++)
+            if (this->selected[id - 1])
+                this->record_ids.push_back(id);
+        this->position = 0;
+    }
+    handle = Handle(this->block_id, this->record_ids[this->position++]);
+    return true;
+}
+
+void ColumnTableCursor::close() {
+    this->record_ids.clear();
+    this->position = 0;
+}
+
+
+// test functions below::
+bool test_column_storage() {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    column_names.push_back("c");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+
+    ColumnTable table("_test_column_cpp", column_names, column_attributes);
+    table.create_if_not_exists();
+    table.drop();
+    table.create();
+
+    // enough rows, some with long text, to take several blocks
+    ValueDict row;
+    for (int i = 0; i < 1000; i++) {
+        row["a"] = Value(i);
+        row["b"] = Value(i % 10 == 0 ? string(100, 'a' + (char)(i % 26)) : "row " + to_string(i));
+        row["c"] = Value(i % 2 == 0);
+        table.insert(&row);
+    }
+    row.erase("c");
+    row["a"] = Value(1000);
+    row["b"] = Value("no c");
+    table.insert(&row);
+
+    Handles* handles = table.select();
+    bool ok = (handles->size() == 1001 && handles->back().first > 1);
+    cout << "insert " << (ok ? "ok" : "failed") << " " << handles->size() << " rows in "
+         << handles->back().first << " blocks" << endl;
+    if (!ok) {
+        delete handles;
+        return false;
+    }
+
+    // just column b, positionally
+    ColumnNames just_b;
+    just_b.push_back("b");
+    Rows rows;
+    table.project(handles, table.get_layout(&just_b), rows);
+    ok = (rows.size() == 1001 && rows[7]->size() == 1 && (*rows[7])[0].text() == "row 7"
+          && (*rows[20])[0].text() == string(100, 'u') && (*rows[1000])[0].text() == "no c");
+    for (Row* r: rows)
+        delete r;
+    cout << "project " << (ok ? "ok" : "failed") << endl;
+    if (!ok) {
+        delete handles;
+        return false;
+    }
+
+    // a where clause on two columns, and a NULL
+    ValueDict where;
+    where["b"] = Value("row 77");
+    where["c"] = Value(false);
+    where["c"].data_type = ColumnAttribute::BOOLEAN;
+    Handles* found = table.select(&where);
+    ok = (found->size() == 1);
+    if (ok) {
+        ValueDict* result = table.project((*found)[0]);
+        ok = ((*result)["a"].n == 77);
+        delete result;
+    }
+    delete found;
+    ValueDict* last = table.project(handles->back());
+    ok = ok && (*last)["c"].is_null() && (*last)["a"].n == 1000;
+    delete last;
+    cout << "select " << (ok ? "ok" : "failed") << endl;
+    if (!ok) {
+        delete handles;
+        return false;
+    }
+
+    // ranges, on the minipages; the NULL in c is in none
+    ValueRanges ranges;
+    ranges["a"].restrict_min(Value(100), true);
+    ranges["a"].restrict_max(Value(200), false);
+    ranges["b"].restrict_min(Value("row"), true);
+    ranges["b"].restrict_max(Value("row 2"), false);
+    u_long in_range = test_count(table.cursor(nullptr, &ranges));
+    ranges.clear();
+    ranges["a"].restrict_min(Value(999), false);
+    ranges["c"];
+    u_long not_null = test_count(table.cursor(nullptr, &ranges));
+    ok = (in_range == 90 && not_null == 0);  // the long b's of the tens are all out of range
+    cout << "ranges " << (ok ? "ok" : "failed") << endl;
+    if (!ok) {
+        delete handles;
+        return false;
+    }
+
+    // deleted rows drop out of selections
+    for (uint i = 0; i < handles->size(); i += 3)
+        table.del((*handles)[i]);
+    where.clear();
+    where["c"] = Value(true);
+    where["c"].data_type = ColumnAttribute::BOOLEAN;
+    found = table.select(handles, &where);
+    ok = (found->size() == 333);  // the evens not divisible by 3, below 1000
+    delete found;
+    delete handles;
+    handles = table.select();
+    ok = ok && handles->size() == 1001 - 334;
+    delete handles;
+    cout << "delete " << (ok ? "ok" : "failed") << endl;
+
+    table.drop();
+    return ok;
+}
+
+// Rows/s each kind of scan gets through, the same rows stored in a heap table and in a column table:
+// a where clause and a range together, just the range (which matches most rows), and an equal TEXT.
+void benchmark_scan() {
+    ColumnNames column_names{"a", "b", "c"};
+    ColumnAttributes column_attributes{ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::INT),
+                                       ColumnAttribute(ColumnAttribute::TEXT)};
+    const int rows = 200000, scans = 10;
+    ValueDict where;
+    where["b"] = Value(7);
+    ValueRanges ranges;
+    ranges["a"].restrict_min(Value(1000), true);
+    ranges["a"].restrict_max(Value(150000), false);
+    ValueDict text_where;
+    text_where["c"] = Value("text 5");
+    HeapTable heap_table("_bench_scan_heap_cpp", column_names, column_attributes);
+    ColumnTable column_table("_bench_scan_column_cpp", column_names, column_attributes);
+    for (DbRelation *table: {(DbRelation*)&heap_table, (DbRelation*)&column_table}) {
+        table->create();
+        ValueDict row;
+        for (int i = 0; i < rows; i++) {
+            row["a"] = Value(i);
+            row["b"] = Value(i % 100);
+            row["c"] = Value("text " + to_string(i % 1000));
+            table->insert(&row);
+        }
+        const char *kind = table == &heap_table ? "heap:   " : "column: ";
+        struct { const char *name; const ValueDict *where; const ValueRanges *ranges; } cases[] = {
+                {"where and range", &where, &ranges},
+                {"range", nullptr, &ranges},
+                {"text", &text_where, nullptr}};
+        for (auto &scan_case: cases) {
+            u_long found = 0;
+            auto start = chrono::steady_clock::now();
+            for (int scan = 0; scan < scans; scan++)
+                found += test_count(table->cursor(scan_case.where, scan_case.ranges));
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << kind << scan_case.name << " found " << found / scans << ", scan "
+                 << (u_long)(rows * scans / seconds) << " rows/s" << endl;
+        }
+        table->drop();
+    }
+}
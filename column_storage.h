@@ -0,0 +1,164 @@
+/**
+ * @file column_storage.h - column-oriented (PAX) storage engine
+ * ColumnPage: DbBlock
+ * ColumnTable: DbRelation
+ */
+#pragma once
+
+#include "heap_storage.h"
+
+/**
+ * @class ColumnPage - PAX layout of a block (implementation of DbBlock)
+ *
+ * The rows in a block are kept column by column. After the header and a bitmap of the deleted rows,
+ * each column has a minipage: a bitmap of its NULLs and then its values for all the rows the block
+ * has room for, INT and BOOLEAN right there and TEXT as an (offset, size) pair into the text that
+ * fills the block from its end down. Reading one column of a block only touches its minipage.
+ *     Bytes 0x00 - 0x01: capacity (rows the block is laid out for)
+ *     Bytes 0x02 - 0x03: count (rows added so far, deleted ones included)
+ *     Bytes 0x04 - 0x05: offset to the start of the text
+ * Bitmaps are padded to 4 bytes so each minipage's values stay aligned. Record ids are the rows'
+ * positions, from 1. Through the DbBlock interface a record is a whole row in the RowFormat.
+ * Deleting a row leaves its text where it is.
+ */
+class ColumnPage : public DbBlock {
+public:
+    static u_long text_room;  // TEXT bytes a new block plans on for each TEXT column of each row
+
+    ColumnPage(Dbt &block, BlockID block_id, const RowFormat &format, bool is_new=false);
+    virtual ~ColumnPage() {}
+    ColumnPage(const ColumnPage& other) = delete;
+    ColumnPage(ColumnPage&& temp) = delete;
+    ColumnPage& operator=(const ColumnPage& other) = delete;
+    ColumnPage& operator=(ColumnPage&& temp) = delete;
+
+    virtual RecordID add(const Dbt* data) throw(DbBlockNoRoomError);
+    virtual Dbt* get(RecordID record_id) const;  // points into a buffer of ours, good until the next get
+    virtual void put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError);
+    virtual void del(RecordID record_id);
+    virtual RecordIDs* ids() const;
+    virtual void clear();
+    virtual u_int16_t size() const;
+
+    RecordID add(const Value *values) throw(DbBlockNoRoomError);  // a value for each column, in order
+    u_int16_t get_capacity() const { return this->capacity; }
+    u_int16_t get_count() const { return this->count; }  // record ids go from 1 through this
+    bool is_deleted(RecordID record_id) const;
+    const char *get_column(RecordID record_id, uint col_num, uint16_t &size) const;  // nullptr for NULL
+    Value get_value(RecordID record_id, uint col_num, bool view=false) const;  // a view borrows its TEXT from the block
+    void get_vector(uint col_num, ColumnVector &vector,
+                    const uint8_t *wanted) const;  // the column's values for all the records (or at least the wanted ones)
+    void get_live(uint8_t *live) const;  // 1 for each record that isn't deleted
+
+protected:
+    static const uint16_t HEADER = 8;
+
+    const RowFormat &format;
+    uint16_t capacity;
+    uint16_t count;
+    uint16_t text_start;
+    std::vector<uint16_t> minipages;  // where each column's minipage starts
+    uint16_t data_end;  // end of the last minipage
+    mutable std::vector<char> record;  // for get
+
+    static uint16_t width(ColumnAttribute::DataType data_type);
+    static uint16_t bitmap_size(uint16_t capacity) { return (uint16_t)((capacity + 31) / 32 * 4); }
+    static u_long layout_size(const ColumnAttributes &column_attributes, uint16_t capacity);
+    static uint16_t capacity_for(const ColumnAttributes &column_attributes);
+    void lay_out();
+    void put_header();
+    bool get_bit(uint16_t bitmap, RecordID record_id) const;
+    void put_bit(uint16_t bitmap, RecordID record_id, bool bit);
+    u_long text_needed(const Value *values, RecordID record_id) const;
+    void put_value(RecordID record_id, uint col_num, const Value &value);
+    char *address(uint16_t offset) const { return (char*)this->block.get_data() + offset; }
+};
+
+/**
+ * @class ColumnTable - column-oriented storage engine (implementation of DbRelation)
+ *
+ * Rows go into the ColumnPages of a HeapFile, so they share its buffer pool. The pool's frames are
+ * SlottedPages, but a ColumnTable only ever uses them to pin, dirty, and unpin its blocks, and
+ * reads and writes the bytes through a ColumnPage. Where clauses are checked a column at a time
+ * over each block, right on its minipages, and projections read just the columns they are asked for.
+ */
+class ColumnTable : public DbRelation {
+    friend class ColumnTableCursor;
+public:
+    ColumnTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes);
+    virtual ~ColumnTable() {}
+    ColumnTable(const ColumnTable& other) = delete;
+    ColumnTable(ColumnTable&& temp) = delete;
+    ColumnTable& operator=(const ColumnTable& other) = delete;
+    ColumnTable& operator=(ColumnTable&& temp) = delete;
+
+    virtual void create();
+    virtual void create_if_not_exists();
+    virtual void drop();
+
+    virtual void open();
+    virtual void close();
+
+    virtual Handle insert(const ValueDict* row);
+    virtual void update(const Handle handle, const ValueDict* new_values);
+    virtual void del(const Handle handle);
+
+    virtual Handles* select();
+    virtual Handles* select(const ValueDict* where);
+    virtual Handles* select(Handles *current_selection, const ValueDict* where);
+    virtual DbCursor* cursor(const ValueDict* where=nullptr, const ValueRanges* ranges=nullptr);
+    using DbRelation::cursor;
+    virtual ValueDict* project(Handle handle);
+    virtual ValueDict* project(Handle handle, const ColumnNames* column_names);
+    virtual ValueDicts* project(Handles* handles);
+    virtual ValueDicts* project(Handles* handles, const ColumnNames* column_names);
+    virtual void project(Handle handle, Row &row);
+    virtual void project(Handles* handles, RowLayoutPtr layout, Rows &rows);
+    using DbRelation::project;
+
+    virtual BufferPool::Stats get_buffer_stats() const { return file.get_buffer_stats(); }
+
+protected:
+    HeapFile file;
+    RowFormat format;
+    RowLayoutPtr layout;  // all our columns, in order
+
+    virtual Row* validate(const ValueDict* row) const;
+    virtual Handle append(const Row* row);
+    virtual void selected(const ColumnPage &page, const BatchFilter &filter, ColumnVector &values,
+                          std::vector<uint8_t> &selected) const;
+    virtual void unmarshal(const ColumnPage &page, RecordID record_id, const std::vector<int> &slots,
+                           Value *values) const;
+    virtual const std::vector<int> &slots_for(const RowLayout &layout) const;
+};
+
+/**
+ * @class ColumnTableCursor - DbCursor that scans a ColumnTable one block at a time
+ *
+ * Each block's matching record ids are found together, by running its minipages through a
+ * BatchFilter, when the cursor gets to it. Blocks appended after open() are not visited.
+ */
+class ColumnTableCursor : public DbCursor {
+public:
+    ColumnTableCursor(ColumnTable &table, const ValueDict* where, const ValueRanges* ranges=nullptr);
+    virtual ~ColumnTableCursor() {}
+    ColumnTableCursor(const ColumnTableCursor& other) = delete;
+    ColumnTableCursor& operator=(const ColumnTableCursor& other) = delete;
+
+    virtual void open();
+    virtual bool next(Handle &handle);
+    virtual void close();
+
+protected:
+    ColumnTable &table;
+    BatchFilter filter;      // from the where clause and ranges
+    ColumnVector values;     // the current block's values of one of the filter's columns
+    std::vector<uint8_t> selected;      // which of the current block's records are kept
+    BlockID block_id;        // block currently being scanned (0 before the first one)
+    BlockID last_block_id;   // final block as of open()
+    RecordIDs record_ids;    // matching records in the current block
+    size_t position;         // next index into record_ids
+};
+
+bool test_column_storage();
+void benchmark_scan();
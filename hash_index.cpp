@@ -0,0 +1,622 @@
+/*
+ * @file hash_index.cpp
+ * Contains definitions for HashIndex
+ * An extendible hashing implementation of DbIndex
+ */
+
+#include <cstring>
+#include <set>
+#include "hash_index.h"
+using namespace std;
+
+// Entry records are the key's hash, then the handle, then the marshaled key.
+static const u_long HANDLE_AT = sizeof(uint32_t);
+static const u_long KEY_AT = HANDLE_AT + sizeof(BlockID) + sizeof(RecordID);
+
+static string make_entry(uint32_t hash, Handle handle, const string &key) {
+    string entry(KEY_AT, '\0');
+    memcpy(&entry[0], &hash, sizeof(hash));
+    memcpy(&entry[HANDLE_AT], &handle.first, sizeof(BlockID));
+    memcpy(&entry[HANDLE_AT + sizeof(BlockID)], &handle.second, sizeof(RecordID));
+    return entry + key;
+}
+
+static uint32_t entry_hash(const string &entry) {
+    uint32_t hash;
+    memcpy(&hash, entry.data(), sizeof(hash));
+    return hash;
+}
+
+
+/**************
+ * HashBucket *
+ **************/
+
+HashBucket::HashBucket(HeapFile &file, BlockID block_id, bool create, uint depth)
+        : file(file), block(nullptr), id(block_id) {
+    if (create) {
+        this->block = file.get_new();
+        this->id = this->block->get_block_id();
+        uint32_t n = depth;
+        Dbt dbt(&n, sizeof(n));
+        this->block->add(&dbt);  // DEPTH
+        n = 0;
+        this->block->add(&dbt);  // NEXT
+    } else {
+        this->block = file.get(block_id);
+    }
+}
+
+HashBucket::~HashBucket() {
+    this->file.unpin(this->block);
+    this->block = nullptr;
+}
+
+uint32_t HashBucket::get_number(RecordID record_id) const {
+    Dbt dbt;
+    this->block->get(record_id, dbt);
+    return *(uint32_t *)dbt.get_data();
+}
+
+void HashBucket::put_number(RecordID record_id, uint32_t n) {
+    Dbt dbt(&n, sizeof(n));
+    this->block->put(record_id, dbt);
+}
+
+void HashBucket::set_depth(uint depth) {
+    put_number(DEPTH, depth);
+}
+
+void HashBucket::set_next(BlockID next) {
+    put_number(NEXT, next);
+}
+
+uint32_t HashBucket::get_hash(u_long i) const {
+    Dbt dbt;
+    this->block->get((RecordID)(NEXT + 1 + i), dbt);
+    return *(uint32_t *)dbt.get_data();
+}
+
+Handle HashBucket::get_handle(u_long i) const {
+    Dbt dbt;
+    this->block->get((RecordID)(NEXT + 1 + i), dbt);
+    const char *bytes = (const char *)dbt.get_data() + HANDLE_AT;
+    return Handle(*(const BlockID *)bytes, *(const RecordID *)(bytes + sizeof(BlockID)));
+}
+
+// Compare in place: the hash first, and only if that matches the key bytes.
+bool HashBucket::matches(u_long i, uint32_t hash, const string &key) const {
+    Dbt dbt;
+    this->block->get((RecordID)(NEXT + 1 + i), dbt);
+    const char *bytes = (const char *)dbt.get_data();
+    return *(const uint32_t *)bytes == hash && dbt.get_size() == KEY_AT + key.size()
+           && memcmp(bytes + KEY_AT, key.data(), key.size()) == 0;
+}
+
+string HashBucket::get_entry(u_long i) const {
+    Dbt dbt;
+    this->block->get((RecordID)(NEXT + 1 + i), dbt);
+    return string((const char *)dbt.get_data(), dbt.get_size());
+}
+
+bool HashBucket::add(const string &entry) {
+    Dbt dbt((void *)entry.data(), (u_int32_t)entry.size());
+    try {
+        this->block->add(&dbt);
+    } catch (DbBlockNoRoomError &e) {
+        return false;
+    }
+    return true;
+}
+
+void HashBucket::remove(u_long i) {
+    this->block->remove_at((RecordID)(NEXT + 1 + i));
+}
+
+void HashBucket::clear() {
+    uint32_t depth = get_depth(), next = get_next();
+    this->block->clear();
+    Dbt dbt(&depth, sizeof(depth));
+    this->block->add(&dbt);
+    dbt.set_data(&next);
+    this->block->add(&dbt);
+}
+
+void HashBucket::save() {
+    this->file.put(this->block);
+}
+
+
+/*************
+ * HashIndex *
+ *************/
+
+double HashIndex::fill_factor = 0.7;
+
+/*
+ * HashIndex constructor
+ *
+ * @param Relation relation - on which the index is built
+ * @param Identifier name - name of index
+ * @param ColumnNames key columns - name of columns for index
+ * @param bool unique if it is a unique key
+ */
+HashIndex::HashIndex(DbRelation& relation, Identifier name, ColumnNames key_columns, bool unique)
+        : DbIndex(relation, name, key_columns, unique),
+          closed(true),
+          file(relation.get_table_name() + "-" + name),
+          depth(0),
+          directory(),
+          directory_blocks() {
+}
+
+/*
+ * Create the index, hashing in the rows already in the relation. It starts out with
+ * about enough buckets for them, so it doesn't have to split its way up to that.
+ */
+void HashIndex::create() {
+    this->file.create();
+    this->closed = false;
+    Handles *handles = nullptr;
+    ValueDicts *rows = nullptr;
+    try {
+        handles = this->relation.select();
+        rows = this->relation.project(handles, &this->key_columns);
+        vector<string> keys;
+        vector<bool> nulls;  // which keys have a NULL in them, and so can't be duplicates
+        keys.reserve(rows->size());
+        for (auto const& row: *rows) {
+            bool null;
+            keys.push_back(this->marshal_key(row, &null));
+            nulls.push_back(null);
+        }
+        for (auto const& row: *rows)
+            delete row;
+        delete rows;
+        rows = nullptr;
+
+        // guess the entry size from the first key
+        this->depth = 0;
+        if (!keys.empty()) {
+            u_long per_bucket = (u_long)(fill_factor * (DbBlock::BLOCK_SZ - 12)) / (4 + KEY_AT + keys[0].size());
+            if (per_bucket == 0)
+                per_bucket = 1;
+            while (this->depth < MAX_DEPTH && (per_bucket << this->depth) < keys.size())
+                this->depth++;
+        }
+        this->directory.clear();
+        for (u_long i = 0; i < (1UL << this->depth); i++) {
+            HashBucket bucket(this->file, 0, true, this->depth);
+            bucket.save();
+            this->directory.push_back(bucket.get_id());
+        }
+        this->save_directory();
+
+        for (u_long i = 0; i < keys.size(); i++) {
+            uint32_t h = hash(keys[i]);
+            if (this->unique && !nulls[i]) {
+                Handles *found = this->lookup_key(h, keys[i]);
+                bool duplicate = !found->empty();
+                delete found;
+                if (duplicate)
+                    throw DbRelationError("Duplicate keys are not allowed in unique index");
+            }
+            this->add(h, make_entry(h, (*handles)[i], keys[i]));
+        }
+        delete handles;
+    //if create fails, drop what you have done
+    } catch (DbRelationError& e) {
+        if (rows != nullptr) {
+            for (auto const& row: *rows)
+                delete row;
+            delete rows;
+        }
+        delete handles;
+        this->drop();
+        throw;
+    }
+}
+
+/*
+ * Drop the index.
+ */
+void HashIndex::drop() {
+    if (!this->closed)
+        this->close();
+    this->file.drop();
+}
+
+/*
+ * Open existing index, reading in the directory. Enables: lookup, insert, delete.
+ */
+void HashIndex::open() {
+    if (!this->closed)
+        return;
+    this->file.open();
+    SlottedPage *header = this->file.get(HEADER);
+    Dbt dbt;
+    header->get(DEPTH, dbt);
+    this->depth = *(uint32_t *)dbt.get_data();
+    header->get(DIRECTORY, dbt);
+    const BlockID *ids = (const BlockID *)dbt.get_data();
+    this->directory_blocks.assign(ids, ids + dbt.get_size() / sizeof(BlockID));
+    this->file.unpin(header);
+
+    this->directory.clear();
+    for (auto const& block_id: this->directory_blocks) {
+        SlottedPage *page = this->file.get(block_id);
+        page->get(1, dbt);
+        ids = (const BlockID *)dbt.get_data();
+        this->directory.insert(this->directory.end(), ids, ids + dbt.get_size() / sizeof(BlockID));
+        this->file.unpin(page);
+    }
+    this->closed = false;
+}
+
+/*
+ * Closes the index. Disables: lookup, insert, delete.
+ */
+void HashIndex::close() {
+    this->file.close();
+    this->directory.clear();
+    this->directory_blocks.clear();
+    this->closed = true;
+}
+
+/*
+ * Find all the rows whose columns are equal to key.
+ * @param ValueDict* key - values for all the index's columns
+ * @return Handles of the matching rows
+ */
+Handles* HashIndex::lookup(ValueDict* key) const {
+    string marshaled = this->marshal_key(key);
+    return this->lookup_key(hash(marshaled), marshaled);
+}
+
+// Handles of the entries for key, from its bucket and any overflow buckets chained to it
+Handles *HashIndex::lookup_key(uint32_t hash, const string &key) const {
+    Handles *handles = new Handles;
+    BlockID next = this->bucket_for(hash);
+    while (next != 0) {
+        HashBucket bucket(this->file, next, false);
+        for (u_long i = 0; i < bucket.get_count(); i++)
+            if (bucket.matches(i, hash, key))
+                handles->push_back(bucket.get_handle(i));
+        next = bucket.get_next();
+    }
+    return handles;
+}
+
+/*
+ * Insert a row with the given handle. Row must exist in relation already.
+ * @param Handle handle of row to insert
+ */
+void HashIndex::insert(Handle handle) {
+    ValueDict *row = this->relation.project(handle, &this->key_columns);
+    bool null;
+    string key = this->marshal_key(row, &null);
+    delete row;
+    uint32_t h = hash(key);
+    if (this->unique && !null) {  // keys with a NULL in them are never duplicates
+        Handles *found = this->lookup_key(h, key);
+        bool duplicate = !found->empty();
+        delete found;
+        if (duplicate)
+            throw DbRelationError("Duplicate keys are not allowed in unique index");
+    }
+    this->add(h, make_entry(h, handle, key));
+}
+
+/*
+ * Delete a row's entry from the index. Row must still exist in relation.
+ * Buckets are left where they are, even if empty.
+ * @param Handle handle of row to remove
+ */
+void HashIndex::del(Handle handle) {
+    ValueDict *row = this->relation.project(handle, &this->key_columns);
+    string key = this->marshal_key(row);
+    delete row;
+    uint32_t h = hash(key);
+    BlockID next = this->bucket_for(h);
+    while (next != 0) {
+        HashBucket bucket(this->file, next, false);
+        for (u_long i = 0; i < bucket.get_count(); i++) {
+            if (bucket.get_hash(i) == h && bucket.get_handle(i) == handle) {
+                bucket.remove(i);
+                bucket.save();
+                return;
+            }
+        }
+        next = bucket.get_next();
+    }
+    throw DbRelationError("key not found in index");
+}
+
+// Add entry to its bucket, splitting the bucket until there is room if splitting can help.
+void HashIndex::add(uint32_t hash, const string &entry) {
+    while (true) {
+        BlockID bucket_id = this->bucket_for(hash);
+        {
+            HashBucket bucket(this->file, bucket_id, false);
+            if (bucket.add(entry)) {
+                bucket.save();
+                return;
+            }
+            if (!this->can_split(bucket, hash))
+                break;
+        }
+        this->split(bucket_id);
+    }
+    this->place(this->bucket_for(hash), entry);
+}
+
+// Splitting only helps if some hash in the bucket differs from this one in the bits we could go down to.
+bool HashIndex::can_split(const HashBucket &bucket, uint32_t hash) const {
+    if (bucket.get_depth() >= MAX_DEPTH)
+        return false;
+    uint32_t mask = (1U << MAX_DEPTH) - 1;
+    for (u_long i = 0; i < bucket.get_count(); i++)
+        if (((bucket.get_hash(i) ^ hash) & mask) != 0)
+            return true;
+    return false;
+}
+
+// Split a full bucket on its next hash bit: entries with it set move to a new sibling bucket.
+void HashIndex::split(BlockID bucket_id) {
+    // empty out the bucket and its overflow chain, keeping the chain for the ones that stay
+    vector<string> entries;
+    uint local = 0;
+    BlockID next = bucket_id;
+    while (next != 0) {
+        HashBucket bucket(this->file, next, false);
+        for (u_long i = 0; i < bucket.get_count(); i++)
+            entries.push_back(bucket.get_entry(i));
+        if (next == bucket_id) {
+            local = bucket.get_depth();
+            bucket.set_depth(local + 1);
+        }
+        bucket.clear();
+        bucket.save();
+        next = bucket.get_next();
+    }
+
+    bool doubled = local == this->depth;
+    if (doubled) {
+        BlockIDs copy(this->directory);
+        this->directory.insert(this->directory.end(), copy.begin(), copy.end());
+        this->depth++;
+    }
+    BlockID sibling_id;
+    {
+        HashBucket sibling(this->file, 0, true, local + 1);
+        sibling.save();
+        sibling_id = sibling.get_id();
+    }
+    set<u_long> changed;
+    for (u_long i = 0; i < this->directory.size(); i++) {
+        if (this->directory[i] == bucket_id && ((i >> local) & 1) != 0) {
+            this->directory[i] = sibling_id;
+            changed.insert(i / PER_DIRECTORY_BLOCK);
+        }
+    }
+    if (doubled) {
+        this->save_directory();
+    } else {
+        for (auto const& i: changed)
+            this->save_directory_block(i);
+    }
+
+    for (auto const& entry: entries)
+        this->place(((entry_hash(entry) >> local) & 1) != 0 ? sibling_id : bucket_id, entry);
+}
+
+// Put entry in the first bucket down the chain from bucket_id that has room, chaining on a new one if none does.
+void HashIndex::place(BlockID bucket_id, const string &entry) {
+    BlockID next = bucket_id;
+    while (true) {
+        HashBucket bucket(this->file, next, false);
+        if (bucket.add(entry)) {
+            bucket.save();
+            return;
+        }
+        next = bucket.get_next();
+        if (next == 0) {
+            HashBucket overflow(this->file, 0, true, bucket.get_depth());
+            if (!overflow.add(entry))
+                throw DbRelationError("index key too big for a hash bucket");
+            overflow.save();
+            bucket.set_next(overflow.get_id());
+            bucket.save();
+            return;
+        }
+    }
+}
+
+// Write out the whole directory, getting more blocks for it if need be, and then the header.
+void HashIndex::save_directory() {
+    u_long needed = (this->directory.size() + PER_DIRECTORY_BLOCK - 1) / PER_DIRECTORY_BLOCK;
+    while (this->directory_blocks.size() < needed) {
+        SlottedPage *page = this->file.get_new();
+        this->directory_blocks.push_back(page->get_block_id());
+        this->file.unpin(page);
+    }
+    for (u_long i = 0; i < needed; i++)
+        this->save_directory_block(i);
+
+    SlottedPage *header = this->file.get(HEADER);
+    header->clear();
+    uint32_t n = this->depth;
+    Dbt dbt(&n, sizeof(n));
+    header->add(&dbt);
+    Dbt ids(&this->directory_blocks[0], (u_int32_t)(this->directory_blocks.size() * sizeof(BlockID)));
+    header->add(&ids);
+    this->file.put(header);
+    this->file.unpin(header);
+}
+
+// Write out the i-th block's worth of the directory.
+void HashIndex::save_directory_block(u_long i) {
+    u_long from = i * PER_DIRECTORY_BLOCK;
+    u_long to = from + PER_DIRECTORY_BLOCK < this->directory.size() ? from + PER_DIRECTORY_BLOCK : this->directory.size();
+    SlottedPage *page = this->file.get(this->directory_blocks[i]);
+    page->clear();
+    Dbt dbt(&this->directory[from], (u_int32_t)((to - from) * sizeof(BlockID)));
+    page->add(&dbt);
+    this->file.put(page);
+    this->file.unpin(page);
+}
+
+// Marshal the values of the key columns, the same way every time so keys can be compared byte for byte.
+// A NULL goes in as zero (or empty TEXT), and a key with any NULLs ends with a bitmap of which ones
+// they are, so it can't be mistaken for one without.
+string HashIndex::marshal_key(const ValueDict *row, bool *has_null) const {
+    string key;
+    string nulls((this->key_columns.size() + 7) / 8, '\0');
+    bool null = false;
+    uint col_num = 0;
+    for (auto const& column_name: this->key_columns) {
+        const Value &value = row->at(column_name);
+        if (value.is_null()) {
+            nulls[col_num / 8] |= (char)(1 << (col_num % 8));
+            null = true;
+        }
+        col_num++;
+        if (value.data_type == ColumnAttribute::DataType::INT) {
+            int32_t n = value.is_null() ? 0 : value.n;
+            key.append((const char *)&n, sizeof(n));
+        } else if (value.data_type == ColumnAttribute::DataType::TEXT) {
+            if (value.text_size() > UINT16_MAX)
+                throw DbRelationError("text field too long to marshal");
+            uint16_t size = (uint16_t)value.text_size();
+            key.append((const char *)&size, sizeof(size));
+            key.append(value.text_data(), size);
+        } else if (value.data_type == ColumnAttribute::DataType::BOOLEAN) {
+            uint8_t b = value.is_null() ? 0 : (uint8_t)value.n;
+            key.append((const char *)&b, sizeof(b));
+        } else {
+            throw DbRelationError("only know how to marshal INT, TEXT, or BOOLEAN for hash index");
+        }
+    }
+    if (null)
+        key += nulls;
+    if (has_null != nullptr)
+        *has_null = null;
+    return key;
+}
+
+// FNV-1a, with a final mix so the low bits the directory goes by depend on all of the key.
+uint32_t HashIndex::hash(const string &key) {
+    uint32_t h = 2166136261U;
+    for (unsigned char c: key) {
+        h ^= c;
+        h *= 16777619U;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * Helper function for test: check that a lookup finds count rows, all with the key.
+ */
+static bool test_lookup(HashIndex &index, HeapTable &table, Identifier column, int value, u_long count) {
+    ValueDict key;
+    key[column] = value;
+    Handles *handles = index.lookup(&key);
+    bool ok = handles->size() == count;
+    for (auto const& handle: *handles) {
+        ValueDict *row = table.project(handle);
+        ok = ok && (*row)[column].n == value;
+        delete row;
+    }
+    delete handles;
+    return ok;
+}
+
+bool test_hash_index() {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    ColumnAttribute ca(ColumnAttribute::INT);
+    column_attributes.push_back(ca);
+    column_attributes.push_back(ca);
+    HeapTable table("_test_hash_cpp", column_names, column_attributes);
+    table.create();
+    for (int i = 0; i < 2000; i++) {
+        ValueDict row;
+        row["a"] = i;
+        row["b"] = i < 1000 ? 0 : i % 10;
+        table.insert(&row);
+    }
+
+    // built over the rows already there, then grown past that with splits
+    ColumnNames a_column, b_column;
+    a_column.push_back("a");
+    b_column.push_back("b");
+    HashIndex index(table, "test_hash_a", a_column, true);
+    index.create();
+    HashIndex multi_index(table, "test_hash_b", b_column, false);
+    multi_index.create();
+    for (int i = 2000; i < 10000; i++) {
+        ValueDict row;
+        row["a"] = i;
+        row["b"] = i % 10;
+        Handle handle = table.insert(&row);
+        index.insert(handle);
+        multi_index.insert(handle);
+    }
+    for (int i = 0; i < 10000; i += 7)
+        if (!test_lookup(index, table, "a", i, 1))
+            return false;
+    if (!test_lookup(index, table, "a", 10000, 0)
+        || !test_lookup(multi_index, table, "b", 0, 1000 + 900)  // piles up in overflow buckets
+        || !test_lookup(multi_index, table, "b", 3, 900)
+        || !test_lookup(multi_index, table, "b", 10, 0))
+        return false;
+
+    // duplicate keys are turned away from the unique one
+    ValueDict dup;
+    dup["a"] = 5;
+    dup["b"] = 5;
+    Handle dup_handle = table.insert(&dup);
+    try {
+        index.insert(dup_handle);
+        return false;
+    } catch (DbRelationError &e) {}
+    HashIndex late_index(table, "test_hash_late", a_column, true);  // and one made over them isn't made at all
+    try {
+        late_index.create();
+        return false;
+    } catch (DbRelationError &e) {}
+    table.del(dup_handle);
+
+    // deletes, then the directory comes back the same from disk
+    for (int i = 0; i < 10000; i += 2) {
+        ValueDict key;
+        key["a"] = i;
+        Handles *handles = index.lookup(&key);
+        index.del(handles->at(0));
+        multi_index.del(handles->at(0));
+        delete handles;
+    }
+    index.close();
+    multi_index.close();
+    index.open();
+    multi_index.open();
+    for (int i = 0; i < 10000; i += 7)
+        if (!test_lookup(index, table, "a", i, i % 2))
+            return false;
+    if (!test_lookup(multi_index, table, "b", 0, 500)
+        || !test_lookup(multi_index, table, "b", 3, 900)
+        || !test_lookup(multi_index, table, "b", 4, 0))
+        return false;
+
+    index.drop();
+    multi_index.drop();
+    table.drop();
+    return true;
+}
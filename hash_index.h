@@ -0,0 +1,93 @@
+#pragma once
+
+#include "heap_storage.h"
+
+// A bucket block: its local depth, the next overflow bucket (0 for none), and then a record for
+// each entry: the key's hash, the handle, and the marshaled key.
+class HashBucket {
+public:
+    HashBucket(HeapFile &file, BlockID block_id, bool create, uint depth=0);
+    virtual ~HashBucket();
+
+    BlockID get_id() const { return this->id; }
+    uint get_depth() const { return get_number(DEPTH); }
+    void set_depth(uint depth);
+    BlockID get_next() const { return get_number(NEXT); }
+    void set_next(BlockID next);
+
+    u_long get_count() const { return this->block->get_num_records() - NEXT; }
+    uint32_t get_hash(u_long i) const;
+    Handle get_handle(u_long i) const;
+    bool matches(u_long i, uint32_t hash, const std::string &key) const;  // entry i is for this key
+    std::string get_entry(u_long i) const;  // the whole record, as is
+
+    bool add(const std::string &entry);  // false if full; unsaved
+    void remove(u_long i);  // unsaved
+    void clear();  // drop all the entries, keeping depth and next; unsaved
+    void save();
+
+protected:
+    static const RecordID DEPTH = 1;
+    static const RecordID NEXT = 2;
+
+    HeapFile &file;
+    SlottedPage *block;
+    BlockID id;
+
+    uint32_t get_number(RecordID record_id) const;
+    void put_number(RecordID record_id, uint32_t n);
+};
+
+/**
+ * @class HashIndex - extendible hashing index
+ *
+ * Block 1 holds the global depth and the ids of the blocks the directory is kept in. The directory
+ * sends a key to the bucket for the low global-depth bits of its hash. A full bucket splits in two
+ * on its next hash bit, doubling the directory first if the bucket was already as deep as it. When
+ * splitting can't help, because all the bucket's keys hash alike or it is MAX_DEPTH deep, it chains
+ * an overflow bucket instead. Buckets are never merged back together. Equality lookups only.
+ */
+class HashIndex : public DbIndex {
+public:
+    static const uint MAX_DEPTH = 16;  // most hash bits the directory goes by
+    static double fill_factor;  // how full create() plans on the buckets being, in (0, 1]
+
+    HashIndex(DbRelation& relation, Identifier name, ColumnNames key_columns, bool unique);
+    virtual ~HashIndex() {}
+
+    virtual void create();
+    virtual void drop();
+
+    virtual void open();
+    virtual void close();
+
+    virtual Handles* lookup(ValueDict* key) const;
+
+    virtual void insert(Handle handle);
+    virtual void del(Handle handle);
+
+protected:
+    static const BlockID HEADER = 1;
+    static const RecordID DEPTH = 1;  // in the header
+    static const RecordID DIRECTORY = 2;  // in the header: the directory blocks' ids
+    static const u_long PER_DIRECTORY_BLOCK = (DbBlock::BLOCK_SZ - 12) / sizeof(BlockID);
+
+    bool closed;
+    mutable HeapFile file;  // reading buckets pins pages even in const lookups
+    uint depth;  // global depth
+    BlockIDs directory;  // bucket for each of the 2^depth hash suffixes
+    BlockIDs directory_blocks;
+
+    std::string marshal_key(const ValueDict *row, bool *has_null=nullptr) const;
+    static uint32_t hash(const std::string &key);
+    BlockID bucket_for(uint32_t hash) const { return this->directory[hash & ((1U << this->depth) - 1)]; }
+    Handles *lookup_key(uint32_t hash, const std::string &key) const;
+    void add(uint32_t hash, const std::string &entry);
+    bool can_split(const HashBucket &bucket, uint32_t hash) const;
+    void split(BlockID bucket_id);
+    void place(BlockID bucket_id, const std::string &entry);
+    void save_directory();
+    void save_directory_block(u_long i);
+};
+
+bool test_hash_index();
@@ -1,685 +1,2587 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <memory.h>
-#include <vector>
-#include <iostream>
-#include "db_cxx.h"
-#include "heap_storage.h"
-#include "storage_engine.h"
-using namespace std;
-
-typedef uint16_t u16;
-
-/* * * * * * * * * * * 
- * SlotPage Functions
- * * * * * * * * * * */
-//Constructor for slotted page
-//Provided by Professor Lundeen
-SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) : DbBlock(block, block_id, is_new) {
-    if (is_new) {
-        this->num_records = 0;
-        this->end_free = DbBlock::BLOCK_SZ - 1;
-        put_header();
-    } else {
-        get_header(this->num_records, this->end_free);
-    }
-}
-
-// Add a new record to the block. Return its id.
-// Provided by Professor Lundeen
-RecordID SlottedPage::add(const Dbt* data) throw(DbBlockNoRoomError) {
-    if (!has_room((u16)data->get_size()))
-        throw DbBlockNoRoomError("not enough room for new record");
-    u16 id = ++this->num_records;
-    u16 size = (u16) data->get_size();
-    this->end_free -= size;
-    u16 loc = this->end_free + 1U;
-    put_header();
-    put_header(id, size, loc);
-    memcpy(this->address(loc), data->get_data(), size);
-    return id;
-}
-
-// Get record from a block. If no block exists or was deleted, return None
-Dbt* SlottedPage::get(RecordID record_id) const{
-
-	u16 size, loc;
-	get_header(size, loc, record_id);
-
-	if(loc == 0){
-		return nullptr;
-	}
-	
-	return new Dbt(this->address(loc),size);
-}
-
-// Replace a record with specified data.
-// Return DbBlockNoRoomError if there is not enough space.
-void SlottedPage::put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError){
-    u16 size, loc;
-    get_header(size, loc, record_id);
-    u16 new_size = (u16)data.get_size();
-
-    if (new_size > size) {
-        u16 extra = new_size - size;
-
-        if (!has_room(extra))
-            throw DbBlockNoRoomError("not enough room for enlarged record (SlottedPage::put)");
-        
-        slide(loc, loc - extra);
-        memcpy(this->address(loc-extra), data.get_data(), new_size);       
-    } else {
-        memcpy(this->address(loc), data.get_data(), new_size);
-        slide(loc + new_size, loc + size);
-    }
-    //if (!has_room(new_size))
-    //    throw DbBlockNoRoomError("Not enough space");
-    //if (new_size > size){
-    //    slide(loc,loc-new_size-size);
-    //    memcpy(address(loc-new_size-size), data.get_data(),new_size);
-    //}
-    //else{
-    //    memcpy(address(loc),data.get_data(),new_size);
-    //    slide(loc+new_size,loc+size);
-    //}
-    get_header(size,loc,record_id);
-    put_header(record_id, new_size, loc);
-}
-
-// Mark record as deleted by setting size and location to 0.
-void SlottedPage::del(RecordID record_id){
-    u16 size, loc;
-    get_header(size, loc, record_id);
-    put_header(record_id, 0, 0);
-    slide(loc, loc+size);
-}
-
-// Gets all non-deleted record IDs
-RecordIDs* SlottedPage::ids(void) const {
-    u16 size, loc;
-    RecordIDs* records = new RecordIDs;
-    for (u16 i = 1; i <= num_records; i++){
-    	get_header(size, loc, i);
-    	if(loc != 0)
-    		records->push_back(i);
-    }
-    return records;
-}
-
-// Erase all the records
-void SlottedPage::clear() {
-    this->num_records = 0;
-    this->end_free = DbBlock::BLOCK_SZ - 1;
-    put_header();
-}
- // Count of non-deleted records
-u16 SlottedPage::size() const {
-    u16 size, loc;
-    u16 count = 0;
-    for (RecordID record_id = 1; record_id <= this->num_records; record_id++) {
-        get_header(size, loc, record_id);
-        if (loc != 0)
-            count++;
-    }
-    return count;
-}
-
-// Gets the size and offset for a record.
-// If record id is 0, it is the block header.
-void SlottedPage::get_header(u16 &size, u16 &loc, RecordID id) const {
-    size = get_n((u16)4*id);
-    loc = get_n((u16)(4*id + 2));
-}
-
-
-// Store the size and offset for given id. For id of zero, store the block header.
-// Provided by professor Lundeen
-void SlottedPage::put_header(RecordID id, u16 size, u16 loc) {
-    if (id == 0) { 
-        size = this->num_records;
-        loc = this->end_free;
-    }
-    put_n((u16)(4*id), size);
-    put_n((u16)(4*id + 2), loc);
-}
-
-// Determines whether there is room for record.
-bool SlottedPage::has_room(u16 size) const {
-    u16 available = this->end_free - (u16)(4*(this->num_records + 2));
-    return size <= available; 
-}
-
-// Moves records around within a block to adhere to slotted page format.
-void SlottedPage::slide(u16 start, u16 end){
-    int shift = end - start;
-
-    // If there is no shift, do nothing
-    if (shift == 0)
-        return;
-
-    // Move data
-    //memcpy((u16)(this->address(end_free+1)), (u16)(this->address(end_free+1+shift)),shift);
-    void *to = this->address((u16)(this->end_free + 1 + shift));
-    void *from = this->address((u16)(this->end_free + 1));
-    int bytes = start - (this->end_free + 1U);
-    char temp[bytes];
-    memcpy(temp, from, bytes);
-    memcpy(to, temp, bytes);
-
-    RecordIDs* record_ids = ids();
-	for (auto const& record_id : *record_ids) {
-		u16 size, loc;
-		get_header(size, loc, record_id);
-		if (loc <= start) {
-			loc += shift;
-			put_header(record_id, size, loc);
-		}
-	}
-    delete record_ids;
-    this->end_free += shift;
-    put_header();
-}
-
-
-// Get 2-byte integer at given offset in block.
-//Provided by Professor Lundeen
-u16 SlottedPage::get_n(u16 offset) const {
-    return *(u16*)this->address(offset);
-}
-
-
-// Put a 2-byte integer at given offset in block.
-// Provided by professor Lundeen
-void SlottedPage::put_n(u16 offset, u16 n) {
-    *(u16*)this->address(offset) = n;
-}
-
-
-// Make a void* pointer for a given offset into the data block.
-// Provided by professor Lundeen
-void* SlottedPage::address(u16 offset) const {
-    return (void*)((char*)this->block.get_data() + offset);
-}
-
-
-/* * * * * * * * * * *
- * HeapFile Functions
- * * * * * * * * * * */
-
-// Constructor
-HeapFile::HeapFile(string name) : DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0) {
-	this->dbfilename = this->name + ".db";
-}
-// Create file
-void HeapFile::create(void) {
-	db_open(DB_CREATE | DB_EXCL);
-	//get_new();
-    SlottedPage *page = get_new(); // force one page to exist
-    delete page;
-}
-
-// Delete file
-void HeapFile::drop(void) {
-    close();
-	Db db(_DB_ENV,0);
-	db.remove(dbfilename.c_str(),nullptr,0);
-}
-
-// Open file
-void HeapFile::open(void) {
-	db_open();
-}
-
-// Close file
-void HeapFile::close(void) {
-	db.close(0);
-    closed = true;
-}
-
-// Allocate a new block for the database file.
-// Returns the new empty DbBlock that is managing the records in this block and its block id.
-// Provided by professor Lundeen
-SlottedPage* HeapFile::get_new(void) {
-    char block[DbBlock::BLOCK_SZ];
-    memset(block, 0, sizeof(block));
-    Dbt data(block, sizeof(block));
-
-    int block_id = ++this->last;
-    Dbt key(&block_id, sizeof(block_id));
-
-    // write out an empty block and read it back in so Berkeley DB is managing the memory
-    SlottedPage* page = new SlottedPage(data, this->last, true);
-    this->db.put(nullptr, &key, &data, 0); // write it out with initialization applied
-    delete page;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, this->last);
-}
-
-
-// Returns a specific slotted page
-SlottedPage* HeapFile::get(BlockID block_id) {
-    Dbt key(&block_id, sizeof(block_id));
-    Dbt retData;
-    // Get page that matches Block ID.
-    this->db.get(nullptr, &key, &retData, 0);
-    return new SlottedPage(retData, block_id, false);
-}
-
-
-// Adds block to specific location
-void HeapFile::put(DbBlock* block){
-    int id = block->get_block_id();
-    // Create new Dbt structure using the new ID, and the size.
-    Dbt key(&id, sizeof(id));
-    this->db.put(nullptr,&key,block->get_block(),0);
-}
-
-
-// Returns list of Block IDs
-BlockIDs* HeapFile::block_ids() const {
-    BlockIDs* bid_list = new BlockIDs();
-    for(BlockID i = 1; i <= (this->last); i++){
-        bid_list -> push_back(i);
-    }
-    return bid_list;
-}
-uint32_t HeapFile::get_block_count() {
-    DB_BTREE_STAT* stat;
-    this->db.stat(nullptr, &stat, DB_FAST_STAT);
-    return stat->bt_ndata;
-}
-
-// Creates and opens DB
-void HeapFile::db_open(uint flags){
-//    DB_BTREE_STAT *stat;
-//    if(!closed){
-//    	return;
-//    }
-//    db.set_re_len(DbBlock::BLOCK_SZ);
-//    dbfilename = name + ".db";
-//    db.open(nullptr, dbfilename.c_str(), nullptr, DB_RECNO, flags, 0644);
-//
-//    if(flags == 0){
-//    	db.stat(nullptr, &stat, 0);
-//    	last = stat->bt_ndata;
-//    } else {
-//        this->last = 0;
-//    }
-//    delete stat;
-//    closed = false;
-    if (!this->closed)
-        return;
-    this->db.set_re_len(DbBlock::BLOCK_SZ); // record length - will be ignored if file already exists
-    this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags, 0644);
-
-    this->last = flags ? 0 : get_block_count();
-    this->closed = false;
-}
-
-
-/* * * * * * * * * * * *
- * HeapTable Functions
- * * * * * * * * * * * */
-//Provided by Professor Lundeen
-HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes )
-        : DbRelation(table_name,column_names,column_attributes), file(table_name) { }
-
-
-// Executes CREATE TABLE <table_name> (<columns>)
-void HeapTable::create(){
-	file.create();
-}
-
-// Executes CREATE TABLE IF NOT EXISTS <table_name> (<columns>)
-void HeapTable::create_if_not_exists(){
-
-    try{
-        open();
-    } catch (DbException& e) {
-        create();
-    }
-}
-
-// Executes DROP TABLE <table_name>
-void HeapTable::drop(){
-	file.drop();
-}
-
-// Open a table to allow INSERT, UPDATE, DELETE, SELECT, and PROJECT functions
-void HeapTable::open(){
-	file.open();
-}
-
-// Close table
-void HeapTable::close(){
-	file.close();
-}
-
-// Executes INSERT INTO <table_name> (<row_keys>) VALUES (<row_values>)
-// Returns a handle for the inserted row.
-Handle HeapTable::insert(const ValueDict* row){
-    open();    
-    Handle hand = append(validate(row));
-    return hand;
-}
-
-// Will be used to execute UPDATE functions
-void HeapTable::update(const Handle handle, const ValueDict* new_values){
-	throw DbRelationError("UPDATE NOT YET IMPLEMENTED");
-}
-
-// Will be used to execute DELETE functions
-// Provided by professor Lundeen
-void HeapTable::del(const Handle handle){
-	open();
-	BlockID block_id = handle.first;
-	RecordID record_id = handle.second;
-	SlottedPage* block = this->file.get(block_id);
-	block->del(record_id);
-	this->file.put(block);
-	delete block;
-}
-
-// Returns list of handles for all rows
-Handles* HeapTable::select(){
-    //return all rows in table
-    return select(nullptr);
-}
-
-
-// Returns list of handles for specified rows.
-// Provided by professor Lundeen
-Handles* HeapTable::select(const ValueDict* where) {
-    open();
-    Handles* handles = new Handles();
-    BlockIDs* block_ids = file.block_ids();
-
-    for (auto const& block_id: *block_ids) {
-        SlottedPage* block = file.get(block_id);
-        RecordIDs* record_ids = block->ids();
-
-        for (auto const& record_id: *record_ids) {
-            Handle handle(block_id, record_id);
-            if (selected(handle, where))
-                handles->push_back(Handle(block_id, record_id));
-        }           
-        delete record_ids;
-        delete block;
-    }
-
-    delete block_ids;
-    return handles;
-}
-
-// Refine another selection
-// ie if you have nested selections, projections, etc
-Handles* HeapTable::select(Handles *current_selection, const ValueDict* where) {
-    Handles* handles = new Handles();
-    for (auto const& handle: *current_selection)
-        if (selected(handle , where))
-            handles->push_back(handle);
-    return handles;
-}
-
-// Returns all fields of the given handle
-ValueDict* HeapTable::project(Handle handle){
-    return project(handle, &this->column_names);
-}
-
-
-// Returns specific fields of the given handle
-ValueDict* HeapTable::project(Handle handle, const ColumnNames* column_names){
-    BlockID bid = handle.first;
-    RecordID rid = handle.second;
-    SlottedPage* block = file.get(bid);
-    Dbt* data = block->get(rid);
-    ValueDict* row = unmarshal(data);
-    delete data;
-    delete block;
-    if(column_names->empty()){
-        return row;
-    }
-    ValueDict* res = new ValueDict();
-    for(auto const& column_name: *column_names) {
-        if(row->find(column_name) == row->end()){
-            throw(DbRelationError("'" + column_name + "'' does not exist in table.\n"));
-        }
-        (*res)[column_name] = (*row)[column_name];
-    }
-    delete row;
-
-    return res;     
-}
-
-// Validates whether a row is ready for insertion.
-ValueDict* HeapTable::validate(const ValueDict* row) const {
-	ValueDict* result = new ValueDict();
-    Value value;
-    ValueDict::const_iterator rowInfo;
-    for (ColumnNames::const_iterator i = column_names.begin(); i != column_names.end(); i++) {
-        rowInfo = row->find(*i);
-        if(rowInfo==row->end()){
-            throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
-        } else {
-            value = rowInfo->second;
-        }
-        (*result) [*i] = value;
-    }
-
-    return result;
-}
-
-// Appends a record to file.
-// Assumes that row is valid.
-Handle HeapTable::append(const ValueDict* row){
-    Dbt* newData = marshal(row); 
-    SlottedPage* block = this->file.get(this->file.get_last_block_id());
-    RecordID recordID;
-    Handle result;
-    try {
-        recordID = block->add(newData);
-    } catch(DbException& e) {
-        block = this->file.get_new();
-        recordID = block->add(newData);
-    }
-    this->file.put(block);
-    delete[] (char*)newData->get_data();
-    delete block;
-    result.first = file.get_last_block_id();
-    result.second = recordID;
-    return result;
-}
-
-
-// Return the bits to go into the file
-// Caller responsible for freeing the returned Dbt and its enclosed ret->get_data().
-// Provided by professor Lundeen
-Dbt* HeapTable::marshal(const ValueDict* row) const {
-    char *bytes = new char[DbBlock::BLOCK_SZ]; // More than we need (we insist that one row fits into DbBlock::BLOCK_SZ)
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const& column_name: this->column_names) {
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        ValueDict::const_iterator column = row->find(column_name);
-        Value value = column->second;
-        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-			if (offset + 4 > DbBlock::BLOCK_SZ - 4)
-				throw DbRelationError("row too big to marshal");            
-            *(int32_t*) (bytes + offset) = value.n;
-            offset += sizeof(int32_t);
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-            u_long size = value.s.length();
-            if (size > UINT16_MAX)
-				throw DbRelationError("text field too long to marshal");
-			if (offset + 2 + size > DbBlock::BLOCK_SZ)
-				throw DbRelationError("row too big to marshal");
-            *(u16*) (bytes + offset) = size;
-            offset += sizeof(u16);
-            memcpy(bytes+offset, value.s.c_str(), size); // Assume ascii for now
-            offset += size;
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
-            if (offset + 1 > DbBlock::BLOCK_SZ - 1)
-                throw DbRelationError("row too big to marshal");
-            *(uint8_t*) (bytes + offset) = (uint8_t)value.n;
-            offset += sizeof(uint8_t);    
-        } else {
-            throw DbRelationError("Only know how to marshal INT, TEXT, and BOOLEAN");
-        }
-    }
-    char *right_size_bytes = new char[offset];
-    memcpy(right_size_bytes, bytes, offset);
-    delete[] bytes;
-    Dbt *data = new Dbt(right_size_bytes, offset);
-    return data;
-}
-
-// Converts marshaled object back to original object type
-// Update from Milestone3_prep
-ValueDict* HeapTable::unmarshal(Dbt* data) const {
-    ValueDict *row = new ValueDict();
-    Value value;
-    char *bytes = (char*)data->get_data();
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const& column_name: this->column_names) {
-    	ColumnAttribute ca = this->column_attributes[col_num++];
-		value.data_type = ca.get_data_type();
-    	if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-    		value.n = *(int32_t*)(bytes + offset);
-    		offset += sizeof(int32_t);
-    	} else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-    		u16 size = *(u16*)(bytes + offset);
-    		offset += sizeof(u16);
-    		char buffer[DbBlock::BLOCK_SZ];
-    		memcpy(buffer, bytes+offset, size);
-    		buffer[size] = '\0';
-    		value.s = string(buffer);  // assume ascii for now
-            offset += size;
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
-            value.n = *(uint8_t*)(bytes + offset);
-            offset += sizeof(uint8_t);    
-    	} else {
-            throw DbRelationError("Only know how to unmarshal INT and TEXT");
-    	}
-		(*row)[column_name] = value;
-    }
-    return row;
-    /*
-    u16 textSize, count = 0, offset = 0, size = data->get_size();
-    char block[size];
-    memcpy(block, data->get_data(), size);
-    ValueDict* result = new ValueDict();
-    Value value;
-    for(ColumnNames::iterator i = column_names.begin(); i != column_names.end(); i++, count++) {
-        if(column_attributes[count].get_data_type() == ColumnAttribute::INT) {
-            value.data_type = ColumnAttribute::INT;           
-            value.n = *(u16*) (block + offset);
-            offset += sizeof(value.n);
-        } 
-        else if(column_attributes[count].get_data_type() == ColumnAttribute::TEXT) {
-            textSize = *(u16*)(block + offset);       
-            offset += sizeof(textSize);
-            value.data_type = ColumnAttribute::TEXT;
-            char temp [textSize];
-            memcpy(temp, (block + offset), textSize);
-            value.s = temp;
-            offset += textSize;
-        } 
-        else {
-            throw DbRelationError("Only unmarshals INT and TEXT");
-        }
-        (*result)[*i] = value;
-    }
-    return result;
-    */
-}
-
-// See if the row at the given handle satisfies the given where clause
-//Provided by Professor Lundeen
-bool HeapTable::selected(Handle handle, const ValueDict* where) {
-	if (where == nullptr)
-		return true;
-	ValueDict* row = this->project(handle, where);
-	return *row == *where;
-}
-
-// test functions below::
-void test_set_row(ValueDict &row, int a, string b) {
-    row["a"] = Value(a);
-    row["b"] = Value(b);
-    row["c"] = Value(a%2 == 0);  // true for even, false for odd
-}
-
-bool test_compare(DbRelation &table, Handle handle, int a, string b) {
-    ValueDict *result = table.project(handle);
-    Value value = (*result)["a"];
-    if (value.n != a) {
-        delete result;
-        return false;
-    }
-    value = (*result)["b"];
-    delete result;
-    if (value.s != b)
-        return false;
-    value = (*result)["c"];
-    if (value.n != (a%2 == 0))
-        return false;
-    return true;
-}
-// TEST FOR HEAP STORAGE
-bool test_heap_storage(){
-
-	ColumnNames column_names;
-
-	column_names.push_back("a");
-	column_names.push_back("b");
-
-	ColumnAttributes column_attributes;
-	ColumnAttribute ca(ColumnAttribute::INT);
-
-	column_attributes.push_back(ca);
-	ca.set_data_type(ColumnAttribute::TEXT);
-	column_attributes.push_back(ca);
-	
-	HeapTable table1("_test_create_drop_cpp", column_names, column_attributes);
-	
-	table1.create();
-	cout << "create ok" << endl;
-	
-	table1.drop();  // drop makes the object unusable because of BerkeleyDB restriction -- maybe want to fix this some day
-	cout << "drop ok" << endl;
-	
-	HeapTable table("_test_data_cpp", column_names, column_attributes);
-	
-	table.create_if_not_exists();
-	cout << "create_if_not_exists ok" << endl;
-	
-	ValueDict row;
-	row["a"] = Value(12);
-	row["b"] = Value("Hello!");
-
-	table.insert(&row);
-	cout << "insert ok" << endl;
-	
-	Handles* handles = table.select();
-	cout << "select ok " << handles->size() << endl;
-	
-	ValueDict *result = table.project((*handles)[0]);
-	cout << "project ok" << endl;
-	
-	Value value = (*result)["a"];
-	
-	if (value.n != 12){
-		return false;
-    }
-
-	value = (*result)["b"];
-
-	if (value.s != "Hello!"){
-		return false;
-    }
-
-	table.drop();
-
-	return true;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include "db_cxx.h"
+#include "heap_storage.h"
+#include "storage_engine.h"
+using namespace std;
+
+typedef uint16_t u16;
+
+/* * * * * * * * * * * 
+ * SlotPage Functions
+ * * * * * * * * * * */
+//Constructor for slotted page
+//Provided by Professor Lundeen
+SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new)
+        : DbBlock(block, block_id, is_new), num_records(0), end_free(0), fragmented(0), free_slot(1), live(0) {
+    if (is_new) {
+        this->num_records = 0;
+        this->end_free = (u16)(get_size() - 1);
+        put_header();
+    } else {
+        get_header(this->num_records, this->end_free);
+        count_free();
+    }
+}
+
+// Add a new record to the block, in the first deleted record's slot if there is one. Return its id.
+// Provided by Professor Lundeen
+RecordID SlottedPage::add(const Dbt* data) throw(DbBlockNoRoomError) {
+    u16 size = (u16) data->get_size();
+    while (this->free_slot <= this->num_records && get_n((u16)(4*this->free_slot + 2)) != 0)
+        this->free_slot++;
+    bool reuse = this->free_slot <= this->num_records;
+    // reusing a slot doesn't need room for another header
+    if (reuse ? !has_room((u16)(size >= 4 ? size - 4 : 0)) : !has_room(size))
+        throw DbBlockNoRoomError("not enough room for new record");
+    u16 loc = allocate(size);
+    u16 id = reuse ? this->free_slot++ : ++this->num_records;
+    if (!reuse)
+        this->free_slot = this->num_records + 1U;
+    this->live++;
+    put_header();
+    put_n((u16)(4*id), 0);  // unmarked
+    put_header(id, size, loc);
+    memcpy(this->address(loc), data->get_data(), size);
+    return id;
+}
+
+// Get record from a block. If no block exists or was deleted, return None
+Dbt* SlottedPage::get(RecordID record_id) const{
+
+	if (record_id == 0 || record_id > this->num_records)
+		return nullptr;  // deleted, along with the slots after it
+	u16 size, loc;
+	get_header(size, loc, record_id);
+
+	if(loc == 0){
+		return nullptr;
+	}
+	
+	return new Dbt(this->address(loc),size);
+}
+
+// Point data at a record where it sits in the block, without allocating anything.
+bool SlottedPage::get(RecordID record_id, Dbt &data) const {
+	if (record_id == 0 || record_id > this->num_records)
+		return false;
+	u16 size, loc;
+	get_header(size, loc, record_id);
+	if (loc == 0)
+		return false;
+	data.set_data(this->address(loc));
+	data.set_size(size);
+	return true;
+}
+
+// Replace a record with specified data.
+// Return DbBlockNoRoomError if there is not enough space.
+// A record that grows moves to the free space, leaving its old bytes as a gap; one that shrinks
+// keeps the end of its old bytes.
+void SlottedPage::put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError){
+    u16 size, loc;
+    get_header(size, loc, record_id);
+    u16 new_size = (u16)data.get_size();
+
+    if (new_size > size) {
+        if (!has_room(new_size - size))
+            throw DbBlockNoRoomError("not enough room for enlarged record (SlottedPage::put)");
+        // let go of the old bytes first, so compacting (if it comes to that) can use them
+        put_header(record_id, 0, 0);
+        release(loc, size);
+        loc = allocate(new_size);
+        memcpy(this->address(loc), data.get_data(), new_size);
+    } else {
+        memmove(this->address((u16)(loc + size - new_size)), data.get_data(), new_size);
+        release(loc, size - new_size);
+        loc += size - new_size;
+    }
+    put_header(record_id, new_size, loc);
+}
+
+// Mark record as deleted by setting size and location to 0, so add() can hand out its id again. Its
+// bytes are left where they are. If it's the last record, its slot goes back to the free space,
+// and so do those of the deleted records before it.
+void SlottedPage::del(RecordID record_id){
+    if (record_id == 0 || record_id > this->num_records)
+        return;  // already gone
+    erase(record_id);
+    this->free_slot = min(this->free_slot, (u16)record_id);
+    if (record_id != this->num_records)
+        return;
+    while (this->num_records > 0 && get_n((u16)(4*this->num_records + 2)) == 0)
+        this->num_records--;
+    this->free_slot = min(this->free_slot, (u16)(this->num_records + 1));
+    put_header();
+}
+
+// Add a record as record_id, moving the headers of record_id and everything after it up by one,
+// so records can be kept in order by id.
+void SlottedPage::insert_at(RecordID record_id, const Dbt* data) throw(DbBlockNoRoomError) {
+    u16 size = (u16) data->get_size();
+    if (!has_room(size))
+        throw DbBlockNoRoomError("not enough room for new record");
+    u16 loc = allocate(size);
+    memmove(this->address((u16)(4*(record_id + 1))), this->address((u16)(4*record_id)),
+            4*(this->num_records + 1 - record_id));
+    this->num_records++;
+    this->live++;
+    put_header();
+    put_n((u16)(4*record_id), 0);  // unmarked
+    put_header(record_id, size, loc);
+    memcpy(this->address(loc), data->get_data(), size);
+}
+
+// Delete a record and close up its header, moving everything after it down by one.
+void SlottedPage::remove_at(RecordID record_id) {
+    erase(record_id);
+    memmove(this->address((u16)(4*record_id)), this->address((u16)(4*(record_id + 1))),
+            4*(this->num_records - record_id));
+    this->num_records--;
+    if (this->free_slot > record_id)
+        this->free_slot--;
+    put_header();
+}
+
+// Gets all non-deleted record IDs
+RecordIDs* SlottedPage::ids(void) const {
+    RecordIDs* records = new RecordIDs;
+    records->reserve(this->live);
+    for (auto const& record: *this)
+        records->push_back(record.id);
+    return records;
+}
+
+// Erase all the records
+void SlottedPage::clear() {
+    this->num_records = 0;
+    this->end_free = (u16)(get_size() - 1);
+    this->fragmented = 0;
+    this->free_slot = 1;
+    this->live = 0;
+    put_header();
+}
+
+// Room between the headers and the records, less the header a new record would need, plus the gaps
+// among the records
+u16 SlottedPage::get_free_space() const {
+    int available = (int)this->end_free - 4*(this->num_records + 1) + this->fragmented;
+    return (u16)(available < 0 ? 0 : available);
+}
+
+// Whether the record has been marked.
+bool SlottedPage::is_marked(RecordID record_id) const {
+    return (get_n((u16)(4*record_id)) & MARK) != 0;
+}
+
+// Set or clear the record's mark.
+void SlottedPage::mark(RecordID record_id, bool marked) {
+    u16 word = get_n((u16)(4*record_id));
+    put_n((u16)(4*record_id), marked ? (u16)(word | MARK) : (u16)(word & ~MARK));
+}
+
+// Gets the size and offset for a record.
+// If record id is 0, it is the block header.
+void SlottedPage::get_header(u16 &size, u16 &loc, RecordID id) const {
+    size = get_n((u16)4*id);
+    if (id != 0)
+        size &= ~MARK;
+    loc = get_n((u16)(4*id + 2));
+}
+
+
+// Store the size and offset for given id. For id of zero, store the block header.
+// A record keeps its mark.
+// Provided by professor Lundeen
+void SlottedPage::put_header(RecordID id, u16 size, u16 loc) {
+    if (id == 0) { 
+        size = this->num_records;
+        loc = this->end_free;
+    } else {
+        size |= get_n((u16)(4*id)) & MARK;
+    }
+    put_n((u16)(4*id), size);
+    put_n((u16)(4*id + 2), loc);
+}
+
+// Determines whether there is room for record (once the block is compacted, if need be).
+bool SlottedPage::has_room(u16 size) const {
+    // signed, since the headers can already have grown right up to the free space
+    int available = (int)this->end_free - 4*(this->num_records + 2) + this->fragmented;
+    return (int)size <= available;
+}
+
+// Take size bytes off the end of the free space for a record, compacting the block first if they
+// are only there counting the gaps. Assumes has_room(size).
+u16 SlottedPage::allocate(u16 size) {
+    if ((int)size > (int)this->end_free - 4*(this->num_records + 2))
+        compact();
+    this->end_free -= size;
+    put_header();
+    return this->end_free + 1U;
+}
+
+// Give back size bytes at loc that no record uses any more: right to the free space if they're
+// next to it, otherwise as a gap for compact() to close up later.
+void SlottedPage::release(u16 loc, u16 size) {
+    if (size == 0)
+        return;
+    if (loc == this->end_free + 1U) {
+        this->end_free += size;
+        put_header();
+    } else {
+        this->fragmented += size;
+    }
+}
+
+// Close up all the gaps in one pass, moving the records (in place, the ones nearest the end of the
+// block first) up against the end of the block. Nothing is allocated.
+void SlottedPage::compact() {
+    u16 ids[DbBlock::MAX_BLOCK_SZ / 4];  // live records, by where they are, from the end of the block down
+    u16 n = 0;
+    for (RecordID record_id = 1; record_id <= this->num_records; record_id++) {
+        u16 loc = get_n((u16)(4*record_id + 2));
+        if (loc == 0)
+            continue;
+        u16 i = n++;
+        for (; i > 0 && get_n((u16)(4*ids[i - 1] + 2)) < loc; i--)
+            ids[i] = ids[i - 1];
+        ids[i] = (u16)record_id;
+    }
+    u16 end = (u16)get_size();
+    for (u16 i = 0; i < n; i++) {
+        u16 size, loc;
+        get_header(size, loc, ids[i]);
+        end -= size;
+        if (loc != end)
+            memmove(this->address(end), this->address(loc), size);
+        put_header(ids[i], size, end);
+    }
+    this->end_free = end - 1U;
+    this->fragmented = 0;
+    put_header();
+}
+
+// Tombstone a record and give back its bytes.
+void SlottedPage::erase(RecordID record_id) {
+    u16 size, loc;
+    get_header(size, loc, record_id);
+    put_n((u16)(4*record_id), 0);  // unmarked
+    put_header(record_id, 0, 0);
+    release(loc, size);
+    if (loc != 0)
+        this->live--;
+}
+
+// Work out, from the headers, the bytes between the free space and the end of the block that no
+// record is using, the first deleted record's slot, and how many records are live.
+void SlottedPage::count_free() {
+    int used = 0;
+    this->free_slot = 0;
+    this->live = 0;
+    for (RecordID record_id = 1; record_id <= this->num_records && 4U*record_id + 4 <= get_size();
+         record_id++) {
+        u16 size, loc;
+        get_header(size, loc, record_id);
+        if (loc != 0) {
+            used += size;
+            this->live++;
+        } else if (this->free_slot == 0)
+            this->free_slot = (u16)record_id;
+    }
+    if (this->free_slot == 0)
+        this->free_slot = this->num_records + 1U;
+    int fragmented = (int)get_size() - 1 - this->end_free - used;
+    this->fragmented = (u16)(fragmented < 0 ? 0 : fragmented);
+}
+
+
+// Skip over deleted records to the next live one (or to the end) and point at it. This is every
+// scan's inner loop, so it reads the headers straight out of the block.
+void SlottedPage::Iterator::settle() {
+    const char *bytes = (const char*)this->page.block.get_data();
+    for (; this->record.id <= this->page.num_records; this->record.id++) {
+        const u16 *header = (const u16*)(bytes + 4*this->record.id);
+        if (header[1] != 0) {
+            this->record.data = bytes + header[1];
+            this->record.size = header[0] & (u16)~MARK;
+            return;
+        }
+    }
+}
+
+// Get 2-byte integer at given offset in block.
+//Provided by Professor Lundeen
+u16 SlottedPage::get_n(u16 offset) const {
+    return *(u16*)this->address(offset);
+}
+
+
+// Put a 2-byte integer at given offset in block.
+// Provided by professor Lundeen
+void SlottedPage::put_n(u16 offset, u16 n) {
+    *(u16*)this->address(offset) = n;
+}
+
+
+// Make a void* pointer for a given offset into the data block.
+// Provided by professor Lundeen
+void* SlottedPage::address(u16 offset) const {
+    return (void*)((char*)this->block.get_data() + offset);
+}
+
+
+/* * * * * * * * * * * *
+ * PageCodec Functions
+ * * * * * * * * * * * */
+static const uint HASH_BITS = 12;  // of the table of where each four bytes were last seen
+
+// Where to look for an earlier copy of the four bytes at p.
+static inline uint32_t lz_hash(const char *p) {
+    uint32_t bytes;
+    memcpy(&bytes, p, sizeof(bytes));
+    return (bytes * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// A count of 15 or more goes on in bytes of up to 255 after the token.
+static inline char *lz_put_count(char *out, uint count) {
+    for (count -= 15; count >= 255; count -= 255)
+        *out++ = (char)255;
+    *out++ = (char)count;
+    return out;
+}
+
+// Pack block into packed (which has room for bound(block_size)), LZ if that makes it smaller.
+uint PageCodec::encode(const char *block, uint block_size, char *packed) {
+    *(uint16_t*)(packed + 1) = (uint16_t)block_size;
+    uint size = compress(block, block_size, packed + HEADER_SIZE, block_size - 1);
+    if (size != 0) {
+        packed[0] = (char)LZ;
+        return HEADER_SIZE + size;
+    }
+    packed[0] = (char)STORED;
+    memcpy(packed + HEADER_SIZE, block, block_size);
+    return HEADER_SIZE + block_size;
+}
+
+// The sequences for block, or 0 if they'd take more than limit bytes. The match finder just
+// remembers the last place each hash of four bytes was seen.
+uint PageCodec::compress(const char *block, uint block_size, char *out, uint limit) {
+    uint16_t seen[1 << HASH_BITS];  // position + 1, or 0
+    memset(seen, 0, sizeof(seen));
+    char *start = out, *end = out + limit;
+    uint anchor = 0;  // first literal not yet written out
+    uint pos = 0;
+    while (pos + MIN_MATCH <= block_size) {
+        uint32_t hash = lz_hash(block + pos);
+        uint candidate = seen[hash];
+        seen[hash] = (uint16_t)(pos + 1);
+        if (candidate == 0 || memcmp(block + candidate - 1, block + pos, MIN_MATCH) != 0) {
+            pos++;
+            continue;
+        }
+        uint match = candidate - 1;
+        uint length = MIN_MATCH;
+        while (pos + length < block_size && block[match + length] == block[pos + length])
+            length++;
+        uint literals = pos - anchor;
+        // token, counts (at most a byte per 255, plus one), literals, offset
+        if ((u_long)(end - out) < 1 + literals / 255 + 1 + literals + 2 + (length - MIN_MATCH) / 255 + 1)
+            return 0;
+        char *token = out++;
+        *token = (char)((std::min(literals, 15U) << 4) | std::min(length - MIN_MATCH, 15U));
+        if (literals >= 15)
+            out = lz_put_count(out, literals);
+        memcpy(out, block + anchor, literals);
+        out += literals;
+        *(uint16_t*)out = (uint16_t)(pos - match);
+        out += sizeof(uint16_t);
+        if (length - MIN_MATCH >= 15)
+            out = lz_put_count(out, length - MIN_MATCH);
+        pos += length;
+        anchor = pos;
+    }
+    uint literals = block_size - anchor;
+    if (literals > 0) {
+        if ((u_long)(end - out) < 1 + literals / 255 + 1 + literals)
+            return 0;
+        *out++ = (char)(std::min(literals, 15U) << 4);
+        if (literals >= 15)
+            out = lz_put_count(out, literals);
+        memcpy(out, block + anchor, literals);
+        out += literals;
+    }
+    return (uint)(out - start);
+}
+
+// Unpack a block, checking every count and offset against the bytes there really are.
+void PageCodec::decode(const char *packed, uint packed_size, char *block, uint block_size) {
+    if (packed_size < HEADER_SIZE || get_block_size(packed) != block_size)
+        throw DbRelationError("packed block has the wrong size");
+    const uint8_t *in = (const uint8_t*)packed + HEADER_SIZE, *in_end = (const uint8_t*)packed + packed_size;
+    if (packed[0] == (char)STORED) {
+        if ((uint)(in_end - in) != block_size)
+            throw DbRelationError("stored block has the wrong size");
+        memcpy(block, in, block_size);
+        return;
+    }
+    if (packed[0] != (char)LZ)
+        throw DbRelationError("unknown block packing " + to_string((int)packed[0]));
+    char *out = block, *out_end = block + block_size;
+    while (in < in_end) {
+        uint token = *in++;
+        u_long literals = token >> 4;
+        if (literals == 15)
+            for (uint8_t more = 255; more == 255 && in < in_end; literals += more)
+                more = *in++;
+        if ((u_long)(in_end - in) < literals || (u_long)(out_end - out) < literals)
+            throw DbRelationError("packed block is corrupt");
+        memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+        if (in == in_end)
+            break;  // the last sequence has no match
+        if (in_end - in < 2)
+            throw DbRelationError("packed block is corrupt");
+        uint offset = *(const uint16_t*)in;
+        in += sizeof(uint16_t);
+        u_long length = token & 15;
+        if (length == 15)
+            for (uint8_t more = 255; more == 255 && in < in_end; length += more)
+                more = *in++;
+        length += MIN_MATCH;
+        if (offset == 0 || offset > (u_long)(out - block) || (u_long)(out_end - out) < length)
+            throw DbRelationError("packed block is corrupt");
+        // what's already there from the match on repeats every offset bytes, so it can be copied whole,
+        // over and over, even when the match overlaps what it's writing
+        for (const char *from = out - offset; length > 0; ) {
+            u_long step = std::min((u_long)(out - from), length);
+            memcpy(out, from, step);
+            out += step;
+            length -= step;
+        }
+    }
+    if (out != out_end)
+        throw DbRelationError("packed block is corrupt");
+}
+
+
+/* * * * * * * * * * * *
+ * BufferPool Functions
+ * * * * * * * * * * * */
+uint BufferPool::capacity = 64;
+
+BufferPool::BufferPool(uint capacity, uint block_size, bool compressed)
+        : users(0), block_size(block_size), compressed(compressed), packed(compressed ? PageCodec::bound(block_size) : 0),
+          frames(capacity), resident(), hand(0), stats() {
+    for (auto& frame: this->frames) {
+        frame.block_id = 0;
+        frame.page = nullptr;
+        frame.data = new char[block_size];
+        frame.pin_count = 0;
+        frame.dirty = false;
+        frame.referenced = false;
+    }
+}
+
+BufferPool::~BufferPool() {
+    for (auto& frame: this->frames) {
+        delete frame.page;
+        delete[] frame.data;
+    }
+}
+
+// Pin a block, reading it in only if it isn't already resident.
+SlottedPage* BufferPool::pin(Db &db, BlockID block_id) {
+    auto it = this->resident.find(block_id);
+    if (it != this->resident.end()) {
+        Frame &frame = this->frames[it->second];
+        frame.pin_count++;
+        frame.referenced = true;
+        this->stats.hits++;
+        return frame.page;
+    }
+    this->stats.misses++;
+    uint i = victim();
+    Frame &frame = this->frames[i];
+    Dbt key(&block_id, sizeof(block_id));
+    Dbt data;
+    db.get(nullptr, &key, &data, 0);
+    if (this->compressed)
+        PageCodec::decode((const char*)data.get_data(), data.get_size(), frame.data, this->block_size);
+    else
+        memcpy(frame.data, data.get_data(), this->block_size);
+    Dbt block(frame.data, this->block_size);
+    frame.block_id = block_id;
+    frame.page = new SlottedPage(block, block_id, false);
+    frame.pin_count = 1;
+    frame.referenced = true;
+    this->resident[block_id] = i;
+    return frame.page;
+}
+
+// Pin a newly allocated block, formatting it and writing it out so the file grows.
+SlottedPage* BufferPool::pin_new(Db &db, BlockID block_id) {
+    auto it = this->resident.find(block_id);
+    if (it != this->resident.end()) {
+        // someone else's stale copy of this block id, so just reformat it
+        Frame &frame = this->frames[it->second];
+        frame.page->clear();
+        frame.pin_count++;
+        frame.referenced = true;
+        write(db, frame);
+        return frame.page;
+    }
+    uint i = victim();
+    Frame &frame = this->frames[i];
+    memset(frame.data, 0, this->block_size);
+    Dbt block(frame.data, this->block_size);
+    frame.block_id = block_id;
+    frame.page = new SlottedPage(block, block_id, true);
+    frame.pin_count = 1;
+    frame.referenced = true;
+    this->resident[block_id] = i;
+    write(db, frame);
+    return frame.page;
+}
+
+// Remember to write this block back once it is unpinned.
+bool BufferPool::mark_dirty(DbBlock* block) {
+    auto it = this->resident.find(block->get_block_id());
+    if (it == this->resident.end() || this->frames[it->second].page != block)
+        return false;
+    this->frames[it->second].dirty = true;
+    return true;
+}
+
+// Drop a pin; the last pin on a dirty block writes it back.
+void BufferPool::unpin(Db &db, DbBlock* block) {
+    auto it = this->resident.find(block->get_block_id());
+    if (it == this->resident.end() || this->frames[it->second].page != block)
+        return;
+    Frame &frame = this->frames[it->second];
+    if (frame.pin_count > 0 && --frame.pin_count == 0 && frame.dirty)
+        write(db, frame);
+}
+
+// Write back all dirty frames, pinned or not.
+void BufferPool::flush(Db &db) {
+    for (auto& frame: this->frames)
+        if (frame.dirty)
+            write(db, frame);
+}
+
+// Pick a frame to reuse with the clock algorithm, emptying it out.
+uint BufferPool::victim() {
+    uint n = (uint)this->frames.size();
+    for (uint tries = 0; tries < 2 * n; tries++) {
+        uint i = this->hand;
+        this->hand = (this->hand + 1) % n;
+        Frame &frame = this->frames[i];
+        if (frame.pin_count > 0)
+            continue;
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+        if (frame.block_id != 0) {
+            this->resident.erase(frame.block_id);
+            this->stats.evictions++;
+        }
+        delete frame.page;
+        frame.page = nullptr;
+        frame.block_id = 0;
+        frame.dirty = false;
+        return i;
+    }
+    throw DbRelationError("buffer pool exhausted: all " + to_string(n) + " frames are pinned");
+}
+
+// Write a frame's block to the file.
+void BufferPool::write(Db &db, Frame &frame) {
+    BlockID block_id = frame.block_id;
+    Dbt key(&block_id, sizeof(block_id));
+    if (this->compressed) {
+        uint size = PageCodec::encode(frame.data, this->block_size, this->packed.data());
+        Dbt data(this->packed.data(), size);
+        db.put(nullptr, &key, &data, 0);
+    } else {
+        db.put(nullptr, &key, frame.page->get_block(), 0);
+    }
+    frame.dirty = false;
+}
+
+
+/* * * * * * * * * * *
+ * HeapFile Functions
+ * * * * * * * * * * */
+std::map<std::string, BufferPool*> HeapFile::pools;
+
+// Constructor
+HeapFile::HeapFile(string name)
+        : DbFile(name), dbfilename(""), last(0), closed(true), block_size(DbBlock::BLOCK_SZ), compressed(false),
+          db(_DB_ENV, 0), pool(nullptr) {
+	this->dbfilename = this->name + ".db";
+}
+// Create file
+void HeapFile::create(void) {
+	db_open(DB_CREATE | DB_EXCL);
+    SlottedPage *page = get_new(); // force one page to exist
+    unpin(page);
+}
+
+// Delete file
+void HeapFile::drop(void) {
+    close();
+	Db db(_DB_ENV,0);
+	db.remove(dbfilename.c_str(),nullptr,0);
+}
+
+// Open file
+void HeapFile::open(void) {
+	db_open();
+}
+
+// Close file, letting go of the buffer pool if we're its last user
+void HeapFile::close(void) {
+    if (this->closed)
+        return;
+    this->pool->flush(this->db);
+    if (--this->pool->users == 0) {
+        HeapFile::pools.erase(this->dbfilename);
+        delete this->pool;
+    }
+    this->pool = nullptr;
+	db.close(0);
+    closed = true;
+}
+
+// Allocate a new block for the database file.
+// Returns the new empty DbBlock that is managing the records in this block and its block id.
+SlottedPage* HeapFile::get_new(void) {
+    return this->pool->pin_new(this->db, ++this->last);
+}
+
+
+// Returns a specific slotted page (from the buffer pool if it's there)
+SlottedPage* HeapFile::get(BlockID block_id) {
+    return this->pool->pin(this->db, block_id);
+}
+
+
+// Marks a block as changed; it is written out once everyone has unpinned it
+void HeapFile::put(DbBlock* block){
+    if (this->pool != nullptr && this->pool->mark_dirty(block))
+        return;
+    int id = block->get_block_id();
+    Dbt key(&id, sizeof(id));
+    if (this->compressed) {
+        std::vector<char> packed(PageCodec::bound(this->block_size));
+        Dbt data(packed.data(), PageCodec::encode((const char*)block->get_data(), this->block_size, packed.data()));
+        this->db.put(nullptr, &key, &data, 0);
+        return;
+    }
+    this->db.put(nullptr,&key,block->get_block(),0);
+}
+
+// Releases a block from get() or get_new()
+void HeapFile::unpin(DbBlock* block) {
+    if (this->pool != nullptr)
+        this->pool->unpin(this->db, block);
+}
+
+// Block size for create(); an existing file keeps the one it was created with
+void HeapFile::set_block_size(uint block_size) {
+    if (block_size < DbBlock::BLOCK_SZ || block_size > DbBlock::MAX_BLOCK_SZ || (block_size & (block_size - 1)) != 0)
+        throw DbRelationError("block size must be a power of two from " + to_string(DbBlock::BLOCK_SZ)
+                              + " through " + to_string(DbBlock::MAX_BLOCK_SZ));
+    this->block_size = block_size;
+}
+
+// Total length of the file's records, with any blocks still in the buffer pool written out first.
+u_long HeapFile::get_stored_size() {
+    this->pool->flush(this->db);
+    u_long size = 0;
+    for (BlockID block_id = 1; block_id <= this->last; block_id++) {
+        Dbt key(&block_id, sizeof(block_id));
+        Dbt data;
+        this->db.get(nullptr, &key, &data, 0);
+        size += data.get_size();
+    }
+    return size;
+}
+
+// Counters for the shared buffer pool
+BufferPool::Stats HeapFile::get_buffer_stats() const {
+    return this->pool == nullptr ? BufferPool::Stats() : this->pool->get_stats();
+}
+
+
+// Returns list of Block IDs
+BlockIDs* HeapFile::block_ids() const {
+    BlockIDs* bid_list = new BlockIDs();
+    for(BlockID i = 1; i <= (this->last); i++){
+        bid_list -> push_back(i);
+    }
+    return bid_list;
+}
+uint32_t HeapFile::get_block_count() {
+    DB_BTREE_STAT* stat;
+    this->db.stat(nullptr, &stat, DB_FAST_STAT);
+    return stat->bt_ndata;
+}
+
+// Creates and opens DB
+void HeapFile::db_open(uint flags){
+//    DB_BTREE_STAT *stat;
+//    if(!closed){
+//    	return;
+//    }
+//    db.set_re_len(DbBlock::BLOCK_SZ);
+//    dbfilename = name + ".db";
+//    db.open(nullptr, dbfilename.c_str(), nullptr, DB_RECNO, flags, 0644);
+//
+//    if(flags == 0){
+//    	db.stat(nullptr, &stat, 0);
+//    	last = stat->bt_ndata;
+//    } else {
+//        this->last = 0;
+//    }
+//    delete stat;
+//    closed = false;
+    if (!this->closed)
+        return;
+    if ((flags & DB_CREATE) && !this->compressed)
+        this->db.set_re_len(this->block_size); // record length (a compressed file's records vary)
+    this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags, 0644);
+    u_int32_t re_len;
+    this->db.get_re_len(&re_len);  // the one it was created with
+    this->compressed = re_len == 0;
+    if (!this->compressed)
+        this->block_size = re_len;
+
+    this->last = flags ? 0 : get_block_count();
+    this->closed = false;
+    if (this->compressed && this->last > 0) {  // the first block's header has the size
+        BlockID block_id = 1;
+        Dbt key(&block_id, sizeof(block_id));
+        Dbt data;
+        this->db.get(nullptr, &key, &data, 0);
+        this->block_size = PageCodec::get_block_size((const char*)data.get_data());
+    }
+
+    auto it = HeapFile::pools.find(this->dbfilename);
+    if (it == HeapFile::pools.end())
+        it = HeapFile::pools.insert(std::make_pair(this->dbfilename, new BufferPool(BufferPool::capacity,
+                                                                                    this->block_size, this->compressed))).first;
+    this->pool = it->second;
+    this->pool->users++;
+}
+
+
+/* * * * * * * * * * * * *
+ * FreeSpaceMap Functions
+ * * * * * * * * * * * * */
+FreeSpaceMap::FreeSpaceMap(string name)
+        : file(name), table_file(nullptr), closed(true), made(false), mapped(0), recent(0),
+          bucket(DbBlock::BLOCK_SZ / 256) {}
+
+// A new table has no room to reuse, so its map isn't made yet.
+void FreeSpaceMap::create() {
+    this->closed = false;
+    this->made = false;
+    this->mapped = 0;
+    this->recent = 0;
+}
+
+// The map may never have been made.
+void FreeSpaceMap::drop() {
+    close();
+    try {
+        this->file.drop();
+    } catch (DbException &e) {
+    }
+}
+
+// Open the map's file, if there is one, and add any blocks of table_file it doesn't know about.
+void FreeSpaceMap::open(HeapFile &table_file) {
+    this->table_file = &table_file;
+    this->bucket = table_file.get_block_size() / 256;
+    if (this->closed) {
+        this->closed = false;
+        this->recent = 0;
+        try {
+            this->file.open();
+            this->made = true;
+            this->mapped = count_mapped();
+        } catch (DbException &e) {
+            this->made = false;
+        }
+    }
+    if (this->made)
+        catch_up();
+}
+
+void FreeSpaceMap::close() {
+    this->file.close();
+    this->closed = true;
+}
+
+// Note a block's free space. A block past the end of the map is added, along with any before it
+// (as having no room until they're set).
+void FreeSpaceMap::set(BlockID block_id, u16 free_space, bool durable) {
+    if (!this->made) {
+        if (durable)
+            make();  // room has been freed up, which the map picks up along with the rest
+        return;
+    }
+    uint8_t units = (uint8_t)std::min(free_space / this->bucket, (u_long)UINT8_MAX);
+    if (block_id > this->mapped) {
+        std::vector<uint8_t> more(block_id - this->mapped, 0);
+        more.back() = units;
+        extend(more);
+        return;
+    }
+    SlottedPage *block = this->file.get((BlockID)((block_id - 1) / PER_BLOCK + 1));
+    Dbt dbt;
+    block->get(1, dbt);
+    ((uint8_t*)dbt.get_data())[(block_id - 1) % PER_BLOCK] = units;  // in place, so the record doesn't move
+    if (durable)
+        this->file.put(block);
+    this->file.unpin(block);
+}
+
+// A block with room for a record of size (and its header): the one found last time if it still has
+// room, otherwise the first one.
+BlockID FreeSpaceMap::find(u16 size) {
+    if (!this->made) {
+        // nothing has been freed up, so only the last block can have room; this is just what add needs
+        BlockID last = this->table_file->get_last_block_id();
+        SlottedPage *block = this->table_file->get(last);
+        bool room = block->get_free_space() >= size + 4;
+        this->table_file->unpin(block);
+        return room ? last : 0;
+    }
+    u_long needed = (size + 4 + this->bucket - 1) / this->bucket;
+    if (needed > UINT8_MAX)
+        return 0;
+    if (this->recent != 0 && this->recent <= this->mapped && get_units(this->recent) >= needed)
+        return this->recent;
+    this->recent = 0;
+    for (BlockID map_block = 1; this->recent == 0 && map_block <= this->file.get_last_block_id(); map_block++) {
+        SlottedPage *block = this->file.get(map_block);
+        Dbt dbt;
+        if (block->get(1, dbt)) {
+            const uint8_t *units = (const uint8_t*)dbt.get_data();
+            for (u_long i = 0; this->recent == 0 && i < dbt.get_size(); i++)
+                if (units[i] >= needed)
+                    this->recent = (map_block - 1) * PER_BLOCK + 1 + (BlockID)i;
+        }
+        this->file.unpin(block);
+    }
+    return this->recent;
+}
+
+// Make the map, the first time a block of the table has room freed up in it (or open the one another
+// HeapTable on the same table has made since this one was opened), and fill it in.
+void FreeSpaceMap::make() {
+    try {
+        this->file.open();
+    } catch (DbException &e) {
+        this->file.create();
+    }
+    this->made = true;
+    this->mapped = count_mapped();
+    this->recent = 0;
+    catch_up();
+}
+
+// Table blocks the map's file covers.
+BlockID FreeSpaceMap::count_mapped() {
+    BlockID last = this->file.get_last_block_id();
+    SlottedPage *block = this->file.get(last);
+    Dbt dbt;
+    BlockID mapped = (last - 1) * PER_BLOCK + (block->get(1, dbt) ? dbt.get_size() : 0);
+    this->file.unpin(block);
+    return mapped;
+}
+
+// Add entries for any blocks of the table's file the map doesn't cover yet.
+void FreeSpaceMap::catch_up() {
+    std::vector<uint8_t> units;
+    for (BlockID block_id = this->mapped + 1; block_id <= this->table_file->get_last_block_id(); block_id++) {
+        SlottedPage *block = this->table_file->get(block_id);
+        units.push_back((uint8_t)std::min(block->get_free_space() / this->bucket, (u_long)UINT8_MAX));
+        this->table_file->unpin(block);
+    }
+    if (!units.empty())
+        extend(units);
+}
+
+// A block's free space, in buckets, as the map has it.
+uint8_t FreeSpaceMap::get_units(BlockID block_id) {
+    SlottedPage *block = this->file.get((BlockID)((block_id - 1) / PER_BLOCK + 1));
+    Dbt dbt;
+    block->get(1, dbt);
+    uint8_t units = ((const uint8_t*)dbt.get_data())[(block_id - 1) % PER_BLOCK];
+    this->file.unpin(block);
+    return units;
+}
+
+// Add entries for blocks mapped + 1 on, filling up the last map block's record and then starting
+// new map blocks.
+void FreeSpaceMap::extend(const std::vector<uint8_t> &units) {
+    size_t i = 0;
+    while (i < units.size()) {
+        BlockID map_block = (BlockID)(this->mapped / PER_BLOCK + 1);
+        SlottedPage *block = map_block > this->file.get_last_block_id() ? this->file.get_new()
+                                                                        : this->file.get(map_block);
+        size_t n = std::min(PER_BLOCK - this->mapped % PER_BLOCK, units.size() - i);
+        Dbt old;
+        std::string record;
+        bool found = block->get(1, old);
+        if (found)
+            record.assign((const char*)old.get_data(), old.get_size());
+        record.append((const char*)&units[i], n);
+        Dbt dbt((void*)record.data(), (u_int32_t)record.size());
+        if (found)
+            block->put(1, dbt);
+        else
+            block->add(&dbt);
+        this->file.put(block);
+        this->file.unpin(block);
+        this->mapped += (BlockID)n;
+        i += n;
+    }
+}
+
+
+/* * * * * * * * * * * * *
+ * TextOverflow Functions
+ * * * * * * * * * * * * */
+static const u16 LINK_SIZE = sizeof(BlockID) + sizeof(RecordID);  // ahead of each chunk
+
+// The handle a pointer or a chunk starts with.
+static Handle get_link(const char *bytes) {
+    return Handle(*(const BlockID*)bytes, *(const RecordID*)(bytes + sizeof(BlockID)));
+}
+
+TextOverflow::TextOverflow(string name)
+        : file(name + ".toast"), free_space(name + ".toast.fsm"), table_file(nullptr), closed(true), made(false) {}
+
+// Most tables never have a value long enough for the overflow, so the file waits for the first one.
+void TextOverflow::create() {
+    this->free_space.create();
+    this->closed = false;
+    this->made = false;
+}
+
+// The overflow may never have been made.
+void TextOverflow::drop() {
+    close();
+    try {
+        this->file.drop();
+    } catch (DbException &e) {
+    }
+    this->free_space.drop();
+}
+
+void TextOverflow::open(HeapFile &table_file) {
+    this->table_file = &table_file;
+    if (!this->closed)
+        return;
+    this->closed = false;
+    this->made = false;
+    try {
+        this->file.open();
+    } catch (DbException &e) {
+        return;
+    }
+    this->made = true;
+    this->free_space.open(this->file);
+}
+
+void TextOverflow::close() {
+    this->file.close();
+    this->free_space.close();
+    this->closed = true;
+    this->made = false;
+}
+
+// Open the file, making it, with blocks like the table's, for the first value to go in. Another
+// HeapTable on the same table may have made it since this one was opened.
+void TextOverflow::make() {
+    try {
+        this->file.open();
+    } catch (DbException &e) {
+        this->file.set_block_size(this->table_file->get_block_size());
+        this->file.set_compressed(this->table_file->is_compressed());
+        this->file.create();
+    }
+    this->closed = false;
+    this->made = true;
+    this->free_space.open(this->file);
+}
+
+// Write a value out as a chain of chunks, the last one first so that each can point to the next.
+void TextOverflow::put(const char *data, u16 size, char *pointer) {
+    if (!this->made)
+        make();
+    // the most the free-space map will find an emptied block for, so the room deletes free up is used again
+    u_long chunk = this->file.get_block_size() / 256 * UINT8_MAX - 4 - LINK_SIZE;
+    Handle next(0, 0);
+    for (u_long start = (size - 1) / chunk * chunk; ; start -= chunk) {
+        next = add(data + start, (u16)std::min(chunk, size - start), next);
+        if (start == 0)
+            break;
+    }
+    *(BlockID*)pointer = next.first;
+    *(RecordID*)(pointer + sizeof(BlockID)) = next.second;
+    *(u16*)(pointer + LINK_SIZE) = size;
+}
+
+// Put a value back together from its chunks.
+void TextOverflow::get(const char *pointer, std::string &text) {
+    if (!this->made)
+        make();
+    text.clear();
+    text.reserve(get_size(pointer));
+    for (Handle next = get_link(pointer); next.first != 0; ) {
+        SlottedPage *block = this->file.get(next.first);
+        Dbt chunk;
+        if (!block->get(next.second, chunk)) {
+            this->file.unpin(block);
+            throw DbRelationError("missing overflow chunk");
+        }
+        const char *bytes = (const char*)chunk.get_data();
+        text.append(bytes + LINK_SIZE, chunk.get_size() - LINK_SIZE);
+        next = get_link(bytes);
+        this->file.unpin(block);
+    }
+    if (text.size() != get_size(pointer))
+        throw DbRelationError("overflow value is the wrong size");
+}
+
+// Free up the chunks of a value.
+void TextOverflow::del(const char *pointer) {
+    if (!this->made)
+        make();
+    for (Handle next = get_link(pointer); next.first != 0; ) {
+        Handle handle = next;
+        SlottedPage *block = this->file.get(handle.first);
+        Dbt chunk;
+        next = Handle(0, 0);
+        if (block->get(handle.second, chunk)) {
+            next = get_link((const char*)chunk.get_data());
+            block->del(handle.second);
+            this->file.put(block);
+            this->free_space.set(handle.first, block->get_free_space());
+        }
+        this->file.unpin(block);
+    }
+}
+
+// Add a chunk, pointing to the next one, to a block the free-space map says has room for it, or
+// else a new block.
+Handle TextOverflow::add(const char *data, u16 size, Handle next) {
+    std::vector<char> bytes(LINK_SIZE + size);
+    *(BlockID*)bytes.data() = next.first;
+    *(RecordID*)(bytes.data() + sizeof(BlockID)) = next.second;
+    memcpy(bytes.data() + LINK_SIZE, data, size);
+    Dbt chunk(bytes.data(), (u_int32_t)bytes.size());
+    u16 total = (u16)bytes.size();
+    BlockID block_id = this->free_space.find(total);
+    SlottedPage *block = nullptr;
+    RecordID record_id = 0;
+    while (block == nullptr && block_id != 0) {
+        block = this->file.get(block_id);
+        try {
+            record_id = block->add(&chunk);
+        } catch (DbBlockNoRoomError &e) {
+            // the map was behind
+            this->free_space.set(block_id, block->get_free_space(), false);
+            this->file.unpin(block);
+            block = nullptr;
+            block_id = this->free_space.find(total);
+        }
+    }
+    if (block == nullptr) {
+        block = this->file.get_new();
+        block_id = block->get_block_id();
+        record_id = block->add(&chunk);  // a chunk always fits in an empty block
+    }
+    this->file.put(block);
+    this->free_space.set(block_id, block->get_free_space(), false);
+    this->file.unpin(block);
+    return Handle(block_id, record_id);
+}
+
+
+/* * * * * * * * * * * *
+ * HeapTable Functions
+ * * * * * * * * * * * */
+//Provided by Professor Lundeen
+HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes )
+        : DbRelation(table_name,column_names,column_attributes), file(table_name), free_space(table_name + ".fsm"),
+          overflow(table_name), format(column_attributes) {
+    this->layout = get_layout(&this->column_names);
+}
+
+
+// Executes CREATE TABLE <table_name> (<columns>)
+void HeapTable::create(){
+	file.create();
+	free_space.create();
+	free_space.open(file);
+	overflow.create();
+	overflow.open(file);
+}
+
+// Executes CREATE TABLE IF NOT EXISTS <table_name> (<columns>)
+void HeapTable::create_if_not_exists(){
+
+    try{
+        open();
+    } catch (DbException& e) {
+        create();
+    }
+}
+
+// Executes DROP TABLE <table_name>
+void HeapTable::drop(){
+	file.drop();
+	free_space.drop();
+	overflow.drop();
+}
+
+// Open a table to allow INSERT, UPDATE, DELETE, SELECT, and PROJECT functions
+void HeapTable::open(){
+	file.open();
+	free_space.open(file);
+	overflow.open(file);
+}
+
+// Close table
+void HeapTable::close(){
+	file.close();
+	free_space.close();
+	overflow.close();
+}
+
+// Executes INSERT INTO <table_name> (<row_keys>) VALUES (<row_values>)
+// Returns a handle for the inserted row.
+Handle HeapTable::insert(const ValueDict* row){
+    open();    
+    Row* full_row = validate(row);
+    Handle hand;
+    try {
+        hand = append(full_row);
+    } catch (...) {
+        delete full_row;
+        throw;
+    }
+    delete full_row;
+    return hand;
+}
+
+// Will be used to execute UPDATE functions
+void HeapTable::update(const Handle handle, const ValueDict* new_values){
+	throw DbRelationError("UPDATE NOT YET IMPLEMENTED");
+}
+
+// Will be used to execute DELETE functions
+// The row's TEXT kept in the overflow goes too.
+// Provided by professor Lundeen
+void HeapTable::del(const Handle handle){
+	open();
+	BlockID block_id = handle.first;
+	RecordID record_id = handle.second;
+	SlottedPage* block = this->file.get(block_id);
+	Dbt data;
+	if (block->get(record_id, data))
+		del_outside(RecordView(this->format, data, block->is_marked(record_id)));
+	block->del(record_id);
+	this->file.put(block);
+	this->free_space.set(block_id, block->get_free_space());
+	this->file.unpin(block);
+}
+
+// Returns list of handles for all rows
+Handles* HeapTable::select(){
+    //return all rows in table
+    return select(nullptr);
+}
+
+
+// Returns list of handles for specified rows.
+Handles* HeapTable::select(const ValueDict* where) {
+    Handles* handles = new Handles();
+    DbCursor* cursor = this->cursor(where);
+    Handle handle;
+    cursor->open();
+    while (cursor->next(handle))
+        handles->push_back(handle);
+    cursor->close();
+    delete cursor;
+    return handles;
+}
+
+// Returns a cursor that streams through the rows satisfying where and ranges.
+DbCursor* HeapTable::cursor(const ValueDict* where, const ValueRanges* ranges) {
+    return new HeapTableCursor(*this, where, ranges);
+}
+
+// Refine another selection
+// ie if you have nested selections, projections, etc
+Handles* HeapTable::select(Handles *current_selection, const ValueDict* where) {
+    Handles* handles = new Handles();
+    Equalities equalities;
+    resolve(where, equalities);
+    SlottedPage* block = nullptr;
+    for (auto const& handle: *current_selection) {
+        if (block == nullptr || block->get_block_id() != handle.first) {
+            if (block != nullptr)
+                file.unpin(block);
+            block = file.get(handle.first);
+        }
+        Dbt data;
+        if (block->get(handle.second, data)
+            && selected(RecordView(this->format, data, block->is_marked(handle.second), &this->overflow), equalities))
+            handles->push_back(handle);
+    }
+    if (block != nullptr)
+        file.unpin(block);
+    return handles;
+}
+
+// Returns all fields of the given handle
+ValueDict* HeapTable::project(Handle handle){
+    return project(handle, &this->column_names);
+}
+
+
+// Returns specific fields of the given handle
+ValueDict* HeapTable::project(Handle handle, const ColumnNames* column_names){
+    Row row(get_layout(column_names));
+    project(handle, row);
+    ValueDict* result = new ValueDict();
+    const ColumnNames &names = row.get_layout().get_column_names();
+    for (uint i = 0; i < row.size(); i++)
+        result->emplace(names[i], std::move(row[i]));
+    return result;
+}
+
+// Fills in row's values straight from the record.
+void HeapTable::project(Handle handle, Row &row) {
+    SlottedPage* block = file.get(handle.first);
+    Dbt data;
+    if (!block->get(handle.second, data)) {
+        file.unpin(block);
+        throw DbRelationError("no such row");
+    }
+    unmarshal(RecordView(this->format, data, block->is_marked(handle.second), &this->overflow),
+              slots_for(row.get_layout()), row.data());
+    file.unpin(block);
+    row.fill_duplicates();
+}
+
+// Returns all fields for each of the given handles
+ValueDicts* HeapTable::project(Handles* handles) {
+    return project(handles, &this->column_names);
+}
+
+// Returns specific fields for each of the given handles.
+ValueDicts* HeapTable::project(Handles* handles, const ColumnNames* column_names) {
+    Rows rows;
+    project(handles, get_layout(column_names), rows);
+    ValueDicts* dicts = new ValueDicts();
+    dicts->reserve(rows.size());
+    for (Row* row: rows) {
+        ValueDict* dict = new ValueDict();
+        const ColumnNames &names = row->get_layout().get_column_names();
+        for (uint i = 0; i < row->size(); i++)
+            dict->emplace(names[i], std::move((*row)[i]));
+        dicts->push_back(dict);
+        delete row;
+    }
+    return dicts;
+}
+
+// Appends a row for each of the given handles.
+// Runs of handles in the same block (as they come from select) share one fetch of that block.
+void HeapTable::project(Handles* handles, RowLayoutPtr layout, Rows &rows) {
+    const std::vector<int> &slots = slots_for(*layout);
+    rows.reserve(rows.size() + handles->size());
+    SlottedPage* block = nullptr;
+    for (auto const& handle: *handles) {
+        if (block == nullptr || block->get_block_id() != handle.first) {
+            if (block != nullptr)
+                file.unpin(block);
+            block = file.get(handle.first);
+        }
+        Dbt data;
+        if (!block->get(handle.second, data)) {
+            file.unpin(block);
+            throw DbRelationError("no such row");
+        }
+        Row* row = new Row(layout);
+        unmarshal(RecordView(this->format, data, block->is_marked(handle.second), &this->overflow), slots,
+                  row->data());
+        row->fill_duplicates();
+        rows.push_back(row);
+    }
+    if (block != nullptr)
+        file.unpin(block);
+}
+
+// Where each of our columns goes in a row with the given layout.
+const std::vector<int> &HeapTable::slots_for(const RowLayout &layout) const {
+    if (layout.get_slots().size() != this->column_names.size())
+        throw DbRelationError("row layout is not for table " + this->table_name);
+    return layout.get_slots();
+}
+
+// Validates whether a row is ready for insertion, returning its values in column order.
+// Columns the row has no value for are NULL.
+Row* HeapTable::validate(const ValueDict* row) const {
+    Row* full_row = new Row(this->layout);
+    for (uint col_num = 0; col_num < this->column_names.size(); col_num++) {
+        auto it = row->find(this->column_names[col_num]);
+        if (it == row->end())
+            (*full_row)[col_num] = Value::null(this->column_attributes[col_num].get_data_type());
+        else
+            (*full_row)[col_num] = it->second;
+    }
+    return full_row;
+}
+
+// Appends a record to file, in a block the free-space map says has room for it, or else a new block.
+// Assumes that row is valid.
+Handle HeapTable::append(const Row* row){
+    Dbt* newData = marshal(row);
+    u16 size = (u16)newData->get_size();
+    BlockID block_id = 0;
+    SlottedPage* block = nullptr;
+    RecordID recordID = 0;
+    try {
+        block_id = this->free_space.find(size);
+        while (block == nullptr && block_id != 0) {
+            block = this->file.get(block_id);
+            try {
+                recordID = block->add(newData);
+            } catch(DbBlockNoRoomError& e) {
+                // the map was behind
+                this->free_space.set(block_id, block->get_free_space(), false);
+                this->file.unpin(block);
+                block = nullptr;
+                block_id = this->free_space.find(size);
+            }
+        }
+        if (block == nullptr) {
+            block = this->file.get_new();
+            block_id = block->get_block_id();
+            recordID = block->add(newData);
+        }
+    } catch (...) {
+        if (block != nullptr)
+            this->file.unpin(block);
+        del_outside(RecordView(this->format, *newData, true));  // the row's TEXT already in the overflow
+        delete[] (char*)newData->get_data();
+        delete newData;
+        throw;
+    }
+    block->mark(recordID);  // it's in a versioned row format
+    this->file.put(block);
+    this->free_space.set(block_id, block->get_free_space(), false);  // less room: no hurry to write it
+    delete[] (char*)newData->get_data();
+    delete newData;
+    this->file.unpin(block);
+    return Handle(block_id, recordID);
+}
+
+
+// Free up the overflow's chunks of the TEXT a record keeps outside itself.
+void HeapTable::del_outside(const RecordView &record) {
+    for (uint col_num = 0; col_num < this->column_names.size(); col_num++) {
+        u16 size;
+        if (record.is_outside(col_num))
+            this->overflow.del(record.get_column(col_num, size));
+    }
+}
+
+// Return the bits to go into the file
+// Caller responsible for freeing the returned Dbt and its enclosed ret->get_data().
+// While the record would take up more than a quarter of a block, its longest TEXT value (of those
+// longer than a pointer) goes in the overflow instead, with a pointer to it in the record.
+// Provided by professor Lundeen
+Dbt* HeapTable::marshal(const Row* row) {
+    const Value *values = row->data();
+    uint n = (uint)this->column_names.size();
+    u_long total = this->format.size(values);
+    std::vector<uint8_t> outside((n + 7) / 8, 0);  // bitmap of the TEXT columns going in the overflow
+    uint moved = 0;
+    while (total + outside.size() > this->file.get_block_size() / 4) {
+        int longest = -1;
+        for (uint col_num = 0; col_num < n; col_num++)
+            if (this->column_attributes[col_num].get_data_type() == ColumnAttribute::DataType::TEXT
+                && !(outside[col_num / 8] & (1 << (col_num % 8)))
+                && values[col_num].text_size() > TextOverflow::POINTER_SIZE
+                && (longest < 0 || values[col_num].text_size() > values[longest].text_size()))
+                longest = (int)col_num;
+        if (longest < 0)
+            break;
+        outside[longest / 8] |= (uint8_t)(1 << (longest % 8));
+        total -= values[longest].text_size() - TextOverflow::POINTER_SIZE;
+        moved++;
+    }
+    if (moved > 0)
+        total += outside.size();
+    if (total > this->file.get_block_size() - 9)  // we insist that one row fits into an empty block, headers and all
+        throw DbRelationError("row too big to marshal");
+    char *bytes = new char[total];
+    if (moved == 0) {
+        this->format.marshal(values, bytes);
+        return new Dbt(bytes, (u_int32_t)total);
+    }
+
+    // the record gets the pointers in place of the values that went out
+    std::vector<char> pointers(moved * TextOverflow::POINTER_SIZE);
+    char *pointer = pointers.data();  // next one to fill in
+    std::vector<Value> stored;
+    stored.reserve(n);
+    try {
+        for (uint col_num = 0; col_num < n; col_num++) {
+            const Value &value = values[col_num];
+            if (outside[col_num / 8] & (1 << (col_num % 8))) {
+                this->overflow.put(value.text_data(), (u16)value.text_size(), pointer);
+                stored.push_back(Value::view(pointer, TextOverflow::POINTER_SIZE));
+                pointer += TextOverflow::POINTER_SIZE;
+            } else if (value.data_type == ColumnAttribute::DataType::TEXT && !value.is_null()) {
+                stored.push_back(Value::view(value.text_data(), value.text_size()));
+            } else {
+                stored.push_back(value);
+            }
+        }
+    } catch (...) {
+        for (char *done = pointers.data(); done < pointer; done += TextOverflow::POINTER_SIZE)
+            this->overflow.del(done);
+        delete[] bytes;
+        throw;
+    }
+    this->format.marshal(stored.data(), bytes, outside.data());
+    return new Dbt(bytes, (u_int32_t)total);
+}
+
+// Converts the columns slots picks out into values: column i goes to values[slots[i]], or is skipped
+// over if that's -1.
+void HeapTable::unmarshal(const RecordView &record, const std::vector<int> &slots, Value *values) const {
+    if (record.is_versioned()) {
+        for (uint col_num = 0; col_num < this->column_names.size(); col_num++)
+            if (slots[col_num] >= 0)
+                values[slots[col_num]] = record.get(col_num);
+        return;
+    }
+
+    // the old format, read front to back
+    const char *bytes = record.get_data();
+    uint offset = 0;
+    for (uint col_num = 0; col_num < this->column_names.size(); col_num++) {
+    	ColumnAttribute::DataType data_type = this->column_attributes[col_num].get_data_type();
+    	int slot = slots[col_num];
+    	if (offset >= record.get_size()) {  // a column added since
+    		if (slot >= 0)
+    			values[slot] = Value::null(data_type);
+    		continue;
+    	}
+    	if (data_type == ColumnAttribute::DataType::INT) {
+    		if (slot >= 0)
+    			values[slot] = Value(*(const int32_t*)(bytes + offset));
+    		offset += sizeof(int32_t);
+    	} else if (data_type == ColumnAttribute::DataType::TEXT) {
+    		u16 size = *(const u16*)(bytes + offset);
+    		offset += sizeof(u16);
+    		if (slot >= 0)  // assume ascii for now
+    			values[slot] = Value(bytes + offset, size);
+            offset += size;
+        } else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
+            if (slot >= 0) {
+                values[slot] = Value((int32_t)*(const uint8_t*)(bytes + offset));
+                values[slot].data_type = data_type;
+            }
+            offset += sizeof(uint8_t);
+    	} else {
+            throw DbRelationError("Only know how to unmarshal INT and TEXT");
+    	}
+    }
+}
+
+// Which of our columns each of the where clause's values is for.
+void HeapTable::resolve(const ValueDict* where, Equalities &equalities) const {
+	equalities.clear();
+	if (where == nullptr)
+		return;
+	for (auto const& column: *where) {
+		auto it = std::find(this->column_names.begin(), this->column_names.end(), column.first);
+		if (it == this->column_names.end())
+			throw DbRelationError("unknown column " + column.first);
+		equalities.push_back(std::make_pair((uint)(it - this->column_names.begin()), &column.second));
+	}
+}
+
+// See if the row at the given handle satisfies the given where clause
+//Provided by Professor Lundeen
+bool HeapTable::selected(Handle handle, const ValueDict* where) {
+	if (where == nullptr || where->empty())
+		return true;
+	Equalities equalities;
+	resolve(where, equalities);
+	SlottedPage* block = file.get(handle.first);
+	Dbt data;
+	bool matched = block->get(handle.second, data)
+		&& selected(RecordView(this->format, data, block->is_marked(handle.second), &this->overflow), equalities);
+	file.unpin(block);
+	return matched;
+}
+
+// Check the record against the equalities without decoding any of it.
+bool HeapTable::selected(const RecordView &record, const Equalities &equalities) const {
+	for (auto const& equality: equalities)
+		if (!record.equals(equality.first, *equality.second))
+			return false;
+	return true;
+}
+
+/* * * * * * * * * * * * * *
+ * RowFormat Functions
+ * * * * * * * * * * * * * */
+RowFormat::RowFormat(const ColumnAttributes &column_attributes)
+        : column_attributes(column_attributes), places(), nulls(0), texts(0), text_start(0) {
+    this->nulls = (u16)((column_attributes.size() + 7) / 8);
+    for (auto const& ca: column_attributes)
+        if (ca.get_data_type() == ColumnAttribute::DataType::TEXT)
+            this->texts++;
+    u16 offset = (u16)(sizeof(uint8_t) + this->nulls + sizeof(u16) * this->texts);
+    u16 text = 0;
+    for (auto const& ca: column_attributes) {
+        ColumnAttribute::DataType data_type = ca.get_data_type();
+        if (data_type == ColumnAttribute::DataType::INT) {
+            this->places.push_back(offset);
+            offset += sizeof(int32_t);
+        } else if (data_type == ColumnAttribute::DataType::TEXT) {
+            this->places.push_back(text++);
+        } else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
+            this->places.push_back(offset);
+            offset += sizeof(uint8_t);
+        } else {
+            throw DbRelationError("Only know how to marshal INT, TEXT, and BOOLEAN");
+        }
+    }
+    this->text_start = offset;
+}
+
+u_long RowFormat::size(const Value *values) const {
+    u_long total = this->text_start;
+    for (uint col_num = 0; col_num < this->column_attributes.size(); col_num++)
+        if (this->column_attributes[col_num].get_data_type() == ColumnAttribute::DataType::TEXT) {
+            if (values[col_num].text_size() > UINT16_MAX)
+                throw DbRelationError("text field too long to marshal");
+            total += values[col_num].text_size();
+        }
+    return total;
+}
+
+void RowFormat::marshal(const Value *values, char *bytes, const uint8_t *outside) const {
+    u16 shift = 0;  // version 4 has the second bitmap, so everything after the first is that much further up
+    *(uint8_t*)bytes = outside == nullptr ? VERSION : VERSION_OUTSIDE;
+    uint8_t *null_bits = (uint8_t*)(bytes + sizeof(uint8_t));
+    memset(null_bits, 0, this->nulls);
+    if (outside != nullptr) {
+        memcpy(null_bits + this->nulls, outside, this->nulls);
+        shift = this->nulls;
+    }
+    u16 *text_ends = (u16*)(bytes + sizeof(uint8_t) + this->nulls + shift);
+    u16 end = this->text_start + shift;
+    for (uint col_num = 0; col_num < this->column_attributes.size(); col_num++) {
+        const Value &value = values[col_num];
+        u16 place = this->places[col_num];
+        if (value.is_null())
+            null_bits[col_num / 8] |= (uint8_t)(1 << (col_num % 8));
+        switch (this->column_attributes[col_num].get_data_type()) {
+            case ColumnAttribute::DataType::INT:
+                *(int32_t*)(bytes + place + shift) = value.is_null() ? 0 : value.n;
+                break;
+            case ColumnAttribute::DataType::TEXT:
+                memcpy(bytes + end, value.text_data(), value.text_size());  // assume ascii for now
+                end += (u16)value.text_size();
+                text_ends[place] = end;
+                break;
+            default:
+                *(uint8_t*)(bytes + place + shift) = value.is_null() ? 0 : (uint8_t)value.n;
+        }
+    }
+}
+
+const char *RowFormat::get_column(const char *bytes, u_long record_size, bool versioned, uint col_num,
+                                  uint16_t &size) const {
+    ColumnAttribute::DataType data_type = this->column_attributes[col_num].get_data_type();
+    if (versioned) {
+        uint8_t version = *(const uint8_t*)bytes;
+        int shift = 0;  // version 2 has no NULL bitmap, so everything is that much further up (down for version 4)
+        if (version == VERSION || version == VERSION_OUTSIDE) {
+            if (bytes[sizeof(uint8_t) + col_num / 8] & (1 << (col_num % 8))) {
+                size = 0;
+                return nullptr;
+            }
+            if (version == VERSION_OUTSIDE)
+                shift = -(int)this->nulls;
+        } else if (version == VERSION_NO_NULLS) {
+            shift = this->nulls;
+        } else {
+            throw DbRelationError("unknown row format version " + std::to_string(version));
+        }
+        u16 place = this->places[col_num];
+        if (data_type == ColumnAttribute::DataType::TEXT) {
+            const u16 *text_ends = (const u16*)(bytes + sizeof(uint8_t) + this->nulls - shift);
+            u16 start = place == 0 ? (u16)(this->text_start - shift) : text_ends[place - 1];
+            size = text_ends[place] - start;
+            return bytes + start;
+        }
+        size = data_type == ColumnAttribute::DataType::INT ? sizeof(int32_t) : sizeof(uint8_t);
+        return bytes + place - shift;
+    }
+
+    // the old format: walk over the columns before it
+    const char *start = bytes;
+    for (uint i = 0; ; i++) {
+        if (start >= bytes + record_size) {  // a column added since
+            size = 0;
+            return nullptr;
+        }
+        data_type = this->column_attributes[i].get_data_type();
+        if (data_type == ColumnAttribute::DataType::INT) {
+            size = sizeof(int32_t);
+        } else if (data_type == ColumnAttribute::DataType::TEXT) {
+            size = *(const u16*)start;
+            start += sizeof(u16);
+        } else {
+            size = sizeof(uint8_t);
+        }
+        if (i == col_num)
+            return start;
+        start += size;
+    }
+}
+
+bool RowFormat::is_outside(const char *bytes, bool versioned, uint col_num) const {
+    return versioned && *(const uint8_t*)bytes == VERSION_OUTSIDE
+           && (bytes[sizeof(uint8_t) + this->nulls + col_num / 8] & (1 << (col_num % 8)));
+}
+
+/* * * * * * * * * * * * * *
+ * RecordView Functions
+ * * * * * * * * * * * * * */
+// Like the other get_column, but TEXT kept outside the record is fetched into fetched, and that's
+// what gets handed back.
+const char *RecordView::get_column(uint col_num, u16 &size, std::string &fetched) const {
+	const char *data = get_column(col_num, size);
+	if (data == nullptr || !is_outside(col_num))
+		return data;
+	if (this->overflow == nullptr)
+		throw DbRelationError("no overflow to fetch TEXT kept outside the record from");
+	this->overflow->get(data, fetched);
+	size = (u16)fetched.size();
+	return fetched.data();
+}
+
+Value RecordView::get(uint col_num, bool view) const {
+	u16 size;
+	std::string fetched;
+	const char *data = get_column(col_num, size, fetched);
+	ColumnAttribute::DataType data_type = this->format.get_column_attributes()[col_num].get_data_type();
+	if (data == nullptr)
+		return Value::null(data_type);
+	if (data_type == ColumnAttribute::DataType::TEXT)  // what was fetched can't be borrowed
+		return view && data != fetched.data() ? Value::view(data, size) : Value(data, size);
+	Value value(data_type == ColumnAttribute::DataType::INT ? *(const int32_t*)data : (int32_t)*(const uint8_t*)data);
+	value.data_type = data_type;
+	return value;
+}
+
+bool RecordView::equals(uint col_num, const Value &value) const {
+	ColumnAttribute::DataType data_type = this->format.get_column_attributes()[col_num].get_data_type();
+	if (value.data_type != data_type)
+		return false;
+	u16 size;
+	const char *data = get_column(col_num, size);
+	if (data == nullptr || value.is_null())
+		return data == nullptr && value.is_null();
+	if (data_type == ColumnAttribute::DataType::INT)
+		return value.n == *(const int32_t*)data;
+	if (data_type == ColumnAttribute::DataType::TEXT) {
+		std::string fetched;
+		if (is_outside(col_num)) {
+			if (value.text_size() != TextOverflow::get_size(data))
+				return false;  // without fetching it
+			data = get_column(col_num, size, fetched);
+		}
+		return value.text_size() == size && memcmp(value.text_data(), data, size) == 0;
+	}
+	return value.n == *(const uint8_t*)data;
+}
+
+/* * * * * * * * * * * * * *
+ * ColumnVector Functions
+ * * * * * * * * * * * * * */
+void ColumnVector::gather(ColumnAttribute::DataType data_type, size_t n) {
+	this->data_type = data_type;
+	this->ints = nullptr;
+	this->bools = nullptr;
+	this->texts = nullptr;
+	this->sizes = nullptr;
+	if (data_type == ColumnAttribute::DataType::INT) {
+		this->int_values.resize(n);
+		this->ints = this->int_values.data();
+	} else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
+		this->bool_values.resize(n);
+		this->bools = this->bool_values.data();
+	} else {
+		this->text_values.resize(n);
+		this->size_values.resize(n);
+		this->texts = this->text_values.data();
+		this->sizes = this->size_values.data();
+	}
+	this->null_values.resize(n);
+	this->nulls = this->null_values.data();
+}
+
+// NULL (data is nullptr) gets a zero value along with its flag, so the INT and BOOLEAN loops can
+// run over it harmlessly.
+void ColumnVector::set(size_t row, const char *data, u16 size) {
+	this->null_values[row] = (uint8_t)(data == nullptr);
+	if (this->data_type == ColumnAttribute::DataType::INT) {
+		this->int_values[row] = data == nullptr ? 0 : *(const int32_t*)data;
+	} else if (this->data_type == ColumnAttribute::DataType::BOOLEAN) {
+		this->bool_values[row] = data == nullptr ? 0 : *(const uint8_t*)data;
+	} else {
+		this->text_values[row] = data;
+		this->size_values[row] = size;
+	}
+}
+
+/* * * * * * * * * * * * * *
+ * BatchFilter Functions
+ * * * * * * * * * * * * * */
+BatchFilter::BatchFilter(const ColumnNames &column_names, const ColumnAttributes &column_attributes,
+                         const ValueDict *where, const ValueRanges *ranges)
+		: columns(), conditions(), never(false) {
+	if (where != nullptr)
+		for (auto const& column: *where)
+			add(column_attributes, vector_for(column_names, column.first), EQUAL, column.second, true);
+	if (ranges != nullptr)
+		for (auto const& column: *ranges) {
+			const ValueRange &range = column.second;
+			uint vector = vector_for(column_names, column.first);
+			if (range.has_min)
+				add(column_attributes, vector, AT_LEAST, range.min, range.min_inclusive);
+			if (range.has_max)
+				add(column_attributes, vector, AT_MOST, range.max, range.max_inclusive);
+			if (!range.has_min && !range.has_max) {
+				Condition condition = {vector, column_attributes[this->columns[vector]].get_data_type(), NOT_NULL,
+				                       nullptr, true, 0};
+				this->conditions.push_back(condition);
+			}
+		}
+}
+
+// Which of the vectors the filter is handed is for the named column, adding one if need be.
+uint BatchFilter::vector_for(const ColumnNames &column_names, const Identifier &column_name) {
+	auto it = std::find(column_names.begin(), column_names.end(), column_name);
+	if (it == column_names.end())
+		throw DbRelationError("unknown column " + column_name);
+	uint col_num = (uint)(it - column_names.begin());
+	auto found = std::find(this->columns.begin(), this->columns.end(), col_num);
+	if (found != this->columns.end())
+		return (uint)(found - this->columns.begin());
+	this->columns.push_back(col_num);
+	return (uint)(this->columns.size() - 1);
+}
+
+// Add a test of a vector's values against value. Anything that will go the same way for every
+// non-NULL row (a value of another type, or a NULL bound) is settled here instead. INT and BOOLEAN
+// bounds are made inclusive.
+void BatchFilter::add(const ColumnAttributes &column_attributes, uint vector, Test test, const Value &value,
+                      bool inclusive) {
+	ColumnAttribute::DataType data_type = column_attributes[this->columns[vector]].get_data_type();
+	Condition condition = {vector, data_type, test, &value, inclusive, value.n};
+	if (test == EQUAL) {
+		if (value.data_type != data_type) {
+			this->never = true;
+			return;
+		}
+	} else if (value.data_type != data_type || value.is_null()) {
+		Value probe = data_type == ColumnAttribute::DataType::TEXT ? Value("") : Value(0);
+		probe.data_type = data_type;
+		ValueRange range;
+		if (test == AT_LEAST)
+			range.restrict_min(value, inclusive);
+		else
+			range.restrict_max(value, inclusive);
+		if (!range.contains(probe)) {
+			this->never = true;
+			return;
+		}
+		condition.test = NOT_NULL;
+	} else if (!inclusive && data_type != ColumnAttribute::DataType::TEXT) {
+		if (value.n == (test == AT_LEAST ? INT32_MAX : INT32_MIN)) {
+			this->never = true;
+			return;
+		}
+		condition.bound = test == AT_LEAST ? value.n + 1 : value.n - 1;
+		condition.inclusive = true;
+	}
+	this->conditions.push_back(condition);
+}
+
+// The loops that narrow a selection down to the rows passing one test. They are branch-free so the
+// compiler can vectorize them.
+template <typename T>
+static void keep_equal(const T *values, int32_t key, uint8_t *selected, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		selected[i] &= (uint8_t)(values[i] == key);
+}
+
+template <typename T>
+static void keep_at_least(const T *values, int32_t low, uint8_t *selected, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		selected[i] &= (uint8_t)(values[i] >= low);
+}
+
+template <typename T>
+static void keep_at_most(const T *values, int32_t high, uint8_t *selected, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		selected[i] &= (uint8_t)(values[i] <= high);
+}
+
+static void keep_flagged(const uint8_t *flags, uint8_t flag, uint8_t *selected, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		selected[i] &= (uint8_t)(flags[i] == flag);
+}
+
+// TEXT has to be compared byte by byte anyway, so these skip the rows already ruled out (whose
+// values may not even be filled in).
+static void keep_text_equal(const char *const *texts, const u16 *sizes, const Value &value, uint8_t *selected,
+                            size_t n) {
+	const char *data = value.text_data();
+	size_t size = value.text_size();
+	for (size_t i = 0; i < n; i++)
+		if (selected[i])
+			selected[i] = (uint8_t)(sizes[i] == size && memcmp(texts[i], data, size) == 0);
+}
+
+static void keep_text_bound(const char *const *texts, const u16 *sizes, const Value &value, bool at_least,
+                            bool inclusive, uint8_t *selected, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		if (!selected[i])
+			continue;
+		int cmp = value.compare_text(texts[i], sizes[i]);  // value against the row's
+		selected[i] = (uint8_t)((at_least ? cmp < 0 : cmp > 0) || (inclusive && cmp == 0));
+	}
+}
+
+// Run the column's conditions one after another over the whole batch. NULLs are ruled out (or, for
+// an equality with NULL, in) first, so the tests of the values never have to look at them.
+void BatchFilter::filter(uint vector, const ColumnVector &values, size_t n, uint8_t *selected) const {
+	if (this->never) {
+		memset(selected, 0, n);
+		return;
+	}
+	for (auto const& condition: this->conditions) {
+		if (condition.vector != vector)
+			continue;
+		if (condition.test == EQUAL && condition.value->is_null()) {
+			if (values.nulls == nullptr)
+				memset(selected, 0, n);
+			else
+				keep_flagged(values.nulls, 1, selected, n);
+			continue;
+		}
+		if (values.nulls != nullptr)
+			keep_flagged(values.nulls, 0, selected, n);
+		if (condition.test == NOT_NULL)
+			continue;
+		if (condition.data_type == ColumnAttribute::DataType::TEXT) {
+			if (condition.test == EQUAL)
+				keep_text_equal(values.texts, values.sizes, *condition.value, selected, n);
+			else
+				keep_text_bound(values.texts, values.sizes, *condition.value, condition.test == AT_LEAST,
+				                condition.inclusive, selected, n);
+		} else if (condition.data_type == ColumnAttribute::DataType::INT) {
+			if (condition.test == EQUAL)
+				keep_equal(values.ints, condition.bound, selected, n);
+			else if (condition.test == AT_LEAST)
+				keep_at_least(values.ints, condition.bound, selected, n);
+			else
+				keep_at_most(values.ints, condition.bound, selected, n);
+		} else {
+			if (condition.test == EQUAL)
+				keep_equal(values.bools, condition.bound, selected, n);
+			else if (condition.test == AT_LEAST)
+				keep_at_least(values.bools, condition.bound, selected, n);
+			else
+				keep_at_most(values.bools, condition.bound, selected, n);
+		}
+	}
+}
+
+/* * * * * * * * * * * * * *
+ * HeapTableCursor Functions
+ * * * * * * * * * * * * * */
+HeapTableCursor::HeapTableCursor(HeapTable &table, const ValueDict* where, const ValueRanges* ranges)
+        : table(table), filter(table.column_names, table.column_attributes, where, ranges), values(), selected(),
+          fetched(), block_id(0), last_block_id(0), records(), position(0) {
+}
+
+HeapTableCursor::~HeapTableCursor() {
+    close();
+}
+
+// Start over from the first block.
+void HeapTableCursor::open() {
+    close();
+    this->table.open();
+    this->block_id = 0;
+    this->last_block_id = this->table.file.get_last_block_id();
+}
+
+// Hand out the current block's matches, finding the next block's once they run out.
+bool HeapTableCursor::next(Handle &handle) {
+    while (this->position >= this->records.size())
+        if (!next_block())
+            return false;
+    handle = Handle(this->block_id, this->records[this->position++].id);
+    return true;
+}
+
+void HeapTableCursor::close() {
+    this->records.clear();
+    this->position = 0;
+}
+
+// Load the records of the following block, if there is one, keeping just the ones that satisfy
+// the where clause. A column at a time, its values are read out of the records still in the running,
+// in place, and then checked for all of them at once.
+bool HeapTableCursor::next_block() {
+    close();
+    if (this->block_id >= this->last_block_id)
+        return false;
+    SlottedPage* block = this->table.file.get(++this->block_id);
+    for (auto const& record: *block)
+        this->records.push_back(record);
+    if (!this->filter.empty()) {
+        size_t n = this->records.size();
+        const std::vector<uint> &columns = this->filter.get_columns();
+        this->selected.assign(n, 1);
+        this->fetched.resize(n);
+        for (uint i = 0; i < columns.size(); i++) {
+            this->values.gather(this->table.column_attributes[columns[i]].get_data_type(), n);
+            for (size_t row = 0; row < n; row++) {
+                if (!this->selected[row])
+                    continue;
+                const SlottedPage::Record &record = this->records[row];
+                Dbt data((void*)record.data, record.size);
+                u16 size;
+                const char *value = RecordView(this->table.format, data, block->is_marked(record.id),
+                                               &this->table.overflow).get_column(columns[i], size, this->fetched[row]);
+                this->values.set(row, value, size);
+            }
+            this->filter.filter(i, this->values, n, this->selected.data());
+        }
+        size_t kept = 0;
+        for (size_t row = 0; row < n; row++)
+            if (this->selected[row])
+                this->records[kept++] = this->records[row];
+        this->records.resize(kept);
+    }
+    this->table.file.unpin(block);
+    return true;
+}
+
+// test functions below::
+void test_set_row(ValueDict &row, int a, string b) {
+    row["a"] = Value(a);
+    row["b"] = Value(b);
+    row["c"] = Value(a%2 == 0);  // true for even, false for odd
+}
+
+bool test_compare(DbRelation &table, Handle handle, int a, string b) {
+    ValueDict *result = table.project(handle);
+    Value value = (*result)["a"];
+    if (value.n != a) {
+        delete result;
+        return false;
+    }
+    value = (*result)["b"];
+    if (value.text() != b) {
+        delete result;
+        return false;
+    }
+    value = (*result)["c"];
+    delete result;
+    if (value.n != (a%2 == 0))
+        return false;
+    return true;
+}
+// Number of rows a cursor comes up with; deletes the cursor.
+u_long test_count(DbCursor *cursor) {
+    u_long count = 0;
+    Handle handle;
+    cursor->open();
+    while (cursor->next(handle))
+        count++;
+    cursor->close();
+    delete cursor;
+    return count;
+}
+
+// Whether there's a HeapFile by that name.
+static bool test_file_exists(const string &name) {
+    HeapFile file(name);
+    try {
+        file.open();
+    } catch (DbException &e) {
+        return false;
+    }
+    file.close();
+    return true;
+}
+
+// TEST FOR HEAP STORAGE
+bool test_heap_storage(){
+
+	ColumnNames column_names;
+
+	column_names.push_back("a");
+	column_names.push_back("b");
+
+	ColumnAttributes column_attributes;
+	ColumnAttribute ca(ColumnAttribute::INT);
+
+	column_attributes.push_back(ca);
+	ca.set_data_type(ColumnAttribute::TEXT);
+	column_attributes.push_back(ca);
+	
+	HeapTable table1("_test_create_drop_cpp", column_names, column_attributes);
+	
+	table1.create();
+	cout << "create ok" << endl;
+	
+	table1.drop();  // drop makes the object unusable because of BerkeleyDB restriction -- maybe want to fix this some day
+	cout << "drop ok" << endl;
+	
+	HeapTable table("_test_data_cpp", column_names, column_attributes);
+	
+	table.create_if_not_exists();
+	cout << "create_if_not_exists ok" << endl;
+	
+	ValueDict row;
+	row["a"] = Value(12);
+	row["b"] = Value("Hello!");
+
+	table.insert(&row);
+	cout << "insert ok" << endl;
+	
+	Handles* handles = table.select();
+	cout << "select ok " << handles->size() << endl;
+	
+	ValueDict *result = table.project((*handles)[0]);
+	cout << "project ok" << endl;
+	
+	Value value = (*result)["a"];
+	
+	if (value.n != 12){
+		return false;
+    }
+
+	value = (*result)["b"];
+
+	if (value.text() != "Hello!"){
+		return false;
+    }
+	delete result;
+	delete handles;
+
+	// stream through enough rows to span several blocks
+	for (int i = 0; i < 1000; i++) {
+		row["a"] = Value(i);
+		row["b"] = Value("row " + to_string(i % 10));
+		table.insert(&row);
+	}
+	ValueDict where;
+	where["b"] = Value("row 7");
+	DbCursor* cursor = table.cursor(&where);
+	Handle handle;
+	int count = 0;
+	cursor->open();
+	while (cursor->next(handle)) {
+		result = table.project(handle);
+		if ((*result)["a"].n % 10 != 7) {
+			delete result;
+			delete cursor;
+			return false;
+		}
+		delete result;
+		count++;
+	}
+	cursor->close();
+	delete cursor;
+	cout << "cursor ok " << count << endl;
+	if (count != 100)
+		return false;
+
+	// refining a selection checks the records in place too
+	handles = table.select();
+	Handles* refined = table.select(handles, &where);
+	bool refined_ok = (refined->size() == 100);
+	delete refined;
+	delete handles;
+	cout << "refine " << (refined_ok ? "ok" : "failed") << endl;
+	if (!refined_ok)
+		return false;
+
+	// ranges are checked along with the where clause, a block at a time
+	ValueRanges ranges;
+	ranges["a"].restrict_min(Value(500), false);
+	ranges["a"].restrict_max(Value(900), true);
+	u_long in_range = test_count(table.cursor(&where, &ranges));
+	ranges.clear();
+	ranges["b"].restrict_min(Value("row 7"), true);
+	ranges["b"].restrict_max(Value("row 8"), false);
+	ranges["a"].restrict_max(Value(100), false);
+	u_long text_range = test_count(table.cursor(nullptr, &ranges));
+	ranges["a"].restrict_min(Value("x"), true);
+	u_long across_types = test_count(table.cursor(nullptr, &ranges));
+	bool ranges_ok = (in_range == 40 && text_range == 10 && across_types == 0);
+	cout << "ranges " << (ranges_ok ? "ok" : "failed") << endl;
+	if (!ranges_ok)
+		return false;
+
+	// batch projection of just one column across all the blocks
+	handles = table.select();
+	ColumnNames just_a;
+	just_a.push_back("a");
+	ValueDicts* rows = table.project(handles, &just_a);
+	bool projected_ok = (rows->size() == handles->size());
+	for (auto const& r: *rows) {
+		if (r->size() != 1 || r->find("a") == r->end())
+			projected_ok = false;
+		delete r;
+	}
+	delete rows;
+	delete handles;
+	cout << "batch project " << (projected_ok ? "ok" : "failed") << endl;
+	if (!projected_ok)
+		return false;
+
+	// positional rows share one layout, with the columns in the order asked for
+	handles = table.select(&where);
+	ColumnNames b_then_a;
+	b_then_a.push_back("b");
+	b_then_a.push_back("a");
+	RowLayoutPtr layout = table.get_layout(&b_then_a);
+	Rows positional;
+	table.project(handles, layout, positional);
+	bool positional_ok = (positional.size() == handles->size());
+	for (auto const& r: positional) {
+		if (&r->get_layout() != layout.get() || (*r)[0].text() != "row 7" || (*r)[1].n % 10 != 7)
+			positional_ok = false;
+		delete r;
+	}
+	delete handles;
+	cout << "positional project " << (positional_ok ? "ok" : "failed") << endl;
+	if (!positional_ok)
+		return false;
+
+	// every row projected above came out of a block the cursor had just brought in
+	BufferPool::Stats stats = table.get_buffer_stats();
+	cout << "buffer pool hits " << stats.hits << " misses " << stats.misses
+		 << " evictions " << stats.evictions << endl;
+	if (stats.hits == 0)
+		return false;
+
+	// a record in the old, unversioned format (left unmarked), as it would be in an older file
+	{
+		HeapFile raw("_test_data_cpp");
+		raw.open();
+		SlottedPage* block = raw.get(raw.get_last_block_id());
+		char old_record[sizeof(int32_t) + sizeof(u16) + 5];
+		*(int32_t*)old_record = 6000;
+		*(u16*)(old_record + sizeof(int32_t)) = 5;
+		memcpy(old_record + sizeof(int32_t) + sizeof(u16), "older", 5);
+		Dbt old_data(old_record, sizeof(old_record));
+		block->add(&old_data);
+		raw.put(block);
+		raw.unpin(block);
+	}
+	where["b"] = Value("older");
+	handles = table.select(&where);
+	bool old_ok = (handles->size() == 1);
+	if (old_ok) {
+		result = table.project((*handles)[0]);
+		old_ok = ((*result)["a"].n == 6000 && (*result)["b"].text() == "older");
+		delete result;
+	}
+	delete handles;
+	cout << "old row format " << (old_ok ? "ok" : "failed") << endl;
+	if (!old_ok)
+		return false;
+
+	// text too long to keep inline in a Value, found by a where clause compared against the page bytes
+	string long_text(3 * Value::INLINE_TEXT, 'x');
+	row["a"] = Value(5000);
+	row["b"] = Value(long_text);
+	table.insert(&row);
+	where["b"] = Value(long_text);
+	handles = table.select(&where);
+	bool long_ok = (handles->size() == 1);
+	if (long_ok) {
+		result = table.project((*handles)[0]);
+		long_ok = ((*result)["a"].n == 5000 && (*result)["b"].text() == long_text);
+		delete result;
+	}
+	delete handles;
+	cout << "long text " << (long_ok ? "ok" : "failed") << endl;
+	if (!long_ok)
+		return false;
+
+	// a column left out of the row is NULL, which no where clause matches, not even its zero placeholder
+	ValueDict partial;
+	partial["b"] = Value("nameless");
+	table.insert(&partial);
+	where.clear();
+	where["b"] = Value("nameless");
+	handles = table.select(&where);
+	bool null_ok = (handles->size() == 1);
+	if (null_ok) {
+		result = table.project((*handles)[0]);
+		null_ok = ((*result)["a"].is_null() && (*result)["a"].data_type == ColumnAttribute::INT
+				   && (*result)["a"] != Value(0) && (*result)["b"].text() == "nameless");
+		delete result;
+	}
+	delete handles;
+	where["a"] = Value(0);
+	handles = table.select(&where);
+	null_ok = null_ok && handles->empty();
+	delete handles;
+	cout << "nulls " << (null_ok ? "ok" : "failed") << endl;
+	if (!null_ok)
+		return false;
+
+	// deleting leaves gaps, which a record too big for the free space alone gets by compacting, and
+	// slots, which get handed out again
+	{
+		char bytes[DbBlock::BLOCK_SZ];
+		Dbt dbt(bytes, sizeof(bytes));
+		SlottedPage page(dbt, 1, true);
+		char record[100];
+		RecordID id;
+		for (id = 1; ; id++) {
+			memset(record, 'a' + id % 26, sizeof(record));
+			Dbt data(record, sizeof(record));
+			try {
+				page.add(&data);
+			} catch (DbBlockNoRoomError &e) {
+				break;
+			}
+		}
+		for (RecordID gone = 1; gone < id; gone += 2)
+			page.del(gone);
+		char bigger[250];
+		memset(bigger, '!', sizeof(bigger));
+		Dbt big(bigger, sizeof(bigger));
+		RecordID big_id = page.add(&big);
+		bool compact_ok = true;
+		for (RecordID kept = 2; kept < id; kept += 2) {
+			Dbt data;
+			compact_ok = compact_ok && page.get(kept, data) && data.get_size() == sizeof(record)
+			             && ((char*)data.get_data())[99] == 'a' + kept % 26;
+		}
+		Dbt data;
+		compact_ok = compact_ok && big_id == 1 && page.get(big_id, data)
+		             && memcmp(data.get_data(), bigger, sizeof(bigger)) == 0;
+		u16 walked = 0;
+		for (auto const& live: page)
+			walked += (live.id == big_id ? live.size == sizeof(bigger)
+			                             : live.id % 2 == 0 && live.size == sizeof(record));
+		compact_ok = compact_ok && walked == page.size() && page.size() == (id - 1) / 2 + 1;
+		SlottedPage reread(dbt, 1);  // as if fresh off the disk
+		compact_ok = compact_ok && reread.size() == page.size();
+		compact_ok = compact_ok && reread.add(&big) == 3 && reread.add(&big) == 5;
+		for (RecordID gone = id - 1; gone > 0; gone--)
+			reread.del(gone);
+		char other[DbBlock::BLOCK_SZ];
+		Dbt other_dbt(other, sizeof(other));
+		compact_ok = compact_ok && reread.get_num_records() == 0
+		             && reread.get_free_space() == SlottedPage(other_dbt, 2, true).get_free_space();
+		cout << "compact " << (compact_ok ? "ok" : "failed") << endl;
+		if (!compact_ok)
+			return false;
+	}
+
+	// the room deletes free up gets used before the file grows, once there's a free-space map for it
+	bool reuse_ok = !test_file_exists("_test_data_cpp.fsm");
+	handles = table.select();
+	BlockID last = 0;
+	for (auto const& handle: *handles) {
+		last = max(last, handle.first);
+		table.del(handle);
+	}
+	delete handles;
+	reuse_ok = reuse_ok && test_file_exists("_test_data_cpp.fsm");
+	for (int i = 0; i < 1000; i++) {
+		row["a"] = Value(i);
+		row["b"] = Value("row " + to_string(i % 10));
+		table.insert(&row);
+	}
+	where.clear();
+	where["b"] = Value("row 3");
+	u_long reused = test_count(table.cursor(&where));
+	handles = table.select();
+	reuse_ok = reuse_ok && reused == 100 && handles->size() == 1000;
+	for (auto const& handle: *handles)
+		reuse_ok = reuse_ok && handle.first <= last;
+	delete handles;
+	cout << "reuse " << (reuse_ok ? "ok" : "failed") << endl;
+	if (!reuse_ok)
+		return false;
+
+	// rows kept whole in a table made with bigger blocks, which it keeps, need fewer of them
+	row["a"] = Value(7);
+	row["b"] = Value(string(4000, 'w'));
+	bool wide_ok = true;
+	{
+		HeapTable wide("_test_wide_cpp", column_names, column_attributes);
+		wide.set_block_size(4 * DbBlock::BLOCK_SZ);
+		wide.create();
+		for (int i = 0; i < 5; i++)
+			wide.insert(&row);
+		wide.close();
+	}
+	HeapTable wide("_test_wide_cpp", column_names, column_attributes);
+	handles = wide.select();
+	wide_ok = wide_ok && handles->size() == 5 && handles->back().first == 2;  // four to a block
+	if (wide_ok) {
+		result = wide.project(handles->back());
+		wide_ok = (*result)["b"].text() == row["b"].text();
+		delete result;
+	}
+	delete handles;
+	wide.drop();
+	cout << "block size " << (wide_ok ? "ok" : "failed") << endl;
+	if (!wide_ok)
+		return false;
+
+	// TEXT too long for a block goes in the overflow, made for it, and is only fetched when it's asked for
+	bool overflow_ok = !test_file_exists("_test_data_cpp.toast");
+	row["a"] = Value(-8);
+	row["b"] = Value(string(10000, 'x') + "end");
+	Handle long_handle = table.insert(&row);
+	result = table.project(long_handle);
+	overflow_ok = overflow_ok && (*result)["b"].text() == row["b"].text() && (*result)["a"] == Value(-8);
+	delete result;
+	where.clear();
+	where["b"] = row["b"];
+	overflow_ok = overflow_ok && test_count(table.cursor(&where)) == 1;
+	where["b"] = Value(string(10000, 'x') + "End");
+	overflow_ok = overflow_ok && test_count(table.cursor(&where)) == 0;
+	where.clear();
+	where["a"] = Value(-8);
+	handles = table.select(&where);
+	ValueDicts *results = table.project(handles, &just_a);
+	overflow_ok = overflow_ok && results->size() == 1 && (*results->front())["a"] == Value(-8);
+	for (ValueDict *dict: *results)
+		delete dict;
+	delete results;
+	delete handles;
+	HeapFile chunks("_test_data_cpp.toast");  // the overflow's chunks, deleted with the row, make room for the next ones
+	chunks.open();
+	BlockID chunk_blocks = chunks.get_last_block_id();
+	table.del(long_handle);
+	long_handle = table.insert(&row);
+	chunks.close();
+	chunks.open();
+	overflow_ok = overflow_ok && chunk_blocks >= 3 && chunks.get_last_block_id() == chunk_blocks;
+	chunks.close();
+	result = table.project(long_handle);
+	overflow_ok = overflow_ok && (*result)["b"].text() == row["b"].text();
+	delete result;
+	{
+		// a row still too big for a block once its long TEXT is out is turned away before any goes in
+		ColumnNames crowded_names{"b", "c"};
+		ColumnAttributes crowded_attributes{ColumnAttribute(ColumnAttribute::TEXT), ColumnAttribute(ColumnAttribute::TEXT)};
+		ValueDict crowded_row;
+		crowded_row["b"] = Value(string(10000, 'y'));
+		crowded_row["c"] = Value("abcde");
+		for (int i = 0; i < 958; i++) {
+			crowded_names.push_back("i" + to_string(i));
+			crowded_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+			crowded_row["i" + to_string(i)] = Value(i);
+		}
+		HeapTable crowded("_test_crowded_cpp", crowded_names, crowded_attributes);
+		crowded.create();
+		try {
+			crowded.insert(&crowded_row);
+			overflow_ok = false;
+		} catch (DbRelationError &e) {
+		}
+		overflow_ok = overflow_ok && !test_file_exists("_test_crowded_cpp.toast");
+		crowded.drop();
+	}
+	cout << "overflow " << (overflow_ok ? "ok" : "failed") << endl;
+	if (!overflow_ok)
+		return false;
+
+	// a compressed table packs its blocks, which another HeapTable on it finds out when it opens it
+	{
+		HeapTable packed("_test_packed_cpp", column_names, column_attributes);
+		packed.set_compressed(true);
+		packed.create();
+		for (int i = 0; i < 1000; i++) {
+			row["a"] = Value(i);
+			row["b"] = Value("the same old words, row " + to_string(i % 10));
+			packed.insert(&row);
+		}
+		packed.close();
+	}
+	HeapTable packed("_test_packed_cpp", column_names, column_attributes);
+	where.clear();
+	where["b"] = Value("the same old words, row 3");
+	bool packed_ok = test_count(packed.cursor(&where)) == 100;
+	HeapFile packed_file("_test_packed_cpp");
+	packed_file.open();
+	packed_ok = packed_ok && packed_file.is_compressed() && packed_file.get_last_block_id() > 5
+	            && packed_file.get_stored_size() * 2 < packed_file.get_last_block_id() * packed_file.get_block_size();
+	packed_file.close();
+	packed.drop();
+	char noise[DbBlock::BLOCK_SZ], unpacked[DbBlock::BLOCK_SZ];  // nothing to squeeze out of it
+	uint32_t seed = 1;
+	for (char &byte: noise) {
+		seed = seed * 1103515245 + 12345;
+		byte = (char)(seed >> 24);
+	}
+	std::vector<char> noise_packed(PageCodec::bound(DbBlock::BLOCK_SZ));
+	uint noise_size = PageCodec::encode(noise, DbBlock::BLOCK_SZ, noise_packed.data());
+	PageCodec::decode(noise_packed.data(), noise_size, unpacked, DbBlock::BLOCK_SZ);
+	packed_ok = packed_ok && noise_packed[0] == (char)PageCodec::STORED && memcmp(noise, unpacked, sizeof(noise)) == 0;
+	cout << "compression " << (packed_ok ? "ok" : "failed") << endl;
+	if (!packed_ok)
+		return false;
+
+	table.drop();
+
+	return true;
+}
+
+// Scan speed and size of a text-heavy table, stored as is and compressed. Each scan starts with
+// the table just opened, so every block is read from the file (and unpacked).
+void benchmark_heap_compression() {
+	ColumnNames column_names{"id", "title", "notes"};
+	ColumnAttributes column_attributes{ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT),
+	                                   ColumnAttribute(ColumnAttribute::TEXT)};
+	const char *words[] = {"order", "shipped", "to", "the", "customer", "returned", "pending", "invoice", "of",
+	                       "warehouse", "delayed", "priority"};
+	const int rows = 20000, scans = 5;
+	for (bool compressed: {false, true}) {
+		HeapTable table(compressed ? "_bench_packed_cpp" : "_bench_plain_cpp", column_names, column_attributes);
+		table.set_compressed(compressed);
+		table.create();
+		ValueDict row;
+		uint32_t seed = 1;
+		for (int i = 0; i < rows; i++) {
+			string notes;
+			for (int word = 0; word < 20; word++) {
+				seed = seed * 1103515245 + 12345;
+				notes += words[(seed >> 16) % 12];
+				notes += ' ';
+			}
+			row["id"] = Value(i);
+			row["title"] = Value("item " + to_string(i));
+			row["notes"] = Value(notes);
+			table.insert(&row);
+		}
+		table.close();
+
+		ValueDict where;
+		where["notes"] = Value("nothing like any of them");  // so every row's notes are looked at
+		double seconds = 0;
+		for (int scan = 0; scan < scans; scan++) {
+			auto start = chrono::steady_clock::now();
+			test_count(table.cursor(&where));
+			seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			table.close();
+		}
+		HeapFile file(compressed ? "_bench_packed_cpp" : "_bench_plain_cpp");
+		file.open();
+		cout << (compressed ? "compressed: " : "plain:      ") << file.get_last_block_id() << " blocks, "
+		     << file.get_stored_size() / 1024 << " kB stored, scan " << (u_long)(rows * scans / seconds) << " rows/s"
+		     << endl;
+		file.close();
+		table.drop();
+	}
+}
+
+// Rows/s of filling a heap table, deleting every other row and putting half as many back, and the
+// blocks the table takes before the deletes and after the reinserts; the new rows should fit in the
+// room the deletes freed up, and take the slots of the deleted ones.
+void benchmark_heap_reuse() {
+	ColumnNames column_names{"a", "b"};
+	ColumnAttributes column_attributes{ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)};
+	const int rows = 100000;
+	HeapTable table("_bench_reuse_cpp", column_names, column_attributes);
+	table.create();
+	ValueDict row;
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < rows; i++) {
+		row["a"] = Value(i);
+		row["b"] = Value("text " + to_string(i));
+		table.insert(&row);
+	}
+	double insert_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	Handles *handles = table.select();
+	BlockID before = handles->back().first;
+	start = chrono::steady_clock::now();
+	for (size_t i = 0; i < handles->size(); i += 2)
+		table.del((*handles)[i]);
+	double delete_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	delete handles;
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < rows / 2; i++) {
+		row["a"] = Value(i);
+		row["b"] = Value("text " + to_string(i));
+		table.insert(&row);
+	}
+	double reinsert_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	handles = table.select();
+	BlockID after = 0;
+	for (auto const& handle: *handles)
+		after = max(after, handle.first);
+	delete handles;
+	table.close();
+	HeapFile file("_bench_reuse_cpp");
+	file.open();
+	u_long slots = 0;  // in the blocks' directories, deleted records' included
+	for (BlockID block_id = 1; block_id <= file.get_last_block_id(); block_id++) {
+		SlottedPage *block = file.get(block_id);
+		slots += block->get_num_records();
+		file.unpin(block);
+	}
+	file.close();
+	cout << "insert " << (u_long)(rows / insert_seconds) << " rows/s, delete " << (u_long)(rows / 2 / delete_seconds)
+	     << " rows/s, reinsert " << (u_long)(rows / 2 / reinsert_seconds) << " rows/s, " << before << " blocks -> "
+	     << after << ", " << slots << " slots for " << rows << " rows" << endl;
+	table.drop();
+}
@@ -18,17 +18,51 @@
  *      Manage a database block that contains several records.
         Modeled after slotted-page from Database Systems Concepts, 6ed, Figure 10-9.
 
-        Record id are handed out sequentially starting with 1 as records are added with add().
+        Record ids start with 1. add() hands out the lowest id whose record was deleted, if there is
+        one, and otherwise the next one after the last; deleting the last record gives its slot back
+        to the free space, along with the slots of any deleted records right before it.
         Each record has a header which is a fixed offset from the beginning of the block:
             Bytes 0x00 - Ox01: number of records
             Bytes 0x02 - 0x03: offset to end of free space
             Bytes 0x04 - 0x05: size of record 1
             Bytes 0x06 - 0x07: offset to record 1
             etc.
+        The top bit of a record's size is a mark that is left for whoever owns the block to use
+        (see mark() and is_marked()); a record starts out unmarked. Sizes and offsets are 16 bits even
+        in the biggest blocks a file can have (DbBlock::MAX_BLOCK_SZ), since no record or offset in
+        them needs the top bit.
+        Deleting or shrinking a record just leaves a gap where its bytes were. The gaps are only
+        closed up, all at once, when a record needs more contiguous room than the free space has
+        (see compact()); until then they count as free space. How many bytes they add up to, where
+        the first deleted record's slot is, and how many records are live are worked out from the
+        headers when a block is read in.
+        The live records can be walked, in id order, with begin() and end() (or a range-based for),
+        which hand out Records that point right into the block, without allocating anything.
  *
  */
 class SlottedPage : public DbBlock {
 public:
+	// A live record where it sits in the block; good while the block is pinned and left alone.
+	struct Record {
+		RecordID id;
+		const char *data;
+		uint16_t size;
+	};
+
+	// Forward iterator over the live records of a block.
+	class Iterator {
+	public:
+		Iterator(const SlottedPage &page, RecordID id) : page(page), record{id, nullptr, 0} { settle(); }
+		const Record &operator*() const { return this->record; }
+		const Record *operator->() const { return &this->record; }
+		Iterator &operator++() { this->record.id++; settle(); return *this; }
+		bool operator!=(const Iterator &other) const { return this->record.id != other.record.id; }
+	protected:
+		const SlottedPage &page;
+		Record record;
+		void settle();  // on to the first live record from here on, if any
+	};
+
 	SlottedPage(Dbt &block, BlockID block_id, bool is_new=false);
 	// Big 5 - we only need the destructor, copy-ctor, move-ctor, and op= are unnecessary
 	// but we delete them explicitly just to make sure we don't use them accidentally
@@ -40,32 +74,176 @@ public:
 
 	virtual RecordID add(const Dbt* data) throw(DbBlockNoRoomError);
 	virtual Dbt* get(RecordID record_id) const;
+	bool get(RecordID record_id, Dbt &data) const;  // points data into the block; false if deleted
 	virtual void put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError);
 	virtual void del(RecordID record_id);
+	void insert_at(RecordID record_id, const Dbt* data) throw(DbBlockNoRoomError);  // renumbers later records up
+	void remove_at(RecordID record_id);  // renumbers later records down
 	virtual RecordIDs* ids(void) const;
     virtual void clear();
-    virtual u_int16_t size() const;
+    virtual u_int16_t size() const { return this->live; }
+    u_int16_t get_num_records() const { return this->num_records; }  // deleted ones included
+    Iterator begin() const { return Iterator(*this, 1); }
+    Iterator end() const { return Iterator(*this, this->num_records + 1U); }
+    u_int16_t get_free_space() const;  // bytes left for new records, headers included
+    bool is_marked(RecordID record_id) const;
+    void mark(RecordID record_id, bool marked=true);
 
 protected:
+	static const uint16_t MARK = 0x8000;  // in a record's size
+
 	uint16_t num_records;
 	uint16_t end_free;
+	uint16_t fragmented;  // bytes in the gaps among the records
+	uint16_t free_slot;  // no deleted record's slot comes before this id
+	uint16_t live;  // records that aren't deleted
 
 	virtual void get_header(uint16_t &size, uint16_t &loc, RecordID id=0) const;
 	virtual void put_header(RecordID id=0, uint16_t size=0, uint16_t loc=0);
 	virtual bool has_room(uint16_t size) const;
-	virtual void slide(uint16_t start, uint16_t end);
+	virtual uint16_t allocate(uint16_t size);
+	virtual void release(uint16_t loc, uint16_t size);
+	virtual void erase(RecordID record_id);
+	virtual void compact();
+	virtual void count_free();
 	virtual uint16_t get_n(uint16_t offset) const;
 	virtual void put_n(uint16_t offset, uint16_t n);
 	virtual void* address(uint16_t offset) const;
 };
 
+/**
+ * @class PageCodec - how the blocks of a compressed HeapFile are packed for the file
+ *
+ * A packed block starts with a header: the method (u8), then the block size (u16). LZ is LZ77 in the
+ * manner of LZ4: a run of sequences, each a token byte (the literal count in the top four bits, the
+ * match length less MIN_MATCH in the bottom four, either one carried on in bytes that follow, 255 at a
+ * time, when it's 15 or more), the literals, and then the match's offset back (u16). The last
+ * sequence is just literals. The zeros of a block's free space come out as a single long match, and
+ * repeated words and values in the records as short ones. A block that LZ can't make any smaller is
+ * STORED as it is.
+ */
+class PageCodec {
+public:
+	static const uint8_t STORED = 0;
+	static const uint8_t LZ = 1;
+	static const uint HEADER_SIZE = 3;
+	static const uint MIN_MATCH = 4;
+
+	static uint bound(uint block_size) { return HEADER_SIZE + block_size; }  // most encode() ever writes
+	static uint encode(const char *block, uint block_size, char *packed);  // returns the packed size
+	static void decode(const char *packed, uint packed_size, char *block, uint block_size);  // throws if it's corrupt
+	static uint get_block_size(const char *packed) { return *(const uint16_t*)(packed + 1); }
+
+protected:
+	static uint compress(const char *block, uint block_size, char *out, uint limit);  // 0 if limit is too few bytes
+};
+
+/**
+ * @class BufferPool - fixed set of in-memory block frames for a HeapFile
+ *
+ * Frames are keyed by BlockID and replaced with the clock algorithm; a pinned frame is never
+ * replaced. A frame marked dirty is written back when its last pin is released, so unpinned
+ * frames are always clean and can be replaced without any I/O. Every HeapFile open on the
+ * same Berkeley DB file shares the same pool, so they all see the same SlottedPage objects.
+ * The pool of a compressed file packs blocks on their way out and unpacks them on the way in (see
+ * PageCodec), so the frames always hold them as they are.
+ */
+class BufferPool {
+public:
+	/**
+	 * number of frames given to each file's pool (only affects pools created afterwards)
+	 */
+	static uint capacity;
+
+	/**
+	 * running counters for sizing the pool
+	 */
+	struct Stats {
+		Stats() : hits(0), misses(0), evictions(0) {}
+		uint64_t hits;       // get() found the block already in a frame
+		uint64_t misses;     // get() had to read the block with Db::get
+		uint64_t evictions;  // a resident block was replaced to make room
+	};
+
+	BufferPool(uint capacity, uint block_size=DbBlock::BLOCK_SZ, bool compressed=false);
+	virtual ~BufferPool();
+	BufferPool(const BufferPool& other) = delete;
+	BufferPool(BufferPool&& temp) = delete;
+	BufferPool& operator=(const BufferPool& other) = delete;
+	BufferPool& operator=(BufferPool&& temp) = delete;
+
+	/**
+	 * Pin a block, reading it from db if it isn't already resident.
+	 * @param db        open Berkeley DB file the block lives in
+	 * @param block_id  which block
+	 * @returns         the block (still owned by the pool)
+	 */
+	virtual SlottedPage* pin(Db &db, BlockID block_id);
+
+	/**
+	 * Pin a freshly formatted empty block, writing it through to db.
+	 * @param db        open Berkeley DB file the block lives in
+	 * @param block_id  id of the new block
+	 * @returns         the block (still owned by the pool)
+	 */
+	virtual SlottedPage* pin_new(Db &db, BlockID block_id);
+
+	/**
+	 * Note that a pinned block has been changed and must be written back.
+	 * @param block  the changed block
+	 * @returns      false if block isn't one of ours
+	 */
+	virtual bool mark_dirty(DbBlock* block);
+
+	/**
+	 * Release one pin on a block, writing it back to db if this was the last pin on a dirty block.
+	 * @param db     open Berkeley DB file the block lives in
+	 * @param block  the block to release
+	 */
+	virtual void unpin(Db &db, DbBlock* block);
+
+	/**
+	 * Write back every dirty frame.
+	 * @param db  open Berkeley DB file the blocks live in
+	 */
+	virtual void flush(Db &db);
+
+	const Stats& get_stats() const { return stats; }
+
+	uint users;  // number of open HeapFiles sharing this pool
+
+protected:
+	struct Frame {
+		BlockID block_id;    // 0 if the frame is empty
+		SlottedPage* page;
+		char* data;
+		uint pin_count;
+		bool dirty;
+		bool referenced;     // second-chance bit for the clock
+	};
+	uint block_size;  // of the file, so of each frame
+	bool compressed;  // the file's blocks are packed with PageCodec
+	std::vector<char> packed;  // a block on its way out, packed
+	std::vector<Frame> frames;
+	std::map<BlockID, uint> resident;  // block id -> index into frames
+	uint hand;
+	Stats stats;
+
+	virtual uint victim();
+	virtual void write(Db &db, Frame &frame);
+};
+
 /**
  * @class HeapFile - heap file implementation of DbFile
  *
  * Heap file organization. Built on top of Berkeley DB RecNo file. There is one of our
         database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
-        for buffer management and file management.
+        for file management and keeping our own BufferPool of blocks in front of it.
         Uses SlottedPage for storing records within blocks.
+        The blocks are DbBlock::BLOCK_SZ unless the file is created with bigger ones (see
+        set_block_size()). The size is the RecNo file's record length, so it is kept with the file.
+        A file can instead be created compressed (see set_compressed()), with records of whatever
+        length its blocks pack down to; the block size is then in each packed block's header.
  */
 class HeapFile : public DbFile {
 public:
@@ -83,8 +261,45 @@ public:
 	virtual SlottedPage* get_new(void);
 	virtual SlottedPage* get(BlockID block_id);
 	virtual void put(DbBlock* block);
+	virtual void unpin(DbBlock* block);
 	virtual BlockIDs* block_ids() const;
 
+	/**
+	 * Choose the size of the blocks of a file that is yet to be created.
+	 * @param block_size  a power of two from DbBlock::BLOCK_SZ through DbBlock::MAX_BLOCK_SZ
+	 */
+	virtual void set_block_size(uint block_size);
+
+	/**
+	 * Size of the file's blocks (only known for sure once it's open).
+	 * @returns  bytes per block
+	 */
+	virtual uint get_block_size() const {return block_size;}
+
+	/**
+	 * Choose whether a file that is yet to be created packs its blocks (see PageCodec).
+	 * @param compressed  true to pack them
+	 */
+	virtual void set_compressed(bool compressed) {this->compressed = compressed;}
+
+	/**
+	 * Whether the file's blocks are packed (only known for sure once it's open).
+	 * @returns  true if they are
+	 */
+	virtual bool is_compressed() const {return compressed;}
+
+	/**
+	 * Bytes the file's blocks take up as they are stored, less Berkeley DB's own overhead.
+	 * @returns  the total of the records' lengths
+	 */
+	virtual u_long get_stored_size();
+
+	/**
+	 * Hit/miss/eviction counters of this file's buffer pool.
+	 * @returns  the counters (all zero if the file isn't open)
+	 */
+	virtual BufferPool::Stats get_buffer_stats() const;
+
 	/**
 	 * Get the id of the current final block in the heap file.
 	 * @returns  block id of last block
@@ -95,16 +310,260 @@ protected:
 	std::string dbfilename;
 	uint32_t last;
 	bool closed;
+	uint block_size;
+	bool compressed;
 	Db db;
+	BufferPool* pool;
+	static std::map<std::string, BufferPool*> pools;  // shared pools keyed by dbfilename
 	virtual void db_open(uint flags=0);
 	virtual uint32_t get_block_count();
 };
 
+/**
+ * @class FreeSpaceMap - roughly how much room each block of a HeapTable's file has left
+ *
+ * One byte per block: its free space (SlottedPage::get_free_space) in units of a 256th of the
+ * table's block size (16 bytes for the usual 4kB blocks), rounded down, so a block the map picks for a record has room for it unless the map is out of date. The
+ * bytes are kept in a HeapFile of their own, PER_BLOCK blocks' worth as the one record in each of
+ * its blocks. Changes that free up room are written through. The ones from filling blocks up just
+ * change the map block in the buffer pool (it goes out whenever the map block is next written), since
+ * a map that thinks a block has more room than it does only costs a failed add, after which the map
+ * is put right. When a map is opened, any blocks it doesn't cover yet are looked at and added. The
+ * map isn't made until a delete first frees up room in the table (see make), which many tables never
+ * do; until then the table only grows at its end, so find() just looks at its last block.
+ */
+class FreeSpaceMap {
+public:
+	static const u_long PER_BLOCK = DbBlock::BLOCK_SZ - 64;  // table blocks each map block covers
+
+	FreeSpaceMap(std::string name);
+	virtual ~FreeSpaceMap() {}
+	FreeSpaceMap(const FreeSpaceMap& other) = delete;
+	FreeSpaceMap(FreeSpaceMap&& temp) = delete;
+	FreeSpaceMap& operator=(const FreeSpaceMap& other) = delete;
+	FreeSpaceMap& operator=(FreeSpaceMap&& temp) = delete;
+
+	virtual void create();
+	virtual void drop();
+	virtual void open(HeapFile &table_file);  // catches the map, if there is one yet, up with table_file
+	virtual void close();
+
+	virtual void set(BlockID block_id, uint16_t free_space, bool durable=true);
+	virtual BlockID find(uint16_t size);  // a block with room for a record of size, or 0
+
+protected:
+	HeapFile file;
+	HeapFile *table_file;  // the table's, as of open()
+	bool closed;
+	bool made;  // whether there is a map file yet
+	BlockID mapped;  // table blocks the map covers, from 1 up
+	BlockID recent;  // what find() came up with last time
+	u_long bucket;  // bytes of free space per unit
+
+	virtual void make();
+	virtual BlockID count_mapped();
+	virtual void catch_up();
+	virtual uint8_t get_units(BlockID block_id);
+	virtual void extend(const std::vector<uint8_t> &units);  // add entries for the next blocks
+};
+
+/**
+ * @class TextOverflow - where a HeapTable keeps the TEXT values too long to go in its rows
+ *
+ * A value is cut into chunks of all but a sliver of a block (as much as the FreeSpaceMap can find an
+ * emptied block for), each a record that starts with the block id (u32) and record id (u16) of the
+ * next chunk (block 0 after the last one). The
+ * chunks go in a HeapFile of their own, <table>.toast, with a FreeSpaceMap so a value's short last
+ * chunk can share a block with others. The file is only made when the first value goes in. In the
+ * row, the value is replaced by a POINTER_SIZE pointer: its first chunk's block id and record id,
+ * then the value's size (u16).
+ */
+class TextOverflow {
+public:
+	static const uint16_t POINTER_SIZE = 8;
+
+	TextOverflow(std::string name);
+	virtual ~TextOverflow() {}
+	TextOverflow(const TextOverflow& other) = delete;
+	TextOverflow(TextOverflow&& temp) = delete;
+	TextOverflow& operator=(const TextOverflow& other) = delete;
+	TextOverflow& operator=(TextOverflow&& temp) = delete;
+
+	virtual void create();
+	virtual void drop();
+	virtual void open(HeapFile &table_file);  // whose block size and compression the file gets when it's made
+	virtual void close();
+
+	virtual void put(const char *data, uint16_t size, char *pointer);  // fills in the value's pointer
+	virtual void get(const char *pointer, std::string &text);
+	virtual void del(const char *pointer);
+	static uint16_t get_size(const char *pointer) { return *(const uint16_t*)(pointer + 6); }  // of the value
+
+protected:
+	HeapFile file;
+	FreeSpaceMap free_space;
+	HeapFile *table_file;  // the table's, as of open()
+	bool closed;
+	bool made;  // whether the file is there and open
+
+	virtual void make();
+	virtual Handle add(const char *data, uint16_t size, Handle next);  // one chunk
+};
+
+/**
+ * @class RowFormat - how a HeapTable lays its rows out in records
+ *
+ * Records from before there were row format versions just have the columns back to back, each TEXT
+ * preceded by its length, so getting to a column means walking over all the ones before it; columns
+ * past the end of such a record (added to the table after it was written) are NULL. Records
+ * in a versioned format are marked in their block (see SlottedPage::mark) and start with the version.
+ * Version 2 then has the end offset (u16, from the start of the record) of each TEXT column's value,
+ * then the INT and BOOLEAN columns at fixed offsets, then the TEXT values one after another, so any
+ * column can be found straight off. Version 3 is the same but for a bitmap of the NULL columns right
+ * after the version byte (bit i%8 of byte i/8 for column i); a NULL takes no room for TEXT and is
+ * zeroed for the others. Version 4 adds a second bitmap just like it, right after the first, of the
+ * TEXT columns whose value is a pointer into a TextOverflow instead of the value itself.
+ */
+class RowFormat {
+public:
+	static const uint8_t VERSION = 3;  // what marshal writes
+	static const uint8_t VERSION_NO_NULLS = 2;  // still read
+	static const uint8_t VERSION_OUTSIDE = 4;  // what marshal writes when some TEXT is kept outside
+
+	RowFormat(const ColumnAttributes &column_attributes);
+
+	const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+	u_long size(const Value *values) const;  // of the record for values (less the second bitmap); throws if a TEXT is too long
+	void marshal(const Value *values, char *bytes,
+	             const uint8_t *outside=nullptr) const;  // bytes has room for size(values); outside is a bitmap like the NULL one
+	const char *get_column(const char *bytes, u_long record_size, bool versioned, uint col_num,
+	                       uint16_t &size) const;  // nullptr for NULL
+	bool is_outside(const char *bytes, bool versioned, uint col_num) const;  // value is a TextOverflow pointer
+
+protected:
+	ColumnAttributes column_attributes;
+	std::vector<uint16_t> places;  // for each column, its offset if it's fixed-width, or which TEXT column it is
+	uint16_t nulls;  // bytes in the NULL bitmap
+	uint16_t texts;  // number of TEXT columns
+	uint16_t text_start;  // where the TEXT values start
+};
+
+/**
+ * @class RecordView - a HeapTable record read in place, right where it sits (typically a pinned block)
+ * Nothing is copied or allocated, except for TEXT kept outside the record, which is only fetched from
+ * the overflow when it's asked for.
+ */
+class RecordView {
+public:
+	RecordView(const RowFormat &format, const Dbt &record, bool versioned, TextOverflow *overflow=nullptr)
+		: format(format), bytes((const char*)record.get_data()), record_size(record.get_size()),
+		  versioned(versioned), overflow(overflow) {}
+
+	bool is_versioned() const { return versioned; }
+	const char *get_data() const { return bytes; }
+	u_long get_size() const { return record_size; }
+	bool is_outside(uint col_num) const { return format.is_outside(bytes, versioned, col_num); }
+	const char *get_column(uint col_num, uint16_t &size) const {  // start of the column's value (or pointer), and its size
+		return format.get_column(bytes, record_size, versioned, col_num, size);
+	}
+	const char *get_column(uint col_num, uint16_t &size, std::string &fetched) const;  // TEXT kept outside goes in fetched
+	Value get(uint col_num, bool view=false) const;  // a view borrows its TEXT from the record; NULL is Value::null
+	bool equals(uint col_num, const Value &value) const;  // same as Value::operator==, on the raw bytes
+
+protected:
+	const RowFormat &format;
+	const char *bytes;
+	u_long record_size;
+	bool versioned;
+	TextOverflow *overflow;  // where TEXT kept outside the record is
+};
+
+/**
+ * @class ColumnVector - one column's values for a batch of rows, as plain arrays indexed by row
+ *
+ * Only the arrays for the column's type are set (TEXT has both texts and sizes). They point either
+ * straight into a block that is laid out that way already (see ColumnPage::get_vector), or at the
+ * values gathered here with gather() and set(). Gathered TEXT still points into wherever it came from.
+ */
+class ColumnVector {
+public:
+	const int32_t *ints;  // INT
+	const uint8_t *bools;  // BOOLEAN
+	const char *const *texts;  // TEXT
+	const uint16_t *sizes;  // TEXT
+	const uint8_t *nulls;  // 1 for each NULL, or nullptr if there are none
+
+	ColumnVector() : ints(nullptr), bools(nullptr), texts(nullptr), sizes(nullptr), nulls(nullptr), data_type(),
+	                 int_values(), bool_values(), text_values(), size_values(), null_values() {}
+	ColumnVector(const ColumnVector& other) = delete;
+	ColumnVector(ColumnVector&& temp) = default;
+	ColumnVector& operator=(const ColumnVector& other) = delete;
+	ColumnVector& operator=(ColumnVector&& temp) = default;
+
+	void gather(ColumnAttribute::DataType data_type, size_t n);  // make room for a batch of n rows
+	void set(size_t row, const char *data, uint16_t size);  // a value, as RecordView::get_column gives it
+
+protected:
+	ColumnAttribute::DataType data_type;
+	std::vector<int32_t> int_values;
+	std::vector<uint8_t> bool_values;
+	std::vector<const char*> text_values;
+	std::vector<uint16_t> size_values;
+	std::vector<uint8_t> null_values;
+};
+
+/**
+ * @class BatchFilter - a where clause's equalities and ranges, checked a whole batch of rows at a time
+ *
+ * The storage engine hands over the values of each column the filter asks for (see get_columns) as a
+ * ColumnVector, one column after another, and the filter narrows a selection of one byte per row with
+ * that column's conditions. Rows already ruled out needn't have their later columns filled in at all.
+ * Each condition on INT or BOOLEAN is a branch-free loop over the array that the compiler vectorizes.
+ * The answers are the same as Value::operator== and ValueRange::contains give.
+ */
+class BatchFilter {
+public:
+	BatchFilter(const ColumnNames &column_names, const ColumnAttributes &column_attributes,
+	            const ValueDict *where, const ValueRanges *ranges=nullptr);  // throws for unknown columns
+
+	bool empty() const { return this->conditions.empty() && !this->never; }
+	const std::vector<uint> &get_columns() const { return this->columns; }  // each needed column number, once
+	void filter(uint vector, const ColumnVector &values, size_t n,
+	            uint8_t *selected) const;  // checks column get_columns()[vector]; clears selected[i] for non-matches
+
+protected:
+	enum Test {EQUAL, AT_LEAST, AT_MOST, NOT_NULL};
+	struct Condition {
+		uint vector;  // index into columns
+		ColumnAttribute::DataType data_type;
+		Test test;
+		const Value *value;
+		bool inclusive;  // for AT_LEAST and AT_MOST on TEXT (the others are made inclusive)
+		int32_t bound;  // for INT and BOOLEAN
+	};
+
+	std::vector<uint> columns;
+	std::vector<Condition> conditions;
+	bool never;  // some condition can't hold for any row (it compares across types)
+
+	uint vector_for(const ColumnNames &column_names, const Identifier &column_name);
+	void add(const ColumnAttributes &column_attributes, uint vector, Test test, const Value &value, bool inclusive);
+};
+
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ * New rows go into whichever block the table's FreeSpaceMap says has room for them, so the room
+ * deletes free up gets used again before the file grows. A table of wide rows can be created with
+ * bigger blocks (see set_block_size()). The longest TEXT values of a row that would take up more
+ * than a quarter of a block are moved out to the table's TextOverflow, so that rows of any length
+ * fit and scans that don't look at those columns needn't read them. A table that is mostly text and
+ * seldom changed can be created compressed (see set_compressed()), taking up less room at the cost of
+ * packing and unpacking blocks as they go to and from the file.
  */
 
 class HeapTable : public DbRelation {
+	friend class HeapTableCursor;
 public:
 	HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes );
 	virtual ~HeapTable() {}
@@ -116,6 +575,12 @@ public:
 	virtual void create();
 	virtual void create_if_not_exists();
 	virtual void drop();
+	virtual void set_block_size(uint block_size) {  // for create()
+		file.set_block_size(block_size);
+	}
+	virtual void set_compressed(bool compressed) {  // for create()
+		file.set_compressed(compressed);
+	}
 
 	virtual void open();
 	virtual void close();
@@ -127,18 +592,74 @@ public:
 	virtual Handles* select();
 	virtual Handles* select(const ValueDict* where);
 	virtual Handles* select(Handles *current_selection, const ValueDict* where);
+	virtual DbCursor* cursor(const ValueDict* where=nullptr, const ValueRanges* ranges=nullptr);
+	using DbRelation::cursor;
 	virtual ValueDict* project(Handle handle);
 	virtual ValueDict* project(Handle handle, const ColumnNames* column_names);
+	virtual ValueDicts* project(Handles* handles);
+	virtual ValueDicts* project(Handles* handles, const ColumnNames* column_names);
+	virtual void project(Handle handle, Row &row);
+	virtual void project(Handles* handles, RowLayoutPtr layout, Rows &rows);
 	using DbRelation::project;
 
+	/**
+	 * Buffer pool counters for the underlying heap file.
+	 * @returns  hit/miss/eviction counts so far
+	 */
+	virtual BufferPool::Stats get_buffer_stats() const { return file.get_buffer_stats(); }
+
 protected:
 	HeapFile file;
-	virtual ValueDict* validate(const ValueDict* row) const;
-	virtual Handle append(const ValueDict* row);
-	virtual Dbt* marshal(const ValueDict* row) const;
-	virtual ValueDict* unmarshal(Dbt* data) const;
+	FreeSpaceMap free_space;
+	TextOverflow overflow;
+	RowFormat format;
+	RowLayoutPtr layout;  // all our columns, in order
+	virtual Row* validate(const ValueDict* row) const;
+	virtual Handle append(const Row* row);
+	virtual Dbt* marshal(const Row* row);
+	virtual void del_outside(const RecordView &record);
+	virtual void unmarshal(const RecordView &record, const std::vector<int> &slots, Value *values) const;
+	virtual const std::vector<int> &slots_for(const RowLayout &layout) const;
+
+	typedef std::vector<std::pair<uint, const Value*>> Equalities;  // column number, value it must equal
+	virtual void resolve(const ValueDict* where, Equalities &equalities) const;
 	virtual bool selected(Handle handle, const ValueDict* where);
+	virtual bool selected(const RecordView &record, const Equalities &equalities) const;
+};
+
+/**
+ * @class HeapTableCursor - DbCursor that scans a HeapTable one block at a time
+ *
+ * Only the records of the block currently being scanned are held in memory. The where clause
+ * and ranges are checked for a whole block at a time, with a BatchFilter.
+ * Blocks appended after open() are not visited.
+ */
+class HeapTableCursor : public DbCursor {
+public:
+	HeapTableCursor(HeapTable &table, const ValueDict* where, const ValueRanges* ranges=nullptr);
+	virtual ~HeapTableCursor();
+	HeapTableCursor(const HeapTableCursor& other) = delete;
+	HeapTableCursor& operator=(const HeapTableCursor& other) = delete;
+
+	virtual void open();
+	virtual bool next(Handle &handle);
+	virtual void close();
+
+protected:
+	HeapTable &table;
+	BatchFilter filter;      // from the where clause and ranges
+	ColumnVector values;     // the current block's values of one of the filter's columns
+	std::vector<uint8_t> selected;      // which of the current block's records the filter keeps
+	std::vector<std::string> fetched;   // the current block's values of TEXT kept in the table's overflow
+	BlockID block_id;        // block currently being scanned (0 before the first one)
+	BlockID last_block_id;   // final block as of open()
+	std::vector<SlottedPage::Record> records;  // matching records in the current block (their data only while it's pinned)
+	size_t position;         // next index into records
+	virtual bool next_block();
 };
 
 bool test_heap_storage();
+void benchmark_heap_compression();
+void benchmark_heap_reuse();
+u_long test_count(DbCursor *cursor);  // rows the cursor comes up with; deletes it
 
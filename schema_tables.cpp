@@ -6,6 +6,8 @@
 #include "schema_tables.h"
 #include "ParseTreeToString.h"
 #include "btree.h"
+#include "hash_index.h"
+#include "column_storage.h"
 
 void initialize_schema_tables() {
     Tables tables;
@@ -49,25 +51,29 @@ const Identifier Tables::TABLE_NAME = "_tables";
 Columns* Tables::columns_table = nullptr;
 std::map<Identifier,DbRelation*> Tables::table_cache;
 
-// get the column name for _tables column
+// get the column names for _tables columns
 ColumnNames& Tables::COLUMN_NAMES() {
     static ColumnNames cn;
-    if (cn.empty())
+    if (cn.empty()) {
         cn.push_back("table_name");
+        cn.push_back("storage");
+    }
     return cn;
 }
 
-// get the column attribute for _tables column
+// get the column attributes for _tables columns
 ColumnAttributes& Tables::COLUMN_ATTRIBUTES() {
     static ColumnAttributes cas;
     if (cas.empty()) {
         ColumnAttribute ca(ColumnAttribute::TEXT);
         cas.push_back(ca);
+        cas.push_back(ca);
     }
     return cas;
 }
 
-// ctor - we have a fixed table structure of just one column: table_name
+// ctor - we have a fixed table structure: table_name and storage (NULL for the schema tables and
+// tables from before there was a choice, which are all heap tables)
 Tables::Tables() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
     Tables::table_cache[TABLE_NAME] = this;
     if (Tables::columns_table == nullptr)
@@ -90,11 +96,13 @@ void Tables::create() {
 // Manually check that table_name is unique.
 Handle Tables::insert(const ValueDict* row) {
     // Try SELECT * FROM _tables WHERE table_name = row["table_name"] and it should return nothing
-    Handles* handles = select(row);
+    ValueDict where;
+    where["table_name"] = row->at("table_name");
+    Handles* handles = select(&where);
     bool unique = handles->empty();
     delete handles;
     if (!unique)
-        throw DbRelationError(row->at("table_name").s + " already exists");
+        throw DbRelationError(row->at("table_name").text() + " already exists");
     return HeapTable::insert(row);
 }
 
@@ -103,7 +111,7 @@ Handle Tables::insert(const ValueDict* row) {
 void Tables::del(Handle handle) {
     // remove from cache, if there
     ValueDict* row = project(handle);
-    Identifier table_name = row->at("table_name").s;
+    Identifier table_name = row->at("table_name").text();
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end()) {
         DbRelation* table = Tables::table_cache.at(table_name);
         Tables::table_cache.erase(table_name);
@@ -123,15 +131,15 @@ void Tables::get_columns(Identifier table_name, ColumnNames &column_names, Colum
     for (auto const& handle: *handles) {
         ValueDict* row = Tables::columns_table->project(handle);  // get the row's values: {'column_name': <name>, 'data_type': <type>}
 
-        Identifier column_name = (*row)["column_name"].s;
+        Identifier column_name = (*row)["column_name"].text();
         column_names.push_back(column_name);
 
         ColumnAttribute::DataType data_type;
-        if ((*row)["data_type"].s == "INT")
+        if ((*row)["data_type"].text() == "INT")
             data_type = ColumnAttribute::INT;
-        else if ((*row)["data_type"].s == "TEXT")
+        else if ((*row)["data_type"].text() == "TEXT")
             data_type = ColumnAttribute::TEXT;
-        else if ((*row)["data_type"].s == "BOOLEAN")
+        else if ((*row)["data_type"].text() == "BOOLEAN")
             data_type = ColumnAttribute::BOOLEAN;
         else
             throw DbRelationError("Unknown data type");
@@ -149,11 +157,28 @@ DbRelation& Tables::get_table(Identifier table_name) {
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end())
         return  *Tables::table_cache[table_name];
 
-    // otherwise assume it is a HeapTable (for now)
+    // otherwise it is whichever storage engine it was created with
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    DbRelation &tables = *Tables::table_cache[TABLE_NAME];
+    Handles* handles = tables.select(&where);
+    Identifier storage = "heap";
+    if (!handles->empty()) {
+        ValueDict* row = tables.project(handles->front());
+        if (!(*row)["storage"].is_null())
+            storage = (*row)["storage"].text();
+        delete row;
+    }
+    delete handles;
+
     ColumnNames column_names;
     ColumnAttributes column_attributes;
     get_columns(table_name, column_names, column_attributes);
-    DbRelation* table = new HeapTable(table_name, column_names, column_attributes);
+    DbRelation* table;
+    if (storage == "column")
+        table = new ColumnTable(table_name, column_names, column_attributes);
+    else
+        table = new HeapTable(table_name, column_names, column_attributes);
     Tables::table_cache[table_name] = table;
     return *table;
 }
@@ -201,6 +226,8 @@ void Columns::create() {
     row["table_name"] = Value("_tables");
     row["column_name"] = Value("table_name");
     insert(&row);
+    row["column_name"] = Value("storage");
+    insert(&row);
 
     row["table_name"] = Value("_columns");
     row["column_name"] = Value("table_name");
@@ -230,12 +257,12 @@ void Columns::create() {
 // Manually check that (table_name, column_name) is unique.
 Handle Columns::insert(const ValueDict* row) {
     // Check that datatype is acceptable
-    if (!is_acceptable_identifier(row->at("table_name").s))
-        throw DbRelationError("unacceptable table name '" + row->at("table_name").s + "'");
-    if (!is_acceptable_identifier(row->at("column_name").s))
-        throw DbRelationError("unacceptable column name '" + row->at("column_name").s + "'");
-    if (!is_acceptable_data_type(row->at("data_type").s))
-        throw DbRelationError("unacceptable data type '" + row->at("data_type").s + "'");
+    if (!is_acceptable_identifier(row->at("table_name").text()))
+        throw DbRelationError("unacceptable table name '" + row->at("table_name").text() + "'");
+    if (!is_acceptable_identifier(row->at("column_name").text()))
+        throw DbRelationError("unacceptable column name '" + row->at("column_name").text() + "'");
+    if (!is_acceptable_data_type(row->at("data_type").text()))
+        throw DbRelationError("unacceptable data type '" + row->at("data_type").text() + "'");
 
     // Try SELECT * FROM _columns WHERE table_name = row["table_name"] AND column_name = column_name["column_name"]
     // and it should return nothing
@@ -246,7 +273,7 @@ Handle Columns::insert(const ValueDict* row) {
     bool unique = handles->empty();
     delete handles;
     if (!unique)
-        throw DbRelationError("duplicate column " + row->at("table_name").s + "." + row->at("column_name").s);
+        throw DbRelationError("duplicate column " + row->at("table_name").text() + "." + row->at("column_name").text());
 
     return HeapTable::insert(row);
 }
@@ -298,8 +325,8 @@ Indices::Indices() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES())
 // Manually check constraints -- unique on (table, index, column)
 Handle Indices::insert(const ValueDict* row) {
     // Check that datatype is acceptable
-    if (!is_acceptable_identifier(row->at("index_name").s))
-        throw DbRelationError("unacceptable index name '" + row->at("index_name").s + "'");
+    if (!is_acceptable_identifier(row->at("index_name").text()))
+        throw DbRelationError("unacceptable index name '" + row->at("index_name").text() + "'");
 
     // Try SELECT * FROM _indices WHERE table_name = row["table_name"] AND index_name = row["index_name"]
     //     AND column_name = column_name["column_name"]
@@ -313,7 +340,7 @@ Handle Indices::insert(const ValueDict* row) {
     bool unique = handles->empty();
     delete handles;
     if (!unique)
-        throw DbRelationError("duplicate index " + row->at("table_name").s + " " + row->at("index_name").s);
+        throw DbRelationError("duplicate index " + row->at("table_name").text() + " " + row->at("index_name").text());
     return HeapTable::insert(row);
 }
 
@@ -322,8 +349,8 @@ Handle Indices::insert(const ValueDict* row) {
 void Indices::del(Handle handle) {
     // remove from cache, if there
     ValueDict* row = project(handle);
-    Identifier table_name = row->at("table_name").s;
-    Identifier index_name = row->at("index_name").s;
+    Identifier table_name = row->at("table_name").text();
+    Identifier index_name = row->at("index_name").text();
     std::pair<Identifier,Identifier> cache_key(table_name, index_name);
     if (Indices::index_cache.find(cache_key) != Indices::index_cache.end()) {
         DbIndex* index = Indices::index_cache.at(cache_key);
@@ -347,13 +374,13 @@ void Indices::get_columns(Identifier table_name, Identifier index_name,
     for (auto const& handle: *handles) {
         ValueDict *row = project(handle);
 
-        Identifier column_name = (*row)["column_name"].s;
+        Identifier column_name = (*row)["column_name"].text();
         uint which = (uint) (*row)["seq_in_index"].n;
         colnames[which - 1] = column_name;  // seq_in_index is 1-based
         if (which > size)
             size = which;
         is_unique = (*row)["is_unique"].n != 0;
-        is_hash = (*row)["index_type"].s == "HASH";
+        is_hash = (*row)["index_type"].text() == "HASH";
         delete row;
     }
     for (uint i = 0; i < size; i++)
@@ -361,20 +388,6 @@ void Indices::get_columns(Identifier table_name, Identifier index_name,
     delete handles;
 }
 
-// FIXME - use this for now until we have HashIndex
-class DummyIndex : public DbIndex {
-public:
-    DummyIndex(DbRelation& rel, Identifier idx, ColumnNames key, bool unq) : DbIndex(rel, idx, key, unq) {}
-    void create() {}
-    void drop() {}
-    void open() {}
-    void close() {}
-    Handles* lookup(ValueDict* key_values) const {return nullptr;}
-    void insert(Handle handle) {}
-    void del(Handle handle) {}
-};
-
-
 // Return a table for given table_name.
 DbIndex& Indices::get_index(Identifier table_name, Identifier index_name) {
     // if they are asking about an index we've once constructed, then just return that one
@@ -382,14 +395,14 @@ DbIndex& Indices::get_index(Identifier table_name, Identifier index_name) {
     if (Indices::index_cache.find(cache_key) != Indices::index_cache.end())
         return  *Indices::index_cache[cache_key];
 
-    // otherwise assume it is a DummyIndex (for now)
+    // otherwise construct the right kind from the _indices entries
     ColumnNames column_names;
     bool is_hash, is_unique;
     get_columns(table_name, index_name, column_names, is_hash, is_unique);
     DbRelation& table = Tables::get_table(table_name);
     DbIndex* index;
     if (is_hash) {
-        index = new DummyIndex(table, index_name, column_names, is_unique);  // FIXME - change to HashIndex
+        index = new HashIndex(table, index_name, column_names, is_unique);
     } else {
         index = new BTreeIndex(table, index_name, column_names, is_unique);
     }
@@ -405,7 +418,7 @@ IndexNames Indices::get_index_names(Identifier table_name) {
     Handles* handles = select(&where);
     for (auto const& handle: *handles) {
         ValueDict* row = project(handle);
-        ret.push_back((*row)["index_name"].s);
+        ret.push_back((*row)["index_name"].text());
         delete row;
     }
     delete handles;
@@ -9,12 +9,15 @@
 #include <iostream>
 #include <string>
 #include <cassert>
+#include <algorithm>
 #include "db_cxx.h"
 #include "SQLParser.h"
 #include "sqlhelper.h"
 #include "heap_storage.h"
 // add for Milestone3
 #include "btree.h"
+#include "hash_index.h"
+#include "column_storage.h"
 #include "ParseTreeToString.h"
 #include "SQLExec.h"
 using namespace std;
@@ -268,6 +271,54 @@ string execute(const SQLStatement *stmt) {
 }
 */
 
+/**
+ * Take a WITH (name=value, ...) clause off the end of a CREATE TABLE or CREATE INDEX, since the
+ * parser doesn't know about them.
+ * @param query  the SQL, returned by reference without the clause
+ * @param with   returned by reference: the options, names and values in lower case
+ * @returns      true if there was such a clause
+ */
+bool split_with(string &query, ValueDict &with) {
+	string lower = query;
+	transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+	size_t start = lower.find_first_not_of(" \t");
+	if (start == string::npos || lower.compare(start, 6, "create") != 0)
+		return false;
+	size_t kind = lower.find_first_not_of(" \t", start + 6);
+	bool index = kind != string::npos && lower.compare(kind, 5, "index") == 0;
+	if (!index && lower.find("table", start + 6) == string::npos)
+		return false;
+	size_t close = lower.find_last_not_of(" \t;");
+	if (close == string::npos || lower[close] != ')')
+		return false;
+	size_t open = lower.rfind('(', close);
+	size_t keyword = open == string::npos || open == 0 ? string::npos : lower.find_last_not_of(" \t", open - 1);
+	if (keyword == string::npos || keyword < 4 || lower.compare(keyword - 3, 4, "with") != 0)
+		return false;
+	size_t columns = lower.find_last_not_of(" \t", keyword - 4);  // the clause follows the column list
+	if (columns == string::npos || (lower[columns] != ')' && !index))  // (or an index's USING)
+		return false;
+
+	string options = lower.substr(open + 1, close - open - 1);
+	size_t from = 0;
+	while (from <= options.size()) {
+		size_t comma = options.find(',', from);
+		string option = options.substr(from, comma == string::npos ? string::npos : comma - from);
+		size_t equals = option.find('=');
+		string name = option.substr(0, equals), value = equals == string::npos ? "" : option.substr(equals + 1);
+		name.erase(0, name.find_first_not_of(" \t"));
+		name.erase(name.find_last_not_of(" \t") + 1);
+		value.erase(0, value.find_first_not_of(" \t"));
+		value.erase(value.find_last_not_of(" \t") + 1);
+		with[name] = Value(value);
+		if (comma == string::npos)
+			break;
+		from = comma + 1;
+	}
+	query = query.substr(0, keyword - 3);
+	return true;
+}
+
 
 /**
  * Main entry point of the sql5300 program
@@ -308,10 +359,21 @@ int main(int argc, char *argv[]) {
 		if (query == "test") {
 			cout << "test_heap_storage: " << (test_heap_storage() ? "ok" : "failed") << endl;
 			cout << "test_btree: " << (test_btree() ? "ok" : "failed") << endl;
+			cout << "test_hash_index: " << (test_hash_index() ? "ok" : "failed") << endl;
+			cout << "test_column_storage: " << (test_column_storage() ? "ok" : "failed") << endl;
+			cout << "test_sql_exec: " << (test_sql_exec() ? "ok" : "failed") << endl;
+			continue;
+		}
+		if (query == "benchmark") {
+			benchmark_heap_compression();
+			benchmark_heap_reuse();
+			benchmark_scan();
 			continue;
 		}
 
 		// use the Hyrise sql parser to get us our AST
+		ValueDict with;
+		bool has_with = split_with(query, with);
 		SQLParserResult* result = SQLParser::parseSQLString(query);
 		if (!result->isValid()) {
 			cout << "invalid SQL: " << query << endl;
@@ -324,7 +386,7 @@ int main(int argc, char *argv[]) {
 					// use ParseTreeToString to deal with
 					//cout << execute(result->getStatement(i)) << endl;
 					cout << ParseTreeToString::statement(statement) << endl;
-					QueryResult *qResult = SQLExec::execute(statement);
+					QueryResult *qResult = SQLExec::execute(statement, has_with ? &with : nullptr);
 					cout << *qResult << endl;
 					delete qResult;
 				} catch (SQLExecError& e) {
@@ -1,85 +1,337 @@
-#include <algorithm>
-#include "storage_engine.h"
-
-bool Value::operator==(const Value &other) const {
-    if (this->data_type != other.data_type)
-        return false;
-    if (this->data_type == ColumnAttribute::INT)
-        return this->n == other.n;
-    return this->s == other.s;
-}
-
-bool Value::operator!=(const Value &other) const {
-    return !(*this == other);
-}
-
-bool Value::operator<(const Value &other) const {
-    if (this->data_type != other.data_type) {
-        // arbitrary ordering of data types: BOOLEAN < INT < TEXT
-        if (this->data_type == ColumnAttribute::BOOLEAN)
-            return true;
-        if (other.data_type == ColumnAttribute::BOOLEAN)
-            return false;
-        if (this->data_type == ColumnAttribute::INT)
-            return true;
-        if (other.data_type == ColumnAttribute::INT)
-            return false;
-        return false; // should never reach this
-    }
-    if (this->data_type == ColumnAttribute::TEXT)
-        return this->s < other.s;
-    return this->n < other.n;
-}
-
-
-// Get only selected column attributes
-ColumnAttributes* DbRelation::get_column_attributes(const ColumnNames &select_column_names) const {
-    ColumnAttributes *ret = new ColumnAttributes();
-    for (auto const& column_name: select_column_names) {
-        auto it = std::find(this->column_names.begin(), this->column_names.end(), column_name);
-        if (it == this->column_names.end()) {
-            delete ret;
-            throw DbRelationError("unknown column " + column_name);
-        }
-        ptrdiff_t index = it - this->column_names.begin();
-        ret->push_back(this->column_attributes[index]);
-    }
-    return ret;
-}
-
-// Just pulls out the column names from a ValueDict and passes that to the usual form of project().
-ValueDict* DbRelation::project(Handle handle, const ValueDict* where) {
-    ColumnNames t;
-    for (auto const& column: *where)
-        t.push_back(column.first);
-    return this->project(handle, &t);
-}
-
-
-// Do a projection for each of a list of handles
-ValueDicts* DbRelation::project(Handles *handles) {
-    ValueDicts *ret = new ValueDicts();
-    for (auto const& handle: *handles)
-        ret->push_back(project(handle));
-    return ret;
-}
-
-// Do a projection for each of a list of handles
-ValueDicts* DbRelation::project(Handles *handles, const ColumnNames *column_names) {
-    ValueDicts *ret = new ValueDicts();
-    for (auto const& handle: *handles)
-        ret->push_back(project(handle, column_names));
-    return ret;
-}
-
-// Do a projection for each of a list of handles
-ValueDicts* DbRelation::project(Handles *handles, const ValueDict* where) {
-    ColumnNames t;
-    for (auto const& column: *where)
-        t.push_back(column.first);
-    ValueDicts *ret = new ValueDicts();
-    for (auto const& handle: *handles)
-        ret->push_back(project(handle, &t));
-    return ret;
-}
-
+#include <algorithm>
+#include "storage_engine.h"
+
+Value::Value(const char *data, size_t size)
+        : data_type(ColumnAttribute::TEXT), n(0), size(0), storage(INLINE), nulled(false) {
+    set_text(data, size);
+}
+
+Value::Value(const Value &other)
+        : data_type(other.data_type), n(other.n), size(0), storage(INLINE), nulled(other.nulled) {
+    set_text(other.text_data(), other.size);
+}
+
+Value::Value(Value &&other) noexcept
+        : data_type(other.data_type), n(other.n), size(other.size), storage(other.storage), nulled(other.nulled) {
+    this->bytes = other.bytes;
+    other.size = 0;
+    other.storage = INLINE;
+}
+
+Value &Value::operator=(const Value &other) {
+    if (this != &other) {
+        // copy first: other's text could be ours if it views it
+        Value copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+Value &Value::operator=(Value &&other) noexcept {
+    if (this != &other) {
+        release();
+        this->data_type = other.data_type;
+        this->n = other.n;
+        this->size = other.size;
+        this->storage = other.storage;
+        this->nulled = other.nulled;
+        this->bytes = other.bytes;
+        other.size = 0;
+        other.storage = INLINE;
+    }
+    return *this;
+}
+
+Value Value::view(const char *data, size_t size) {
+    Value value;
+    value.data_type = ColumnAttribute::TEXT;
+    value.size = (uint32_t)size;
+    value.storage = VIEW;
+    value.bytes.ptr = data;
+    return value;
+}
+
+Value Value::null(ColumnAttribute::DataType data_type) {
+    Value value;
+    value.data_type = data_type;
+    value.nulled = true;
+    return value;
+}
+
+void Value::set_text(const char *data, size_t size) {
+    release();
+    this->size = (uint32_t)size;
+    if (size <= INLINE_TEXT) {
+        this->storage = INLINE;
+        if (size > 0)
+            memcpy(this->bytes.chars, data, size);
+    } else {
+        char *copy = new char[size];
+        memcpy(copy, data, size);
+        this->storage = HEAP;
+        this->bytes.ptr = copy;
+    }
+}
+
+void Value::release() {
+    if (this->storage == HEAP)
+        delete[] this->bytes.ptr;
+    this->storage = INLINE;
+    this->size = 0;
+}
+
+int Value::compare_text(const char *data, size_t size) const {
+    int cmp = memcmp(text_data(), data, std::min((size_t)this->size, size));
+    if (cmp != 0)
+        return cmp;
+    return this->size < size ? -1 : (this->size > size ? 1 : 0);
+}
+
+bool Value::operator==(const Value &other) const {
+    if (this->data_type != other.data_type)
+        return false;
+    if (this->nulled || other.nulled)
+        return this->nulled == other.nulled;
+    if (this->data_type == ColumnAttribute::TEXT)
+        return this->size == other.size && memcmp(text_data(), other.text_data(), this->size) == 0;
+    return this->n == other.n;
+}
+
+bool Value::operator!=(const Value &other) const {
+    return !(*this == other);
+}
+
+bool Value::operator<(const Value &other) const {
+    if (this->data_type != other.data_type) {
+        // arbitrary ordering of data types: BOOLEAN < INT < TEXT
+        if (this->data_type == ColumnAttribute::BOOLEAN)
+            return true;
+        if (other.data_type == ColumnAttribute::BOOLEAN)
+            return false;
+        if (this->data_type == ColumnAttribute::INT)
+            return true;
+        if (other.data_type == ColumnAttribute::INT)
+            return false;
+        return false; // should never reach this
+    }
+    if (this->nulled || other.nulled)
+        return this->nulled && !other.nulled;
+    if (this->data_type == ColumnAttribute::TEXT)
+        return compare_text(other.text_data(), other.size) < 0;
+    return this->n < other.n;
+}
+
+
+// Get only selected column attributes
+ColumnAttributes* DbRelation::get_column_attributes(const ColumnNames &select_column_names) const {
+    ColumnAttributes *ret = new ColumnAttributes();
+    for (auto const& column_name: select_column_names) {
+        auto it = std::find(this->column_names.begin(), this->column_names.end(), column_name);
+        if (it == this->column_names.end()) {
+            delete ret;
+            throw DbRelationError("unknown column " + column_name);
+        }
+        ptrdiff_t index = it - this->column_names.begin();
+        ret->push_back(this->column_attributes[index]);
+    }
+    return ret;
+}
+
+// Raise the lower bound if value is at least as restrictive as the current one.
+void ValueRange::restrict_min(const Value &value, bool inclusive) {
+    if (!this->has_min || this->min < value || (value == this->min && !inclusive)) {
+        this->min = value;
+        this->min_inclusive = inclusive;
+        this->has_min = true;
+    }
+}
+
+// Lower the upper bound if value is at least as restrictive as the current one.
+void ValueRange::restrict_max(const Value &value, bool inclusive) {
+    if (!this->has_max || value < this->max || (value == this->max && !inclusive)) {
+        this->max = value;
+        this->max_inclusive = inclusive;
+        this->has_max = true;
+    }
+}
+
+// Check value against both bounds. NULL is in no range.
+bool ValueRange::contains(const Value &value) const {
+    if (value.is_null())
+        return false;
+    if (this->has_min && (value < this->min || (!this->min_inclusive && value == this->min)))
+        return false;
+    if (this->has_max && (this->max < value || (!this->max_inclusive && value == this->max)))
+        return false;
+    return true;
+}
+
+// Hand back the next of the materialized handles.
+bool HandlesCursor::next(Handle &handle) {
+    if (this->handles == nullptr || this->position >= this->handles->size())
+        return false;
+    handle = (*this->handles)[this->position++];
+    return true;
+}
+
+SelectCursor::SelectCursor(DbRelation &relation, DbCursor* input, const ValueDict* where, const ValueRanges* ranges)
+        : relation(relation), input(input), where(where), ranges(ranges), row(nullptr) {
+    ColumnNames column_names;
+    if (where != nullptr)
+        for (auto const& column: *where) {
+            this->equalities.push_back(std::make_pair((uint)column_names.size(), &column.second));
+            column_names.push_back(column.first);
+        }
+    if (ranges != nullptr)
+        for (auto const& column: *ranges) {
+            auto it = std::find(column_names.begin(), column_names.end(), column.first);
+            this->bounds.push_back(std::make_pair((uint)(it - column_names.begin()), &column.second));
+            if (it == column_names.end())
+                column_names.push_back(column.first);
+        }
+    if (!column_names.empty())
+        this->row = new Row(relation.get_layout(&column_names));
+}
+
+// Pull from the input cursor until a row matches the where clause.
+bool SelectCursor::next(Handle &handle) {
+    while (this->input->next(handle)) {
+        if (this->row == nullptr)
+            return true;
+        this->relation.project(handle, *this->row);
+        bool matched = true;
+        for (auto const& equality: this->equalities)
+            matched = matched && (*this->row)[equality.first] == *equality.second;
+        for (auto const& bound: this->bounds)
+            matched = matched && bound.second->contains((*this->row)[bound.first]);
+        if (matched)
+            return true;
+    }
+    return false;
+}
+
+// Default cursor just walks the materialized result of select(), checking any ranges a row at a time.
+DbCursor* DbRelation::cursor(const ValueDict* where, const ValueRanges* ranges) {
+    DbCursor *cursor = new HandlesCursor(where == nullptr ? this->select() : this->select(where));
+    if (ranges != nullptr && !ranges->empty())
+        cursor = this->cursor(cursor, nullptr, ranges);
+    return cursor;
+}
+
+// Default restricted cursor projects each input row to check it.
+DbCursor* DbRelation::cursor(DbCursor* input, const ValueDict* where, const ValueRanges* ranges) {
+    return new SelectCursor(*this, input, where, ranges);
+}
+
+// Just pulls out the column names from a ValueDict and passes that to the usual form of project().
+ValueDict* DbRelation::project(Handle handle, const ValueDict* where) {
+    ColumnNames t;
+    for (auto const& column: *where)
+        t.push_back(column.first);
+    return this->project(handle, &t);
+}
+
+
+// Do a projection for each of a list of handles
+ValueDicts* DbRelation::project(Handles *handles) {
+    ValueDicts *ret = new ValueDicts();
+    for (auto const& handle: *handles)
+        ret->push_back(project(handle));
+    return ret;
+}
+
+// Do a projection for each of a list of handles
+ValueDicts* DbRelation::project(Handles *handles, const ColumnNames *column_names) {
+    ValueDicts *ret = new ValueDicts();
+    for (auto const& handle: *handles)
+        ret->push_back(project(handle, column_names));
+    return ret;
+}
+
+// Do a projection for each of a list of handles
+ValueDicts* DbRelation::project(Handles *handles, const ValueDict* where) {
+    ColumnNames t;
+    for (auto const& column: *where)
+        t.push_back(column.first);
+    return project(handles, &t);
+}
+
+// Default layout is the projection's columns with their attributes, and where the relation's columns go.
+RowLayoutPtr DbRelation::get_layout(const ColumnNames* column_names) const {
+    const ColumnNames &names = column_names->empty() ? this->column_names : *column_names;
+    ColumnAttributes *column_attributes = get_column_attributes(names);
+    std::vector<int> slots(this->column_names.size(), -1);
+    bool duplicates = false;
+    for (uint i = 0; i < names.size(); i++) {
+        ptrdiff_t index = std::find(this->column_names.begin(), this->column_names.end(), names[i])
+                          - this->column_names.begin();
+        if (slots[index] == -1)
+            slots[index] = (int)i;
+        else
+            duplicates = true;
+    }
+    RowLayoutPtr layout = std::make_shared<RowLayout>(names, *column_attributes, slots, duplicates);
+    delete column_attributes;
+    return layout;
+}
+
+// Default positional projection goes by way of the ValueDict one.
+void DbRelation::project(Handle handle, Row &row) {
+    const ColumnNames &column_names = row.get_layout().get_column_names();
+    ValueDict *dict = project(handle, &column_names);
+    for (uint i = 0; i < row.size(); i++)
+        row[i] = std::move((*dict)[column_names[i]]);
+    row.fill_duplicates();
+    delete dict;
+}
+
+// Do a positional projection for each of a list of handles
+void DbRelation::project(Handles *handles, RowLayoutPtr layout, Rows &rows) {
+    rows.reserve(rows.size() + handles->size());
+    for (auto const& handle: *handles) {
+        Row *row = new Row(layout);
+        project(handle, *row);
+        rows.push_back(row);
+    }
+}
+
+int RowLayout::ordinal(const Identifier &column_name) const {
+    auto it = std::find(this->column_names.begin(), this->column_names.end(), column_name);
+    return it == this->column_names.end() ? -1 : (int)(it - this->column_names.begin());
+}
+
+Row::Row(RowLayoutPtr layout, const ValueDict &dict) : layout(layout), values() {
+    this->values.reserve(layout->size());
+    for (auto const& column_name: layout->get_column_names()) {
+        auto it = dict.find(column_name);
+        if (it == dict.end())
+            throw DbRelationError("no value for column " + column_name);
+        this->values.push_back(it->second);
+    }
+}
+
+const Value &Row::at(const Identifier &column_name) const {
+    int i = this->layout->ordinal(column_name);
+    if (i < 0)
+        throw DbRelationError("unknown column " + column_name);
+    return this->values[i];
+}
+
+ValueDict *Row::to_dict() const {
+    ValueDict *dict = new ValueDict();
+    const ColumnNames &column_names = this->layout->get_column_names();
+    for (uint i = 0; i < this->values.size(); i++)
+        dict->emplace(column_names[i], this->values[i]);
+    return dict;
+}
+
+void Row::fill_duplicates() {
+    if (!this->layout->has_duplicates())
+        return;
+    const ColumnNames &column_names = this->layout->get_column_names();
+    for (uint i = 0; i < this->values.size(); i++) {
+        int first = this->layout->ordinal(column_names[i]);
+        if (first != (int)i)
+            this->values[i] = this->values[first];
+    }
+}
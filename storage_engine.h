@@ -9,8 +9,11 @@
  */
 #pragma once
 
+#include <cstring>
 #include <exception>
 #include <map>
+#include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 #include "db_cxx.h"
@@ -46,9 +49,10 @@ typedef std::length_error DbBlockNoRoomError;
 class DbBlock {
 public:
 	/**
-	 * our blocks are 4kB
+	 * our blocks are 4kB, unless their file was created with bigger ones (up to MAX_BLOCK_SZ)
 	 */ 
 	static const uint BLOCK_SZ = 4096;
+	static const uint MAX_BLOCK_SZ = 32768;
 
 	/**
 	 * ctor/dtor (subclasses should handle the big-5)
@@ -115,6 +119,12 @@ public:
 	 */
 	virtual void* get_data() {return block.get_data();}
 
+	/**
+	 * Get the size of this block, which is its file's block size.
+	 * @returns  bytes in the block
+	 */
+	virtual uint get_size() const {return block.get_size();}
+
 	/**
 	 * Get this block's BlockID within its DbFile.
 	 * @returns this block's id
@@ -138,6 +148,7 @@ typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an
  * 	get_new()
  *	get(block_id)
  *	put(block)
+ *	unpin(block)
  *	block_ids()
  */
 class DbFile {
@@ -168,14 +179,14 @@ public:
 
 	/**
 	 * Add a new block for this file.
-	 * @returns  the newly appended block
+	 * @returns  the newly appended block (released by caller with unpin())
 	 */
 	virtual DbBlock* get_new() = 0;
 
 	/**
 	 * Get a specific block in this file.
 	 * @param block_id  which block to get
-	 * @returns         pointer to the DbBlock (freed by caller)
+	 * @returns         pointer to the DbBlock (released by caller with unpin())
 	 */
 	virtual DbBlock* get(BlockID block_id) = 0;
 
@@ -185,6 +196,13 @@ public:
 	 */
 	virtual void put(DbBlock* block) = 0;
 
+	/**
+	 * Release a block obtained from get() or get_new().
+	 * The block must not be used again by the caller afterwards.
+	 * @param block  block to release
+	 */
+	virtual void unpin(DbBlock* block) = 0;
+
 	/**
 	 * Get a list of all the valid BlockID's in the file
 	 * FIXME - not a good long-term approach, but we'll do this until we put in iterators
@@ -211,7 +229,7 @@ public:
 	ColumnAttribute(DataType data_type) : data_type(data_type) {}
 	virtual ~ColumnAttribute() {}
 
-	virtual DataType get_data_type() { return data_type; }
+	virtual DataType get_data_type() const { return data_type; }
 	virtual void set_data_type(DataType data_type) {this->data_type = data_type;}
 
 protected:
@@ -221,20 +239,78 @@ protected:
 
 /**
  * @class Value - holds value for a field
+ *
+ * A tagged value: INT and BOOLEAN use just n. TEXT of up to INLINE_TEXT bytes is kept right in the
+ * Value, so neither allocates; longer text goes on the heap. A view (see Value::view) instead borrows
+ * its text from bytes someone else owns, like a pinned page. Copying a Value always gives one that
+ * owns its text, so a view only lives as long as it isn't copied; moving it keeps it a view.
+ * Any type of value may be NULL (see Value::null): a NULL equals only another NULL of its type and
+ * sorts ahead of the rest of them.
  */
 class Value {
 public:
+	static const uint INLINE_TEXT = 16;  // longest text kept in the Value itself
+
 	ColumnAttribute::DataType data_type;
 	int32_t n;
-	std::string s;
 
-	Value() : n(0) {data_type = ColumnAttribute::INT;}
-	Value(int32_t n) : n(n) {data_type = ColumnAttribute::INT;}
-	Value(std::string s) : s(s) {data_type = ColumnAttribute::TEXT; }
+	Value() : data_type(ColumnAttribute::INT), n(0), size(0), storage(INLINE), nulled(false) {}
+	Value(int32_t n) : data_type(ColumnAttribute::INT), n(n), size(0), storage(INLINE), nulled(false) {}
+	Value(const std::string &s) : Value(s.data(), s.size()) {}
+	Value(const char *s) : Value(s, strlen(s)) {}
+	Value(const char *data, size_t size);  // TEXT, copied
+	Value(const Value &other);
+	Value(Value &&other) noexcept;  // noexcept, so a growing std::vector<Value> moves rather than copies
+	~Value() { release(); }
+	Value &operator=(const Value &other);
+	Value &operator=(Value &&other) noexcept;
+
+	static Value view(const char *data, size_t size);  // TEXT, borrowed: data must outlive the view
+	static Value null(ColumnAttribute::DataType data_type);
+	bool is_null() const { return this->nulled; }
+
+	// for TEXT
+	const char *text_data() const { return this->storage == INLINE ? this->bytes.chars : this->bytes.ptr; }
+	size_t text_size() const { return this->size; }
+	std::string text() const { return std::string(text_data(), this->size); }
+	int compare_text(const char *data, size_t size) const;  // like memcmp, then shorter first
 
 	bool operator==(const Value &other) const;
 	bool operator!=(const Value &other) const;
     bool operator<(const Value &other) const;
+
+protected:
+	enum Storage : uint8_t {INLINE, HEAP, VIEW};
+
+	uint32_t size;
+	Storage storage;
+	bool nulled;
+	union {
+		char chars[INLINE_TEXT];
+		const char *ptr;
+	} bytes;
+
+	void set_text(const char *data, size_t size);
+	void release();
+};
+
+/**
+ * @class ValueRange - bounds on a field's values (from <, <=, >, >=, or BETWEEN)
+ * A missing bound is open-ended.
+ */
+class ValueRange {
+public:
+	bool has_min, has_max;
+	bool min_inclusive, max_inclusive;
+	Value min, max;
+
+	ValueRange() : has_min(false), has_max(false), min_inclusive(true), max_inclusive(true) {}
+
+	// tighten the bounds, keeping whichever of the old and new bound is more restrictive
+	void restrict_min(const Value &value, bool inclusive);
+	void restrict_max(const Value &value, bool inclusive);
+
+	bool contains(const Value &value) const;
 };
 
 // More type aliases
@@ -242,9 +318,66 @@ typedef std::string Identifier;
 typedef std::vector<Identifier> ColumnNames;
 typedef std::vector<ColumnAttribute> ColumnAttributes;
 typedef std::pair<BlockID, RecordID> Handle;
-typedef std::vector<Handle> Handles;  // FIXME: will need to turn this into an iterator at some point
+typedef std::vector<Handle> Handles;  // see DbCursor for streaming through rows instead
 typedef std::map<Identifier, Value> ValueDict;
 typedef std::vector<ValueDict*> ValueDicts;
+typedef std::map<Identifier, ValueRange> ValueRanges;
+
+/**
+ * @class RowLayout - which columns a Row holds, in order
+ * One layout is shared by all the rows of a projection, so the rows themselves don't carry any column
+ * names. A layout made by DbRelation::get_layout also knows where each of the relation's columns goes.
+ */
+class RowLayout {
+public:
+	RowLayout(const ColumnNames &column_names, const ColumnAttributes &column_attributes)
+		: column_names(column_names), column_attributes(column_attributes), slots(), duplicates(false) {}
+	RowLayout(const ColumnNames &column_names, const ColumnAttributes &column_attributes,
+			  const std::vector<int> &slots, bool duplicates)
+		: column_names(column_names), column_attributes(column_attributes), slots(slots), duplicates(duplicates) {}
+
+	size_t size() const { return column_names.size(); }
+	const ColumnNames &get_column_names() const { return column_names; }
+	const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+	int ordinal(const Identifier &column_name) const;  // first place column_name is at, -1 if nowhere
+
+	// for each of the relation's columns, its ordinal in the row (-1 if it's left out)
+	const std::vector<int> &get_slots() const { return slots; }
+	bool has_duplicates() const { return duplicates; }  // some relation column is in the row more than once
+
+protected:
+	ColumnNames column_names;
+	ColumnAttributes column_attributes;
+	std::vector<int> slots;
+	bool duplicates;
+};
+typedef std::shared_ptr<const RowLayout> RowLayoutPtr;
+
+/**
+ * @class Row - a row's values, by their column's ordinal in the row's RowLayout
+ */
+class Row {
+public:
+	Row(RowLayoutPtr layout) : layout(layout), values(layout->size()) {}
+	Row(RowLayoutPtr layout, const ValueDict &dict);  // throws if dict is missing one of the layout's columns
+
+	const RowLayout &get_layout() const { return *layout; }
+	const RowLayoutPtr &get_layout_ptr() const { return layout; }
+	size_t size() const { return values.size(); }
+	Value &operator[](size_t i) { return values[i]; }
+	const Value &operator[](size_t i) const { return values[i]; }
+	Value *data() { return values.data(); }
+	const Value *data() const { return values.data(); }
+	const Value &at(const Identifier &column_name) const;  // throws if column_name isn't in the row
+
+	ValueDict *to_dict() const;  // for code that still works with a ValueDict (freed by caller)
+	void fill_duplicates();  // copy each duplicated column's value from its first appearance
+
+protected:
+	RowLayoutPtr layout;
+	std::vector<Value> values;
+};
+typedef std::vector<Row*> Rows;
 
 
 /**
@@ -256,6 +389,92 @@ public:
 };
 
 
+/**
+ * @class DbCursor - pull-based iterator over the handles of qualifying rows
+ *
+ * Usage:
+ * 	DbCursor* cursor = relation.cursor(where);
+ * 	cursor->open();
+ * 	while (cursor->next(handle))
+ * 		...
+ * 	cursor->close();
+ * 	delete cursor;
+ */
+class DbCursor {
+public:
+	// ctor/dtor
+	DbCursor() {}
+	virtual ~DbCursor() {}
+
+	/**
+	 * Position the cursor before the first qualifying row.
+	 */
+	virtual void open() = 0;
+
+	/**
+	 * Advance to the next qualifying row.
+	 * @param handle  returned by reference: the next row's handle
+	 * @returns       false once there are no more rows
+	 */
+	virtual bool next(Handle &handle) = 0;
+
+	/**
+	 * Release whatever the cursor is holding onto.
+	 */
+	virtual void close() = 0;
+};
+
+
+/**
+ * @class HandlesCursor - DbCursor over an already materialized list of handles
+ */
+class HandlesCursor : public DbCursor {
+public:
+	// takes ownership of handles (which may be nullptr for an empty list)
+	HandlesCursor(Handles* handles) : handles(handles), position(0) {}
+	virtual ~HandlesCursor() { delete handles; }
+	HandlesCursor(const HandlesCursor& other) = delete;
+	HandlesCursor& operator=(const HandlesCursor& other) = delete;
+
+	virtual void open() { position = 0; }
+	virtual bool next(Handle &handle);
+	virtual void close() {}
+
+protected:
+	Handles* handles;
+	size_t position;
+};
+
+class DbRelation;
+
+/**
+ * @class SelectCursor - DbCursor that filters the rows of another cursor
+ * by projecting each of them and comparing to the where-clause predicates
+ * (equalities in where, bounds in ranges; either may be nullptr)
+ */
+class SelectCursor : public DbCursor {
+public:
+	// takes ownership of input; where and ranges must outlive this cursor
+	SelectCursor(DbRelation &relation, DbCursor* input, const ValueDict* where, const ValueRanges* ranges=nullptr);
+	virtual ~SelectCursor() { delete input; delete row; }
+	SelectCursor(const SelectCursor& other) = delete;
+	SelectCursor& operator=(const SelectCursor& other) = delete;
+
+	virtual void open() { input->open(); }
+	virtual bool next(Handle &handle);
+	virtual void close() { input->close(); }
+
+protected:
+	DbRelation &relation;
+	DbCursor* input;
+	const ValueDict* where;
+	const ValueRanges* ranges;
+	Row* row;  // every column mentioned in where or ranges, reused for each input row
+	std::vector<std::pair<uint, const Value*>> equalities;  // by ordinal in row
+	std::vector<std::pair<uint, const ValueRange*>> bounds;  // same
+};
+
+
 /**
  * @class DbRelation - top-level object handling a physical database relation
  * 
@@ -357,6 +576,24 @@ public:
 	 */
 	virtual Handles* select(Handles* current_selection, const ValueDict* where) = 0;
 
+	/**
+	 * Streaming version of select(where): rows are handed back one at a time
+	 * instead of all being collected first.
+	 * @param where   where-clause predicates (nullptr for all rows, must outlive the cursor)
+	 * @param ranges  range predicates (nullptr for none, must outlive the cursor)
+	 * @returns       an unopened cursor over handles for qualifying rows (freed by caller)
+	 */
+	virtual DbCursor* cursor(const ValueDict* where=nullptr, const ValueRanges* ranges=nullptr);
+
+	/**
+	 * Streaming version of select(current_selection, where).
+	 * @param input   cursor over the rows to restrict (owned by the returned cursor)
+	 * @param where   equality predicates (nullptr for none, must outlive the cursor)
+	 * @param ranges  range predicates (nullptr for none, must outlive the cursor)
+	 * @returns       an unopened cursor over handles for qualifying rows (freed by caller)
+	 */
+	virtual DbCursor* cursor(DbCursor* input, const ValueDict* where, const ValueRanges* ranges=nullptr);
+
 	/**
 	 * Return a sequence of all values for handle (SELECT *).
 	 * @param handle  row to get values from
@@ -387,6 +624,28 @@ public:
 	virtual ValueDicts* project(Handles *handles, const ColumnNames* column_names);
 	virtual ValueDicts* project(Handles *handles, const ValueDict* column_names);
 
+	/**
+	 * Layout for the rows of a projection onto column_names, for them all to share.
+	 * @param column_names  list of column names to project (all of them, in order, if empty)
+	 * @returns             the layout, with slots for this relation
+	 */
+	virtual RowLayoutPtr get_layout(const ColumnNames* column_names) const;
+
+	/**
+	 * Positional version of project(handle, column_names), into a row that can be reused.
+	 * @param handle  row to get values from
+	 * @param row     returned by reference: values for the columns of its layout (from get_layout)
+	 */
+	virtual void project(Handle handle, Row &row);
+
+	/**
+	 * Positional version of project(handles, column_names).
+	 * @param handles  rows to get values from
+	 * @param layout   columns to project (from get_layout)
+	 * @param rows     returned by reference: a new Row appended for each handle (freed by caller)
+	 */
+	virtual void project(Handles *handles, RowLayoutPtr layout, Rows &rows);
+
 	/**
 	 * Accessor for column_names.
 	 * @returns column_names   list of column names for this relation, in order
@@ -467,14 +726,24 @@ public:
 
 	/**
 	 * Lookup a range of search keys.
-	 * @param min_key  dictionary of min (inclusive) search key
-	 * @param max_key  dictionary of max (inclusive) search key
-	 * @returns        list of DbFile handles for records in range
-	 */
-    virtual Handles* range(ValueDict* min_key, ValueDict* max_key) const {
+	 * Either bound may give just the leading columns of the search key.
+	 * @param min_key        dictionary of min search key (nullptr for no lower bound)
+	 * @param max_key        dictionary of max search key (nullptr for no upper bound)
+	 * @param min_inclusive  whether keys equal to min_key qualify
+	 * @param max_inclusive  whether keys equal to max_key qualify
+	 * @returns              list of DbFile handles for records in range
+	 */
+    virtual Handles* range(ValueDict* min_key, ValueDict* max_key,
+                           bool min_inclusive=true, bool max_inclusive=true) const {
         throw DbRelationError("range index query not supported");
     }
 
+	/**
+	 * Accessor for key_columns.
+	 * @returns  the columns of the search key, in order
+	 */
+    virtual const ColumnNames& get_key_columns() const { return key_columns; }
+
 	/**
 	 * Insert the index entry for the given record.
 	 * @param record  handle (into relation) to the record to insert